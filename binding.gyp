@@ -4,12 +4,30 @@
       'target_name': 'git',
       'win_delay_load_hook': 'false',
       'dependencies': [
-        'libgit2'
+        'libgit2',
+        'zlib'
       ],
       'include_dirs': [ '<!(node -e "require(\'nan\')")' ],
       'sources': [
         'src/repository.cc',
         'src/git-worker.cc',
+        'src/work-queue.cc',
+        'src/scheduler.cc',
+        'src/status-watcher.cc',
+        'src/parallel.cc',
+        'src/untracked-cache.cc',
+        'src/head-cache.cc',
+        'src/intraline.cc',
+        'src/latest-requests.cc',
+        'src/blob-stream.cc',
+        'src/diff-session.cc',
+        'src/diff-text.cc',
+        'src/changed-paths.cc',
+        'src/commit-cache.cc',
+        'src/commit-graph.cc',
+        'src/commit-log.cc',
+        'src/tree-diff.cc',
+        'src/myers.cc',
         'src/common.cc'
       ],
       'cflags': ['-fexceptions'],
@@ -160,6 +160,17 @@ describe('git', function () {
             });
         });
     });
+    describe('.getSchedulerStats()', function () {
+        it('reports the work done by each lane', function (done) {
+            git.open(__dirname, { lane: 'background' }).then(function () {
+                let stats = git.getSchedulerStats();
+                expect(stats.background.completed).toBeGreaterThan(0);
+                expect(stats.background.threads).toBeGreaterThan(0);
+                expect(stats.interactive.queued).toBe(0);
+                done();
+            }, done.fail);
+        });
+    });
     describe('.getPath()', function () {
         it('returns the path to the .git directory', function (done) {
             git.open(__dirname).then(function (repo) {
@@ -438,6 +449,214 @@ describe('git', function () {
             }, done.fail);
         });
     });
+    describe('.getCommitCount(fromCommit, toCommit)', function () {
+        let repo;
+        beforeEach(function (done) {
+            let repoDirectory = temp.mkdirSync('node-git-repo-');
+            wrench.copyDirSyncRecursive('fixtures/ahead-behind.git', path.join(repoDirectory, '.git'));
+            git.open(repoDirectory).then(function (res) {
+                repo = res;
+                done();
+            }, done.fail);
+        });
+        it('counts the commits and finds the merge base from the commit graph', function (done) {
+            let master = '78a4842f7e6e4ef5c3076aaf5a9e9336ceee54d8';
+            let origin = '2f2309073d2f947005299cf23769d0fd7a4791d6';
+            expect(repo.getCommitCount(master, origin)).toBe(3);
+            expect(repo.getCommitCount(origin, master)).toBe(2);
+            expect(repo.getMergeBase(master, origin)).toBe('50719ab369dcbbc2fb3b7a0167c52accbd0eb40e');
+            repo.getCommitCountAsync(master, master).then(function (count) {
+                expect(count).toBe(0);
+                expect(repo.getCommitCount(master, origin)).toBe(3);
+                done();
+            }, done.fail);
+        });
+    });
+    describe('.getAheadBehindCounts(branches)', function () {
+        let repo;
+        beforeEach(function (done) {
+            let repoDirectory = temp.mkdirSync('node-git-repo-');
+            wrench.copyDirSyncRecursive('fixtures/ahead-behind.git', path.join(repoDirectory, '.git'));
+            git.open(repoDirectory).then(function (res) {
+                repo = res;
+                done();
+            }, done.fail);
+        });
+        it('counts every tracking branch against its upstream', function (done) {
+            expect(repo.getUpstreamBranch()).toBe('refs/remotes/origin/master');
+            expect(repo.getAheadBehindCount('master')).toEqual({ ahead: 3, behind: 2 });
+            repo.getAheadBehindCounts().then(function (counts) {
+                expect(counts).toEqual({
+                    'refs/heads/master': {
+                        upstream: 'refs/remotes/origin/master',
+                        ahead: 3,
+                        behind: 2
+                    }
+                });
+                return repo.getAheadBehindCounts(['master', 'refs/remotes/origin/master', 'missing']);
+            }).then(function (counts) {
+                expect(Object.keys(counts)).toEqual(['refs/heads/master']);
+                done();
+            }, done.fail);
+        });
+    });
+    describe('.getLog(callback, [options])', function () {
+        let repo;
+        beforeEach(function (done) {
+            let repoDirectory = temp.mkdirSync('node-git-repo-');
+            wrench.copyDirSyncRecursive('fixtures/ahead-behind.git', path.join(repoDirectory, '.git'));
+            git.open(repoDirectory).then(function (res) {
+                repo = res;
+                done();
+            }, done.fail);
+        });
+        it('walks the history page by page', function (done) {
+            let ids = [];
+            let collect = function (commits) {
+                commits.forEach(function (commit) {
+                    ids.push(commit.id);
+                });
+            };
+            repo.getLog(collect, { limit: 2, batchSize: 1 }).then(function (cursor) {
+                expect(ids).toEqual([
+                    '78a4842f7e6e4ef5c3076aaf5a9e9336ceee54d8',
+                    '4a1a04e402ca8fc3834e1861e17f88094e6bfe21'
+                ]);
+                return repo.getLog(collect, { limit: 2, cursor: cursor });
+            }).then(function (cursor) {
+                expect(ids.slice(2)).toEqual([
+                    'f2b8171757c216887e0d5795a284150955fd42c6',
+                    '50719ab369dcbbc2fb3b7a0167c52accbd0eb40e'
+                ]);
+                expect(cursor).toBe(null);
+                done();
+            }, done.fail);
+        });
+        it('decodes the requested fields of a range', function (done) {
+            let commits = [];
+            repo.getLog(function (batch) {
+                commits = commits.concat(batch);
+            }, {
+                range: 'refs/remotes/origin/master..master',
+                order: 'topological',
+                reverse: true,
+                fields: ['parents', 'author', 'summary']
+            }).then(function (cursor) {
+                expect(cursor).toBe(null);
+                expect(commits.map(function (commit) { return commit.summary; })).toEqual(['c1', 'c2', 'c3']);
+                expect(commits[0].parents).toEqual(['50719ab369dcbbc2fb3b7a0167c52accbd0eb40e']);
+                expect(commits[2].author).toEqual({
+                    name: 'Kevin Sawicki',
+                    email: 'kevinsawicki@gmail.com',
+                    time: 1362847018,
+                    offset: -480
+                });
+                expect(commits[2].message).toBeUndefined();
+                expect(commits[2].committer).toBeUndefined();
+                done();
+            }, done.fail);
+        });
+    });
+    describe('.getCommits(commits, [options])', function () {
+        let repoDirectory;
+        beforeEach(function () {
+            repoDirectory = temp.mkdirSync('node-git-repo-');
+            wrench.copyDirSyncRecursive('fixtures/ahead-behind.git', path.join(repoDirectory, '.git'));
+        });
+        it('reads commits through a cache shared by the repositories of a directory', function (done) {
+            let c3 = '78a4842f7e6e4ef5c3076aaf5a9e9336ceee54d8';
+            let first = '50719ab369dcbbc2fb3b7a0167c52accbd0eb40e';
+            let repo, other;
+            git.open(repoDirectory).then(function (res) {
+                repo = res;
+                return repo.getCommits([c3, 'not-a-sha', first]);
+            }).then(function (commits) {
+                expect(commits[0].summary).toBe('c3');
+                expect(commits[0].parents).toEqual(['4a1a04e402ca8fc3834e1861e17f88094e6bfe21']);
+                expect(commits[0].author.name).toBe('Kevin Sawicki');
+                expect(commits[1]).toBe(null);
+                expect(commits[2].summary).toBe('First commit');
+                expect(commits[2].parents).toEqual([]);
+                let stats = repo.getCommitCacheStats();
+                expect(stats.misses).toBe(2);
+                expect(stats.entries).toBe(2);
+                return git.open(repoDirectory);
+            }).then(function (res) {
+                other = res;
+                return other.getCommits([c3]);
+            }).then(function (commits) {
+                expect(commits[0].id).toBe(c3);
+                expect(other.getCommitCacheStats().hits).toBe(1);
+                expect(repo.getCommitCacheStats().hits).toBe(1);
+                done();
+            }, done.fail);
+        });
+    });
+    describe('.getPathHistory(path, [options])', function () {
+        let repo;
+        beforeEach(function (done) {
+            let repoDirectory = temp.mkdirSync('node-git-repo-');
+            wrench.copyDirSyncRecursive('fixtures/ahead-behind.git', path.join(repoDirectory, '.git'));
+            git.open(repoDirectory).then(function (res) {
+                repo = res;
+                done();
+            }, done.fail);
+        });
+        it('returns the commits that changed the path', function (done) {
+            repo.getPathHistory('c.txt').then(function (commits) {
+                expect(commits).toEqual([
+                    '78a4842f7e6e4ef5c3076aaf5a9e9336ceee54d8',
+                    '4a1a04e402ca8fc3834e1861e17f88094e6bfe21',
+                    'f2b8171757c216887e0d5795a284150955fd42c6'
+                ]);
+                return repo.getPathHistory('a.txt', { limit: 1 });
+            }).then(function (commits) {
+                expect(commits).toEqual(['f2b8171757c216887e0d5795a284150955fd42c6']);
+                return repo.getPathHistory('b.txt', { from: 'refs/remotes/origin/master' });
+            }).then(function (commits) {
+                expect(commits).toEqual(['2f2309073d2f947005299cf23769d0fd7a4791d6']);
+                return repo.getPathHistory('missing.txt');
+            }).then(function (commits) {
+                expect(commits).toEqual([]);
+                done();
+            }, done.fail);
+        });
+        it('returns the same commits once the filters are built', function (done) {
+            let filtersPath = path.join(repo.getPath(), 'git-native', 'changed-paths');
+            let waitForFilters = function () {
+                return new Promise(function (resolve) {
+                    let poll = function () {
+                        if (fs.existsSync(filtersPath)) {
+                            resolve();
+                        } else {
+                            setTimeout(poll, 10);
+                        }
+                    };
+                    poll();
+                });
+            };
+            repo.getPathHistory('c.txt').then(waitForFilters).then(function () {
+                return git.open(repo.getWorkingDirectory());
+            }).then(function (reopened) {
+                return Promise.all([
+                    reopened.getPathHistory('c.txt'),
+                    reopened.getPathHistory('b.txt', { from: 'refs/remotes/origin/master' }),
+                    reopened.getPathHistory('missing.txt'),
+                    repo.getPathHistory('c.txt')
+                ]);
+            }).then(function (results) {
+                expect(results[0]).toEqual([
+                    '78a4842f7e6e4ef5c3076aaf5a9e9336ceee54d8',
+                    '4a1a04e402ca8fc3834e1861e17f88094e6bfe21',
+                    'f2b8171757c216887e0d5795a284150955fd42c6'
+                ]);
+                expect(results[1]).toEqual(['2f2309073d2f947005299cf23769d0fd7a4791d6']);
+                expect(results[2]).toEqual([]);
+                expect(results[3]).toEqual(results[0]);
+                done();
+            }, done.fail);
+        });
+    });
     describe('.getDiffStats(path)', function () {
         let repo;
         beforeEach(function (done) {
@@ -494,6 +713,36 @@ describe('git', function () {
             });
         });
     });
+    describe('.getDiffStats(paths)', function () {
+        let repo;
+        beforeEach(function (done) {
+            let repoDirectory = temp.mkdirSync('node-git-repo-');
+            wrench.copyDirSyncRecursive('fixtures/master.git', path.join(repoDirectory, '.git'));
+            git.open(repoDirectory).then(function (res) {
+                repo = res;
+                done();
+            }, done.fail);
+        });
+        it('returns the stats of every changed path', function () {
+            fs.writeFileSync(path.join(repo.getWorkingDirectory(), 'a.txt'), 'changing\na.txt', 'utf8');
+            expect(repo.getDiffStats(null)).toEqual({
+                'a.txt': {added: 2, deleted: 1}
+            });
+            expect(repo.getDiffStats(['a.txt', 'b.txt'])).toEqual({
+                'a.txt': {added: 2, deleted: 1}
+            });
+            expect(repo.getDiffStats([])).toEqual({});
+        });
+        it('returns a packed table', function (done) {
+            repo.getDiffStatsAsync(['a.txt'], {format: 'packed'}).then(function (stats) {
+                expect(stats.paths.toString()).toBe('a.txt');
+                expect(Array.from(stats.offsets)).toEqual([0, 5]);
+                expect(Array.from(stats.added)).toEqual([0]);
+                expect(Array.from(stats.deleted)).toEqual([1]);
+                done();
+            }, done.fail);
+        });
+    });
     describe('.getHeadBlob(path)', function () {
         let repo;
         beforeEach(function (done) {
@@ -523,6 +772,123 @@ describe('git', function () {
                 expect(repo.getHeadBlob('i-do-not-exist.txt')).toBeNull();
             });
         });
+        describe('when the asBuffer option is specified', function () {
+            it('returns the HEAD blob contents as a Buffer', function () {
+                let contents = repo.getHeadBlob('a.txt', {asBuffer: true});
+                expect(Buffer.isBuffer(contents)).toBe(true);
+                expect(contents.toString('utf8')).toBe('first line\n');
+            });
+        });
+        describe('when HEAD moves', function () {
+            it('returns the blob of the new HEAD', function (done) {
+                let tmpPath = tmp();
+                wrench.copyDirSyncRecursive('fixtures/master.git', path.join(tmpPath, '.git'));
+                bareToNormal(tmpPath, function () {
+                    git.open(tmpPath).then(function (res) {
+                        expect(res.getHeadBlob('a.txt')).toBe('first line\n');
+                        fs.writeFileSync(path.join(tmpPath, 'a.txt'), 'second line\n', 'utf8');
+                        res.add('a.txt');
+                        expect(res.commit('change a.txt', 'a', 'a@a.com')).toBe(true);
+                        expect(res.getHeadBlob('a.txt')).toBe('second line\n');
+                        done();
+                    }, done.fail);
+                });
+            });
+        });
+    });
+    describe('.getHeadBlobs(paths)', function () {
+        it('returns the HEAD blobs packed in one buffer', function (done) {
+            let repoDirectory = temp.mkdirSync('node-git-repo-');
+            wrench.copyDirSyncRecursive('fixtures/master.git', path.join(repoDirectory, '.git'));
+            git.open(repoDirectory).then(function (repo) {
+                return repo.getHeadBlobs([ 'i-do-not-exist.txt', 'a.txt' ]);
+            }).then(function (blobs) {
+                expect(blobs.offsets.length).toBe(3);
+                expect(blobs.contents.toString('utf8', blobs.offsets[1], blobs.offsets[2])).toBe('first line\n');
+                expect(Array.from(blobs.missing)).toEqual([ 0 ]);
+                done();
+            }, done.fail);
+        });
+    });
+    describe('.getHeadBlobStream(path, callback)', function () {
+        it('streams the HEAD blob in chunks', function (done) {
+            let repoDirectory = temp.mkdirSync('node-git-repo-');
+            let chunks = [];
+            wrench.copyDirSyncRecursive('fixtures/master.git', path.join(repoDirectory, '.git'));
+            git.open(repoDirectory).then(function (repo) {
+                return repo.getHeadBlobStream('a.txt', function (chunk) {
+                    chunks.push(chunk);
+                }, {chunkSize: 4});
+            }).then(function (size) {
+                expect(size).toBe(11);
+                expect(chunks.length).toBe(3);
+                expect(Buffer.concat(chunks).toString('utf8')).toBe('first line\n');
+                done();
+            }, done.fail);
+        });
+        it('streams chunks smaller than the loose object header', function (done) {
+            let repoDirectory = temp.mkdirSync('node-git-repo-');
+            let chunks = [];
+            wrench.copyDirSyncRecursive('fixtures/master.git', path.join(repoDirectory, '.git'));
+            git.open(repoDirectory).then(function (repo) {
+                return repo.getHeadBlobStream('a.txt', function (chunk) {
+                    chunks.push(chunk);
+                }, {chunkSize: 1});
+            }).then(function (size) {
+                expect(size).toBe(11);
+                expect(chunks.length).toBe(11);
+                expect(chunks.every(function (chunk) { return chunk.length === 1; })).toBe(true);
+                expect(Buffer.concat(chunks).toString('utf8')).toBe('first line\n');
+                done();
+            }, done.fail);
+        });
+    });
+    describe('.getTreeDiffStream(oldRev, newRev, callback)', function () {
+        let repo;
+        beforeEach(function (done) {
+            git.open('fixtures/master.git').then(function (res) {
+                repo = res;
+                done();
+            }, done.fail);
+        });
+        it('streams the patch of every changed file', function (done) {
+            let files = [];
+            repo.getTreeDiffStream('HEAD~1', 'HEAD', function (file) {
+                files.push(file);
+            }).then(function (count) {
+                expect(count).toBe(1);
+                expect(files).toEqual([{
+                    status: 'M',
+                    oldPath: 'a.txt',
+                    newPath: 'a.txt',
+                    added: 1,
+                    deleted: 0,
+                    hunks: [{
+                        oldStart: 0,
+                        oldLines: 0,
+                        newStart: 1,
+                        newLines: 1,
+                        lines: ['+first line']
+                    }]
+                }]);
+                done();
+            }, done.fail);
+        });
+        it('only counts lines in stats only mode', function (done) {
+            let files = [];
+            repo.getTreeDiffStream(null, 'HEAD', function (file) {
+                files.push(file);
+            }, {statsOnly: true, renames: true}).then(function () {
+                expect(files).toEqual([{
+                    status: 'A',
+                    oldPath: 'a.txt',
+                    newPath: 'a.txt',
+                    added: 1,
+                    deleted: 0
+                }]);
+                done();
+            }, done.fail);
+        });
     });
     describe('.getIndexBlob(path)', function () {
         let repo;
@@ -593,6 +959,168 @@ describe('git', function () {
                 expect(repo.getStatus('a.txt')).toBe(1 << 9);
             });
         });
+        describe('when the packed format is specified', function () {
+            it('returns the statuses as a buffer and typed arrays', function () {
+                let packed = repo.getStatus({format: 'packed'});
+                let statuses = {};
+                for (let i = 0; i < packed.flags.length; i++) {
+                    let name = packed.paths.toString('utf8', packed.offsets[i], packed.offsets[i + 1]);
+                    statuses[name] = packed.flags[i];
+                }
+                expect(packed.offsets.length).toBe(packed.flags.length + 1);
+                expect(statuses).toEqual(repo.getStatus());
+            });
+        });
+        describe('when the untrackedCache option is specified', function () {
+            it('lists untracked directories from a persisted cache', function () {
+                let newDir = path.join(repo.getWorkingDirectory(), 'secret-stuff');
+                fs.mkdirSync(newDir);
+                fs.writeFileSync(path.join(newDir, 'd.txt'), '', 'utf8');
+                fs.writeFileSync(path.join(newDir, 'e.txt'), '', 'utf8');
+                let statuses = repo.getStatus({untrackedCache: true});
+                expect(statuses).toEqual(repo.getStatus());
+                expect(statuses['secret-stuff/d.txt']).toBe(1 << 7);
+                expect(fs.existsSync(path.join(repo.getPath(), 'git-native/untracked-cache'))).toBe(true);
+                fs.unlinkSync(path.join(newDir, 'e.txt'));
+                statuses = repo.getStatus({untrackedCache: true});
+                expect(statuses['secret-stuff/e.txt']).toBeUndefined();
+                expect(statuses['secret-stuff/d.txt']).toBe(1 << 7);
+            });
+        });
+        describe('when the parallel option is specified', function () {
+            it('returns the same statuses as a serial scan', function () {
+                let newDir = path.join(repo.getWorkingDirectory(), 'secret-stuff');
+                fs.mkdirSync(newDir);
+                fs.writeFileSync(path.join(newDir, 'd.txt'), '', 'utf8');
+                let statuses = repo.getStatus({parallel: 4});
+                expect(statuses).toEqual(repo.getStatus());
+                expect(_.keys(statuses).length).toBe(3);
+                expect(statuses['secret-stuff/d.txt']).toBe(1 << 7);
+            });
+        });
+    });
+    describe('.watch([callback])', function () {
+        let repo;
+        beforeEach(function (done) {
+            let repoDirectory = temp.mkdirSync('node-git-repo-');
+            wrench.copyDirSyncRecursive('fixtures/master.git', path.join(repoDirectory, '.git'));
+            git.open(repoDirectory).then(function (res) {
+                repo = res;
+                done();
+            }, done.fail);
+        });
+        afterEach(function () {
+            repo.unwatch();
+        });
+        if (process.platform !== 'linux') {
+            return;
+        }
+        it('reports changed paths and keeps the status up to date', function (done) {
+            let reported = false;
+            expect(repo.watch(function (paths) {
+                if (reported) {
+                    return;
+                }
+                reported = true;
+                expect(paths).toContain('b.txt');
+                let statuses = repo.getStatus();
+                expect(_.keys(statuses).length).toBe(2);
+                expect(statuses['b.txt']).toBe(1 << 7);
+                done();
+            })).toBe(true);
+            expect(_.keys(repo.getStatus()).length).toBe(1);
+            setTimeout(function () {
+                fs.writeFileSync(path.join(repo.getWorkingDirectory(), 'b.txt'), '', 'utf8');
+            }, 100);
+        });
+        it('rescans and watches ignored directories when .gitignore changes', function (done) {
+            let workingDirectory = repo.getWorkingDirectory();
+            fs.mkdirSync(path.join(workingDirectory, 'build'));
+            fs.writeFileSync(path.join(workingDirectory, 'build', 'a.out'), '', 'utf8');
+            fs.writeFileSync(path.join(workingDirectory, '.gitignore'), 'build/\n', 'utf8');
+            let step = 0;
+            expect(repo.watch(function (paths) {
+                if (step === 0 && paths.indexOf('.gitignore') !== -1) {
+                    step = 1;
+                    expect(repo.getStatus()['build/a.out']).toBe(1 << 7);
+                    fs.writeFileSync(path.join(workingDirectory, 'build', 'b.out'), '', 'utf8');
+                } else if (step === 1 && paths.indexOf('build/b.out') !== -1) {
+                    step = 2;
+                    expect(repo.getStatus()['build/b.out']).toBe(1 << 7);
+                    done();
+                }
+            })).toBe(true);
+            expect(repo.getStatus()['build/a.out']).toBeUndefined();
+            setTimeout(function () {
+                fs.writeFileSync(path.join(workingDirectory, '.gitignore'), '', 'utf8');
+            }, 100);
+        });
+    });
+    describe('.getStatusStream(callback, [options])', function () {
+        let repo;
+        beforeEach(function (done) {
+            let repoDirectory = temp.mkdirSync('node-git-repo-');
+            wrench.copyDirSyncRecursive('fixtures/master.git', path.join(repoDirectory, '.git'));
+            git.open(repoDirectory).then(function (res) {
+                repo = res;
+                for (let i = 0; i < 5; i++) {
+                    fs.writeFileSync(path.join(repo.getWorkingDirectory(), `new-${i}.txt`), '', 'utf8');
+                }
+                done();
+            }, done.fail);
+        });
+        it('passes the statuses to the callback in chunks', function (done) {
+            let chunks = [];
+            repo.getStatusStream(function (chunk) {
+                chunks.push(chunk);
+            }, {chunkSize: 2}).then(function (total) {
+                expect(total).toBe(6);
+                expect(chunks.length).toBe(3);
+                expect(_.extend.apply(_, [{}].concat(chunks))).toEqual(repo.getStatus());
+                done();
+            }, done.fail);
+        });
+        it('stops when the callback returns false', function (done) {
+            let chunks = 0;
+            repo.getStatusStream(function () {
+                chunks++;
+                return false;
+            }, {chunkSize: 1}).then(function () {
+                expect(chunks).toBe(1);
+                done();
+            }, done.fail);
+        });
+    });
+    describe('.getStatusSummary([options])', function () {
+        let repo;
+        beforeEach(function (done) {
+            let repoDirectory = temp.mkdirSync('node-git-repo-');
+            wrench.copyDirSyncRecursive('fixtures/master.git', path.join(repoDirectory, '.git'));
+            git.open(repoDirectory).then(function (res) {
+                repo = res;
+                fs.writeFileSync(path.join(repo.getWorkingDirectory(), 'b.txt'), '', 'utf8');
+                done();
+            }, done.fail);
+        });
+        it('counts the changed paths', function (done) {
+            repo.getStatusSummary().then(function (summary) {
+                expect(summary).toEqual({
+                    dirty: true,
+                    new: 1,
+                    modified: 0,
+                    deleted: 1,
+                    staged: 0,
+                    conflicted: 0
+                });
+                done();
+            }, done.fail);
+        });
+        it('only reports the dirty flag when dirtyOnly is set', function (done) {
+            repo.getStatusSummary({dirtyOnly: true}).then(function (summary) {
+                expect(summary).toEqual({dirty: true});
+                done();
+            }, done.fail);
+        });
     });
     describe('.getStatusForPaths([paths])', function () {
         let repo;
@@ -638,6 +1166,26 @@ describe('git', function () {
             });
         });
     });
+    describe('.createDiffSession(path)', function () {
+        it('diffs the edited text against the HEAD blob', function (done) {
+            git.open('fixtures/master.git').then(function (repo) {
+                let session = repo.createDiffSession('a.txt');
+                expect(session.getLineDiffs()).toEqual([]);
+                session.edit(1, 0, 'second line\n');
+                expect(session.getLineDiffs()).toEqual([
+                    {oldStart: 1, oldLines: 0, newStart: 2, newLines: 1}
+                ]);
+                session.edit(0, 1, 'first line is different\n');
+                expect(session.getLineDiffs()).toEqual([
+                    {oldStart: 1, oldLines: 1, newStart: 1, newLines: 2}
+                ]);
+                session.setText('first line\n');
+                expect(session.getLineDiffs()).toEqual([]);
+                expect(repo.createDiffSession('i-dont-exists.txt')).toBeNull();
+                done();
+            }, done.fail);
+        });
+    });
     describe('.getLineDiffs(path, text, options)', function () {
         it('returns all hunks that differ', function (done) {
             let masterPath = 'fixtures/master.git';
@@ -663,6 +1211,41 @@ describe('git', function () {
                 done();
             }, done.fail);
         });
+        it('returns the changed words of paired lines', function (done) {
+            git.open('fixtures/master.git').then(function (repo) {
+                let diffs = repo.getLineDiffDetails('a.txt', 'first word\n', {intraline: 'word'});
+                expect(diffs.length).toBe(2);
+                expect(Array.from(diffs[0].changes)).toEqual([ 6, 4 ]);
+                expect(Array.from(diffs[1].changes)).toEqual([ 6, 4 ]);
+                let packed = repo.getLineDiffDetails('a.txt', 'first word\n', {intraline: 'char', format: 'packed'});
+                expect(Array.from(packed.intraline)).toEqual([ 0, 6, 4, 1, 6, 4 ]);
+                done();
+            }, done.fail);
+        });
+        it('diffs a Buffer like a string', function (done) {
+            git.open('fixtures/master.git').then(function (repo) {
+                let text = 'first line\nsecond line';
+                expect(repo.getLineDiffs('a.txt', Buffer.from(text))).toEqual(repo.getLineDiffs('a.txt', text));
+                return repo.getLineDiffsAsync('a.txt', Buffer.from(text));
+            }).then(function (diffs) {
+                expect(diffs).toEqual([ {oldStart: 1, oldLines: 0, newStart: 2, newLines: 1} ]);
+                done();
+            }, done.fail);
+        });
+        it('returns packed hunks and lines when asked to', function (done) {
+            git.open('fixtures/master.git').then(function (repo) {
+                let text = 'f\u00e9rst line\n';
+                let hunks = repo.getLineDiffs('a.txt', text, {format: 'packed'});
+                expect(Array.from(hunks)).toEqual([ 1, 1, 1, 1 ]);
+                let details = repo.getLineDiffDetails('a.txt', text, {format: 'packed'});
+                expect(Array.from(details.hunks)).toEqual([ 1, 1, 1, 1 ]);
+                let lines = Array.from(details.lines);
+                expect(lines.length).toBe(10);
+                expect(details.oldContent.toString('utf8', lines[3], lines[3] + lines[4])).toBe('first line\n');
+                expect(text.substr(lines[8], lines[9])).toBe(text);
+                done();
+            }, done.fail);
+        });
         it('returns null for paths that don\'t exist', function (done) {
             let masterPath = 'fixtures/master.git';
             git.open(masterPath).then(function (repo) {
@@ -792,6 +1375,104 @@ describe('git', function () {
             });
         });
     });
+    describe('async methods', function () {
+        let repo;
+        let repoDirectory;
+        beforeEach(function (done) {
+            repoDirectory = temp.mkdirSync('node-git-repo-');
+            wrench.copyDirSyncRecursive('fixtures/master.git', path.join(repoDirectory, '.git'));
+            git.open(repoDirectory).then(function (res) {
+                repo = res;
+                fs.writeFileSync(path.join(repoDirectory, 'b.txt'), '', 'utf8');
+                done();
+            }, done.fail);
+        });
+        it('getStatusAsync() resolves with the same statuses as getStatus()', function (done) {
+            let statuses = repo.getStatusAsync();
+            expect(statuses instanceof Promise).toBe(true);
+            statuses.then(function (res) {
+                expect(res).toEqual(repo.getStatus());
+                expect(res['b.txt']).toBe(1 << 7);
+                done();
+            }, done.fail);
+        });
+        it('getStatusAsync(path) resolves with the status of the path', function (done) {
+            repo.getStatusAsync('a.txt').then(function (status) {
+                expect(status).toBe(1 << 9);
+                done();
+            }, done.fail);
+        });
+        it('getHeadBlobAsync(path) resolves with the blob contents', function (done) {
+            Promise.all([
+                repo.getHeadBlobAsync('a.txt'),
+                repo.getHeadBlobAsync('i-do-not-exist.txt')
+            ]).then(function (res) {
+                expect(res[0]).toBe('first line\n');
+                expect(res[1]).toBeNull();
+                done();
+            }, done.fail);
+        });
+        it('getLineDiffsAsync(path, text) resolves with the hunks', function (done) {
+            repo.getLineDiffsAsync('a.txt', 'first line is different').then(function (diffs) {
+                expect(diffs).toEqual(repo.getLineDiffs('a.txt', 'first line is different'));
+                done();
+            }, done.fail);
+        });
+        it('getLineDiffsAsync(path, text) drops superseded calls', function (done) {
+            let calls = [];
+            for (let i = 0; i < 20; i++)
+                calls.push(repo.getLineDiffsAsync('a.txt', 'text ' + i));
+            Promise.all(calls).then(function (results) {
+                let last = results[results.length - 1];
+                expect(last.length).toBe(1);
+                let stats = repo.getLineDiffStats();
+                expect(stats.requested).toBe(20);
+                expect(stats.dropped + stats.cancelled + stats.completed).toBe(20);
+                expect(stats.dropped + stats.cancelled).toBeGreaterThan(0);
+                done();
+            }, done.fail);
+        });
+        it('addAsync(path) stages the file', function (done) {
+            repo.addAsync('b.txt').then(function () {
+                expect(repo.getStatus('b.txt')).toBe(1 << 0);
+                done();
+            }, done.fail);
+        });
+        it('runs writes in order with the reads queued after them', function (done) {
+            let before = repo.getStatusAsync('b.txt');
+            let added = repo.addAsync('b.txt');
+            let after = repo.getStatusAsync('b.txt');
+            Promise.all([ before, added, after ]).then(function (res) {
+                expect(res[0]).toBe(1 << 7);
+                expect(res[2]).toBe(1 << 0);
+                done();
+            }, done.fail);
+        });
+        it('addAsync(path) rejects when the file does not exist', function (done) {
+            repo.addAsync('missing.txt').then(done.fail, done);
+        });
+        it('getHeadAsync() and getReferencesAsync() resolve like their sync twins', function (done) {
+            Promise.all([
+                repo.getHeadAsync(),
+                repo.getReferencesAsync(),
+                repo.getReferenceTargetAsync('refs/heads/master')
+            ]).then(function (res) {
+                expect(res[0]).toBe(repo.getHead());
+                expect(res[1]).toEqual(repo.getReferences());
+                expect(res[2]).toBe(repo.getReferenceTarget('refs/heads/master'));
+                done();
+            }, done.fail);
+        });
+        it('setConfigValueAsync(key, value) is seen by reads queued after it', function (done) {
+            let set = repo.setConfigValueAsync('foo.bar', 'baz');
+            let value = repo.getConfigValueAsync('foo.bar');
+            Promise.all([ set, value ]).then(function (res) {
+                expect(res[0]).toBe(true);
+                expect(res[1]).toBe('baz');
+                done();
+            }, done.fail);
+        });
+    });
     describe('.add(path)', function () {
         let repo;
         beforeEach(function (done) {
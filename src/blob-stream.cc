@@ -0,0 +1,438 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uv.h>
+#include <zlib.h>
+#include <algorithm>
+#include <string>
+#include "./blob-stream.h"
+
+namespace {
+
+const size_t INPUT_SIZE = 64 * 1024;
+
+// Object types of pack entries.
+const int PACK_BLOB = 3;
+const int PACK_OFS_DELTA = 6;
+const int PACK_REF_DELTA = 7;
+
+// Parse the "blob <size>\0" header of a loose object out of |data|. Returns
+// the length of the header, 0 when more data is needed and -1 when the
+// object is not a blob.
+int ParseLooseHeader(const char *data, size_t length) {
+    const void *end = memchr(data, '\0', length);
+    if (end == NULL)
+        return length < 32 ? 0 : -1;
+    if (length < 5 || memcmp(data, "blob ", 5) != 0)
+        return -1;
+    return static_cast<const char*>(end) - data + 1;
+}
+
+int StreamLooseBlob(git_repository *repository, const git_oid *id,
+                    size_t chunkSize, const BlobChunkSink &sink,
+                    uint64_t *size) {
+    char hex[GIT_OID_HEXSZ + 1];
+    git_oid_tostr(hex, sizeof(hex), id);
+    string path = string(git_repository_path(repository)) + "objects/" +
+        string(hex, 2) + "/" + string(hex + 2);
+
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == NULL)
+        return GIT_ENOTFOUND;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK) {
+        fclose(file);
+        return -1;
+    }
+
+    unsigned char input[INPUT_SIZE];
+    char header[32];
+    size_t headerLength = 0;
+    bool inHeader = true;
+    // Contents inflated along with the header, not handed out yet. There
+    // can be more of them than fit in a small chunk.
+    const char *pending = NULL;
+    size_t pendingLength = 0;
+    char *chunk = NULL;
+    size_t chunkLength = 0;
+    int error = GIT_OK;
+    int status = Z_OK;
+
+    while (error == GIT_OK) {
+        if (!inHeader && pendingLength > 0) {
+            size_t length = min(pendingLength, chunkSize - chunkLength);
+            memcpy(chunk + chunkLength, pending, length);
+            chunkLength += length;
+            pending += length;
+            pendingLength -= length;
+        } else if (status == Z_STREAM_END) {
+            break;
+        } else {
+            if (zs.avail_in == 0) {
+                zs.avail_in = fread(input, 1, sizeof(input), file);
+                zs.next_in = input;
+                if (zs.avail_in == 0) {
+                    error = -1;
+                    break;
+                }
+            }
+
+            if (inHeader) {
+                // Inflate a few bytes at a time until the header is
+                // complete, what follows it is the start of the contents.
+                zs.next_out = reinterpret_cast<Bytef*>(header + headerLength);
+                zs.avail_out = sizeof(header) - headerLength;
+                status = inflate(&zs, Z_NO_FLUSH);
+                if (status != Z_OK && status != Z_STREAM_END) {
+                    error = -1;
+                    break;
+                }
+                headerLength = sizeof(header) - zs.avail_out;
+
+                int parsed = ParseLooseHeader(header, headerLength);
+                if (parsed < 0) {
+                    error = -1;
+                } else if (parsed > 0) {
+                    inHeader = false;
+                    chunk = static_cast<char*>(malloc(chunkSize));
+                    if (chunk == NULL) {
+                        error = -1;
+                        break;
+                    }
+                    pending = header + parsed;
+                    pendingLength = headerLength - parsed;
+                }
+                continue;
+            }
+
+            zs.next_out = reinterpret_cast<Bytef*>(chunk + chunkLength);
+            zs.avail_out = chunkSize - chunkLength;
+            status = inflate(&zs, Z_NO_FLUSH);
+            if (status != Z_OK && status != Z_STREAM_END &&
+                status != Z_BUF_ERROR) {
+                error = -1;
+                break;
+            }
+            chunkLength = chunkSize - zs.avail_out;
+        }
+
+        if (chunkLength == chunkSize) {
+            *size += chunkLength;
+            char *full = chunk;
+            chunk = NULL;
+            if (!sink(full, chunkLength))
+                break;
+            chunk = static_cast<char*>(malloc(chunkSize));
+            if (chunk == NULL)
+                error = -1;
+            chunkLength = 0;
+        }
+    }
+
+    // A stream that ends inside the header isn't a blob.
+    if (error == GIT_OK && inHeader)
+        error = -1;
+    // The last chunk is rarely full.
+    if (error == GIT_OK && chunk != NULL && chunkLength > 0) {
+        *size += chunkLength;
+        sink(chunk, chunkLength);
+        chunk = NULL;
+    }
+    free(chunk);
+    inflateEnd(&zs);
+    fclose(file);
+    return error;
+}
+
+uv_file OpenFile(const string &path) {
+    uv_fs_t request;
+    uv_file file = uv_fs_open(NULL, &request, path.c_str(), O_RDONLY, 0,
+                              NULL);
+    uv_fs_req_cleanup(&request);
+    return file;
+}
+
+void CloseFile(uv_file file) {
+    uv_fs_t request;
+    uv_fs_close(NULL, &request, file, NULL);
+    uv_fs_req_cleanup(&request);
+}
+
+// Read up to |length| bytes at |offset| of |file|. Returns the number of
+// bytes read, less than |length| at the end of the file, or -1.
+int64_t ReadAt(uv_file file, int64_t offset, void *data, size_t length) {
+    char *out = static_cast<char*>(data);
+    size_t total = 0;
+    while (total < length) {
+        uv_fs_t request;
+        unsigned int remaining = static_cast<unsigned int>(length - total);
+        uv_buf_t buffer = uv_buf_init(out + total, remaining);
+        int read = uv_fs_read(NULL, &request, file, &buffer, 1,
+                              offset + total, NULL);
+        uv_fs_req_cleanup(&request);
+        if (read < 0)
+            return -1;
+        if (read == 0)
+            break;
+        total += read;
+    }
+    return total;
+}
+
+uint32_t GetBigEndian32(const unsigned char *data) {
+    return static_cast<uint32_t>(data[0]) << 24 |
+        static_cast<uint32_t>(data[1]) << 16 |
+        static_cast<uint32_t>(data[2]) << 8 |
+        static_cast<uint32_t>(data[3]);
+}
+
+// Find the offset of |id| in the pack of the version 2 index at |indexPath|.
+bool FindInPackIndex(const string &indexPath, const git_oid *id,
+                     uint64_t *offset) {
+    uv_file file = OpenFile(indexPath);
+    if (file < 0)
+        return false;
+
+    // The magic number and version, then the fanout table.
+    unsigned char head[8 + 256 * 4];
+    bool found = false;
+    if (ReadAt(file, 0, head, sizeof(head)) ==
+            static_cast<int64_t>(sizeof(head)) &&
+        memcmp(head, "\377tOc\0\0\0\2", 8) == 0) {
+        const unsigned char *fanout = head + 8;
+        int64_t count = GetBigEndian32(fanout + 255 * 4);
+        uint32_t first = id->id[0];
+        uint32_t low = first > 0 ? GetBigEndian32(fanout + (first - 1) * 4) : 0;
+        uint32_t high = GetBigEndian32(fanout + first * 4);
+
+        // The ids, their CRCs, their 31 bit offsets and then the offsets
+        // that don't fit in 31 bits.
+        int64_t ids = sizeof(head);
+        int64_t offsets = ids + count * (GIT_OID_RAWSZ + 4);
+        int64_t largeOffsets = offsets + count * 4;
+        while (low < high) {
+            uint32_t middle = low + (high - low) / 2;
+            unsigned char entry[GIT_OID_RAWSZ];
+            if (ReadAt(file, ids + middle * int64_t(GIT_OID_RAWSZ), entry,
+                       sizeof(entry)) != GIT_OID_RAWSZ)
+                break;
+
+            int compare = memcmp(id->id, entry, GIT_OID_RAWSZ);
+            if (compare < 0) {
+                high = middle;
+            } else if (compare > 0) {
+                low = middle + 1;
+            } else {
+                unsigned char data[8];
+                if (ReadAt(file, offsets + middle * 4, data, 4) != 4)
+                    break;
+                uint32_t small = GetBigEndian32(data);
+                if ((small & 0x80000000) == 0) {
+                    *offset = small;
+                    found = true;
+                } else if (ReadAt(file, largeOffsets +
+                                  int64_t(small & 0x7fffffff) * 8,
+                                  data, 8) == 8) {
+                    *offset = uint64_t(GetBigEndian32(data)) << 32 |
+                        GetBigEndian32(data + 4);
+                    found = true;
+                }
+                break;
+            }
+        }
+    }
+    CloseFile(file);
+    return found;
+}
+
+// Inflate the blob stored whole at |offset| of the pack at |packPath| a
+// chunk at a time. Returns GIT_PASSTHROUGH when the entry is a delta.
+int StreamPackEntry(const string &packPath, uint64_t offset,
+                    size_t chunkSize, const BlobChunkSink &sink,
+                    uint64_t *size) {
+    uv_file file = OpenFile(packPath);
+    if (file < 0)
+        return GIT_PASSTHROUGH;
+
+    // The type and the inflated size, a variable length number.
+    unsigned char header[16];
+    int64_t headerLength = ReadAt(file, offset, header, sizeof(header));
+    int64_t used = 0;
+    int type = -1;
+    uint64_t objectSize = 0;
+    if (headerLength > 0) {
+        unsigned char c = header[used++];
+        type = (c >> 4) & 7;
+        objectSize = c & 15;
+        int shift = 4;
+        while (c & 0x80) {
+            if (used == headerLength || shift > 57) {
+                type = -1;
+                break;
+            }
+            c = header[used++];
+            objectSize |= static_cast<uint64_t>(c & 0x7f) << shift;
+            shift += 7;
+        }
+    }
+    if (type != PACK_BLOB) {
+        CloseFile(file);
+        if (type == PACK_OFS_DELTA || type == PACK_REF_DELTA)
+            return GIT_PASSTHROUGH;
+        return type < 0 ? -1 : GIT_ENOTFOUND;
+    }
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK) {
+        CloseFile(file);
+        return -1;
+    }
+
+    unsigned char input[INPUT_SIZE];
+    int64_t position = offset + used;
+    char *chunk = NULL;
+    size_t chunkLength = 0;
+    uint64_t inflated = 0;
+    bool stopped = false;
+    int error = GIT_OK;
+    int status = Z_OK;
+
+    while (status != Z_STREAM_END && error == GIT_OK) {
+        if (zs.avail_in == 0) {
+            int64_t read = ReadAt(file, position, input, sizeof(input));
+            if (read <= 0) {
+                error = -1;
+                break;
+            }
+            position += read;
+            zs.next_in = input;
+            zs.avail_in = static_cast<uInt>(read);
+        }
+
+        if (chunk == NULL) {
+            chunk = static_cast<char*>(malloc(chunkSize));
+            if (chunk == NULL) {
+                error = -1;
+                break;
+            }
+        }
+
+        zs.next_out = reinterpret_cast<Bytef*>(chunk + chunkLength);
+        zs.avail_out = chunkSize - chunkLength;
+        status = inflate(&zs, Z_NO_FLUSH);
+        if (status != Z_OK && status != Z_STREAM_END &&
+            status != Z_BUF_ERROR) {
+            error = -1;
+            break;
+        }
+        chunkLength = chunkSize - zs.avail_out;
+
+        if (chunkLength == chunkSize ||
+            (status == Z_STREAM_END && chunkLength > 0)) {
+            inflated += chunkLength;
+            *size += chunkLength;
+            char *full = chunk;
+            size_t fullLength = chunkLength;
+            chunk = NULL;
+            chunkLength = 0;
+            if (!sink(full, fullLength)) {
+                stopped = true;
+                break;
+            }
+        }
+    }
+
+    if (error == GIT_OK && !stopped && inflated != objectSize)
+        error = -1;
+    free(chunk);
+    inflateEnd(&zs);
+    CloseFile(file);
+    return error;
+}
+
+// Stream the blob |id| out of the packs of the repository when it is stored
+// there whole. Returns GIT_PASSTHROUGH when it is in no pack, or a delta.
+int StreamPackedBlob(git_repository *repository, const git_oid *id,
+                     size_t chunkSize, const BlobChunkSink &sink,
+                     uint64_t *size) {
+    string packs = string(git_repository_path(repository)) + "objects/pack/";
+    int error = GIT_PASSTHROUGH;
+    uv_fs_t request;
+    if (uv_fs_scandir(NULL, &request, packs.c_str(), 0, NULL) >= 0) {
+        uv_dirent_t entry;
+        while (uv_fs_scandir_next(&request, &entry) != UV_EOF) {
+            string name = entry.name;
+            if (name.size() <= 4 ||
+                name.compare(name.size() - 4, 4, ".idx") != 0)
+                continue;
+
+            uint64_t offset;
+            if (FindInPackIndex(packs + name, id, &offset)) {
+                string pack = name.substr(0, name.size() - 4) + ".pack";
+                error = StreamPackEntry(packs + pack, offset, chunkSize, sink,
+                                        size);
+                break;
+            }
+        }
+    }
+    uv_fs_req_cleanup(&request);
+    return error;
+}
+
+// Let libgit2 read the blob |id| whole, rebuilding it from its deltas, and
+// hand it out in chunks.
+int ReadWholeBlob(git_repository *repository, const git_oid *id,
+                  size_t chunkSize, const BlobChunkSink &sink,
+                  uint64_t *size) {
+    git_odb *odb = NULL;
+    int error = git_repository_odb(&odb, repository);
+    if (error != GIT_OK)
+        return error;
+
+    git_odb_object *object = NULL;
+    error = git_odb_read(&object, odb, id);
+    git_odb_free(odb);
+    if (error != GIT_OK)
+        return error;
+    if (git_odb_object_type(object) != GIT_OBJ_BLOB) {
+        git_odb_object_free(object);
+        return GIT_ENOTFOUND;
+    }
+
+    const char *data = static_cast<const char*>(git_odb_object_data(object));
+    size_t length = git_odb_object_size(object);
+    for (size_t offset = 0; offset < length; offset += chunkSize) {
+        size_t chunkLength = length - offset < chunkSize ?
+            length - offset : chunkSize;
+        char *chunk = static_cast<char*>(malloc(chunkLength));
+        if (chunk == NULL) {
+            error = -1;
+            break;
+        }
+        memcpy(chunk, data + offset, chunkLength);
+        *size += chunkLength;
+        if (!sink(chunk, chunkLength))
+            break;
+    }
+
+    git_odb_object_free(object);
+    return error;
+}
+
+}  // namespace
+
+int StreamBlob(git_repository *repository, const git_oid *id,
+               size_t chunkSize, const BlobChunkSink &sink, uint64_t *size) {
+    *size = 0;
+    int error = StreamLooseBlob(repository, id, chunkSize, sink, size);
+    if (error == GIT_ENOTFOUND)
+        error = StreamPackedBlob(repository, id, chunkSize, sink, size);
+    // Deltas, and objects of alternates, are rebuilt by libgit2.
+    if (error == GIT_PASSTHROUGH)
+        error = ReadWholeBlob(repository, id, chunkSize, sink, size);
+    return error;
+}
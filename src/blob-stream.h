@@ -0,0 +1,24 @@
+#ifndef SRC_BLOB_STREAM_H_
+#define SRC_BLOB_STREAM_H_
+
+#include <git2.h>
+#include <stdint.h>
+#include <functional>
+
+using namespace std;  // NOLINT(build/namespaces)
+
+// Receives a chunk of blob contents allocated with malloc and takes
+// ownership of it. Returns false to stop reading.
+typedef function<bool(char *data, size_t size)> BlobChunkSink;
+
+// Read the blob |id| in chunks of at most |chunkSize| bytes.
+//
+// Loose objects, and packed objects stored whole, are inflated straight from
+// their file a chunk at a time, so memory use doesn't depend on the size of
+// the blob. Deltified objects have to be rebuilt in memory by libgit2, they
+// are read whole and then handed out in chunks. |size| is set to the number
+// of bytes read.
+int StreamBlob(git_repository *repository, const git_oid *id,
+               size_t chunkSize, const BlobChunkSink &sink, uint64_t *size);
+
+#endif  // SRC_BLOB_STREAM_H_
@@ -0,0 +1,530 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <unordered_set>
+#include "./changed-paths.h"
+#include "./parallel.h"
+
+namespace {
+
+const char MAGIC[4] = { 'G', 'N', 'C', 'P' };
+const size_t HEADER_SIZE = 12;
+const size_t FANOUT_SIZE = 256 * 4;
+const size_t BITS_PER_PATH = 10;
+const size_t MAX_CHANGED_PATHS = 512;
+const size_t COMMITS_PER_SAVE = 16384;
+
+// Little-endian encoding of the filters file.
+uint32_t GetInt32(const unsigned char *data) {
+    return static_cast<uint32_t>(data[0]) |
+        (static_cast<uint32_t>(data[1]) << 8) |
+        (static_cast<uint32_t>(data[2]) << 16) |
+        (static_cast<uint32_t>(data[3]) << 24);
+}
+
+void PutInt(string *out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++)
+        out->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+}
+
+bool OidLess(const git_oid &a, const git_oid &b) {
+    return git_oid_cmp(&a, &b) < 0;
+}
+
+uint32_t RotateLeft(uint32_t value, int count) {
+    return (value << count) | (value >> (32 - count));
+}
+
+// 32-bit MurmurHash3, the hash git's changed-path filters use.
+uint32_t Murmur3(uint32_t seed, const string &data) {
+    const uint32_t c1 = 0xcc9e2d51;
+    const uint32_t c2 = 0x1b873593;
+    const unsigned char *bytes =
+        reinterpret_cast<const unsigned char*>(data.data());
+    size_t blocks = data.size() / 4;
+
+    uint32_t hash = seed;
+    for (size_t i = 0; i < blocks; i++) {
+        uint32_t k = GetInt32(bytes + i * 4);
+        k *= c1;
+        k = RotateLeft(k, 15);
+        k *= c2;
+        hash ^= k;
+        hash = RotateLeft(hash, 13) * 5 + 0xe6546b64;
+    }
+
+    const unsigned char *tail = bytes + blocks * 4;
+    uint32_t k = 0;
+    switch (data.size() & 3) {
+        case 3:
+            k ^= static_cast<uint32_t>(tail[2]) << 16;
+        case 2:  // NOLINT(whitespace/fallthrough)
+            k ^= static_cast<uint32_t>(tail[1]) << 8;
+        case 1:  // NOLINT(whitespace/fallthrough)
+            k ^= tail[0];
+            k *= c1;
+            k = RotateLeft(k, 15);
+            k *= c2;
+            hash ^= k;
+    }
+
+    hash ^= static_cast<uint32_t>(data.size());
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+// A changed path and every directory above it.
+void AddPath(unordered_set<string> *paths, const char *path) {
+    if (path == NULL)
+        return;
+    string changed(path);
+    paths->insert(changed);
+    for (size_t slash = changed.find('/'); slash != string::npos;
+         slash = changed.find('/', slash + 1))
+        paths->insert(changed.substr(0, slash));
+}
+
+string BuildFilter(const unordered_set<string> &paths) {
+    if (paths.size() > MAX_CHANGED_PATHS)
+        return string(1, '\xff');
+
+    string filter((paths.size() * BITS_PER_PATH + 7) / 8, '\0');
+    size_t bits = filter.size() * 8;
+    unordered_set<string>::const_iterator path = paths.begin();
+    for (; path != paths.end(); ++path) {
+        ChangedPaths::Key key = ChangedPaths::MakeKey(*path);
+        for (size_t i = 0; i < 7; i++) {
+            uint32_t bit = key.hashes[i] % bits;
+            filter[bit / 8] |= static_cast<char>(1 << (bit % 8));
+        }
+    }
+    return filter;
+}
+
+int ComputeFilter(git_repository *repository, const git_oid *id,
+                  string *filter) {
+    git_commit *commit;
+    int error = git_commit_lookup(&commit, repository, id);
+    if (error != GIT_OK)
+        return error;
+
+    git_tree *tree = NULL;
+    git_tree *parentTree = NULL;
+    error = git_commit_tree(&tree, commit);
+    if (error == GIT_OK && git_commit_parentcount(commit) > 0) {
+        git_commit *parent;
+        error = git_commit_parent(&parent, commit, 0);
+        if (error == GIT_OK) {
+            error = git_commit_tree(&parentTree, parent);
+            git_commit_free(parent);
+        }
+    }
+
+    git_diff *diff = NULL;
+    if (error == GIT_OK)
+        error = git_diff_tree_to_tree(&diff, repository, parentTree, tree,
+                                      NULL);
+    if (error == GIT_OK) {
+        unordered_set<string> paths;
+        size_t count = git_diff_num_deltas(diff);
+        for (size_t i = 0; i < count && paths.size() <= MAX_CHANGED_PATHS;
+             i++) {
+            const git_diff_delta *delta = git_diff_get_delta(diff, i);
+            AddPath(&paths, delta->old_file.path);
+            AddPath(&paths, delta->new_file.path);
+        }
+        *filter = BuildFilter(paths);
+    }
+
+    git_diff_free(diff);
+    git_tree_free(parentTree);
+    git_tree_free(tree);
+    git_commit_free(commit);
+    return error;
+}
+
+struct NewFilter {
+    git_oid id;
+    string bits;
+    char computed = 0;
+};
+
+bool NewFilterLess(const NewFilter &a, const NewFilter &b) {
+    return OidLess(a.id, b.id);
+}
+
+// The id and mode of the entry at |path| in the tree of |commit|, the tree
+// itself for an empty path. False when there is none.
+bool EntryAt(git_commit *commit, const string &path, git_oid *id,
+             git_filemode_t *mode) {
+    if (path.empty()) {
+        git_oid_cpy(id, git_commit_tree_id(commit));
+        *mode = GIT_FILEMODE_TREE;
+        return true;
+    }
+
+    git_tree *tree;
+    if (git_commit_tree(&tree, commit) != GIT_OK)
+        return false;
+    git_tree_entry *entry;
+    bool found = git_tree_entry_bypath(&entry, tree, path.c_str()) == GIT_OK;
+    if (found) {
+        git_oid_cpy(id, git_tree_entry_id(entry));
+        *mode = git_tree_entry_filemode(entry);
+        git_tree_entry_free(entry);
+    }
+    git_tree_free(tree);
+    return found;
+}
+
+int ChangedFromParent(git_repository *repository, const git_oid *id,
+                      const string &path, bool *changed) {
+    git_commit *commit;
+    int error = git_commit_lookup(&commit, repository, id);
+    if (error != GIT_OK)
+        return error;
+
+    git_oid entryId, parentEntryId;
+    git_filemode_t mode, parentMode;
+    bool found = EntryAt(commit, path, &entryId, &mode);
+    bool parentFound = false;
+    if (git_commit_parentcount(commit) > 0) {
+        git_commit *parent;
+        error = git_commit_parent(&parent, commit, 0);
+        if (error == GIT_OK) {
+            parentFound = EntryAt(parent, path, &parentEntryId, &parentMode);
+            git_commit_free(parent);
+        }
+    }
+    git_commit_free(commit);
+
+    *changed = found != parentFound ||
+        (found && (mode != parentMode ||
+                   !git_oid_equal(&entryId, &parentEntryId)));
+    return error;
+}
+
+}  // namespace
+
+struct ChangedPaths::Table {
+    string data;
+    uint32_t count = 0;
+    const unsigned char *fanout = NULL;
+    const unsigned char *ids = NULL;
+    const unsigned char *ends = NULL;
+    const unsigned char *filters = NULL;
+
+    bool Own(string *bytes) {
+        data.swap(*bytes);
+        const unsigned char *start =
+            reinterpret_cast<const unsigned char*>(data.data());
+        if (data.size() < HEADER_SIZE + FANOUT_SIZE ||
+            memcmp(start, MAGIC, sizeof(MAGIC)) != 0 ||
+            GetInt32(start + 4) != VERSION)
+            return false;
+
+        uint32_t commits = GetInt32(start + 8);
+        size_t indexSize = HEADER_SIZE + FANOUT_SIZE +
+            static_cast<size_t>(commits) * (GIT_OID_RAWSZ + 4);
+        if (data.size() < indexSize ||
+            GetInt32(start + HEADER_SIZE + 255 * 4) != commits)
+            return false;
+
+        const unsigned char *index = start + HEADER_SIZE + FANOUT_SIZE;
+        const unsigned char *offsets =
+            index + static_cast<size_t>(commits) * GIT_OID_RAWSZ;
+        size_t filtersSize = commits == 0 ? 0 :
+            GetInt32(offsets + (static_cast<size_t>(commits) - 1) * 4);
+        if (data.size() != indexSize + filtersSize)
+            return false;
+
+        count = commits;
+        fanout = start + HEADER_SIZE;
+        ids = index;
+        ends = offsets;
+        filters = start + indexSize;
+        return true;
+    }
+
+    bool Find(const git_oid *id, uint32_t *position) const {
+        if (count == 0)
+            return false;
+
+        unsigned char first = id->id[0];
+        uint32_t low = first == 0 ? 0 : GetInt32(fanout + (first - 1) * 4);
+        uint32_t high = min(GetInt32(fanout + first * 4), count);
+        while (low < high) {
+            uint32_t middle = low + (high - low) / 2;
+            int cmp = memcmp(ids + static_cast<size_t>(middle) * GIT_OID_RAWSZ,
+                             id->id, GIT_OID_RAWSZ);
+            if (cmp == 0) {
+                *position = middle;
+                return true;
+            }
+            if (cmp < 0)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        return false;
+    }
+
+    const git_oid* Id(uint32_t position) const {
+        return reinterpret_cast<const git_oid*>(
+            ids + static_cast<size_t>(position) * GIT_OID_RAWSZ);
+    }
+
+    size_t Start(uint32_t position) const {
+        return position == 0 ? 0 : GetInt32(ends + (position - 1) * 4);
+    }
+
+    size_t End(uint32_t position) const {
+        return GetInt32(ends + static_cast<size_t>(position) * 4);
+    }
+
+    // The contents of a filters file with the filters of this table and
+    // the computed ones of |added|, which is sorted by id.
+    string Merge(const vector<NewFilter> &added) const {
+        vector<git_oid> merged;
+        string filterData;
+        vector<uint32_t> mergedEnds;
+        size_t next = 0;
+        for (uint32_t i = 0; i < count || next < added.size();) {
+            if (next < added.size() && !added[next].computed) {
+                next++;
+                continue;
+            }
+            if (next == added.size() ||
+                (i < count && OidLess(*Id(i), added[next].id))) {
+                merged.push_back(*Id(i));
+                filterData.append(reinterpret_cast<const char*>(filters) +
+                                  Start(i), End(i) - Start(i));
+                i++;
+            } else {
+                merged.push_back(added[next].id);
+                filterData.append(added[next].bits);
+                next++;
+            }
+            mergedEnds.push_back(filterData.size());
+        }
+
+        uint32_t fanoutCounts[256] = { 0 };
+        for (size_t i = 0; i < merged.size(); i++)
+            fanoutCounts[merged[i].id[0]]++;
+
+        string result(MAGIC, sizeof(MAGIC));
+        PutInt(&result, VERSION, 4);
+        PutInt(&result, merged.size(), 4);
+        uint32_t total = 0;
+        for (int i = 0; i < 256; i++) {
+            total += fanoutCounts[i];
+            PutInt(&result, total, 4);
+        }
+        for (size_t i = 0; i < merged.size(); i++)
+            result.append(reinterpret_cast<const char*>(merged[i].id),
+                          GIT_OID_RAWSZ);
+        for (size_t i = 0; i < mergedEnds.size(); i++)
+            PutInt(&result, mergedEnds[i], 4);
+        result.append(filterData);
+        return result;
+    }
+};
+
+ChangedPaths::ChangedPaths(const char *gitdir)
+    : filtersPath(string(gitdir) + "git-native/changed-paths"),
+      table(make_shared<Table>()) {
+    uv_mutex_init(&lock);
+    uv_mutex_init(&updateLock);
+}
+
+ChangedPaths::~ChangedPaths() {
+    uv_mutex_destroy(&lock);
+    uv_mutex_destroy(&updateLock);
+}
+
+bool ChangedPaths::TakeBuild() {
+    uv_mutex_lock(&lock);
+    bool take = !buildTaken;
+    buildTaken = true;
+    uv_mutex_unlock(&lock);
+    return take;
+}
+
+bool ChangedPaths::IsBuilt() {
+    return Current()->count > 0;
+}
+
+ChangedPaths::Key ChangedPaths::MakeKey(const string &path) {
+    Key key;
+    uint32_t first = Murmur3(0x293ae76f, path);
+    uint32_t second = Murmur3(0x7e646e2c, path);
+    for (size_t i = 0; i < 7; i++)
+        key.hashes[i] = first + static_cast<uint32_t>(i) * second;
+    return key;
+}
+
+bool ChangedPaths::MaybeChanged(const git_oid *id, const Key &key) {
+    shared_ptr<const Table> current = Current();
+    uint32_t position;
+    if (!current->Find(id, &position))
+        return true;
+
+    // An empty filter is a commit that changed nothing.
+    size_t start = current->Start(position);
+    size_t bits = (current->End(position) - start) * 8;
+    const unsigned char *filter = current->filters + start;
+    for (size_t i = 0; i < 7 && bits > 0; i++) {
+        uint32_t bit = key.hashes[i] % bits;
+        if (!(filter[bit / 8] & (1 << (bit % 8))))
+            return false;
+    }
+    return bits > 0;
+}
+
+int ChangedPaths::Update(git_repository *repository,
+                         const vector<git_oid> &ids, size_t threads) {
+    uv_mutex_lock(&updateLock);
+    shared_ptr<const Table> current = Current();
+    vector<NewFilter> missing;
+    uint32_t position;
+    for (size_t i = 0; i < ids.size(); i++) {
+        if (current->Find(&ids[i], &position))
+            continue;
+        missing.push_back(NewFilter());
+        missing.back().id = ids[i];
+    }
+    if (missing.empty()) {
+        uv_mutex_unlock(&updateLock);
+        return GIT_OK;
+    }
+
+    size_t threadCount = ParallelThreadCount(threads, missing.size());
+    string gitPath(git_repository_path(repository));
+    vector<git_repository*> handles(threadCount, NULL);
+    handles[0] = repository;
+
+    int error = GIT_OK;
+    for (size_t start = 0; start < missing.size() && error == GIT_OK;
+         start += COMMITS_PER_SAVE) {
+        size_t batch = min(missing.size() - start, COMMITS_PER_SAVE);
+        ParallelFor(batch, threadCount, [&](size_t index, size_t thread) {
+            if (handles[thread] == NULL &&
+                git_repository_open_ext(&handles[thread], gitPath.c_str(),
+                                        GIT_REPOSITORY_OPEN_NO_SEARCH, NULL)
+                  != GIT_OK) {
+                handles[thread] = NULL;
+                return;
+            }
+
+            // Commits that can't be read, like the boundary of a shallow
+            // clone, are left without a filter.
+            NewFilter &filter = missing[start + index];
+            filter.computed = ComputeFilter(handles[thread], &filter.id,
+                                            &filter.bits) == GIT_OK;
+        });
+
+        vector<NewFilter> added(missing.begin() + start,
+                                missing.begin() + start + batch);
+        sort(added.begin(), added.end(), NewFilterLess);
+        string data = current->Merge(added);
+
+        // Filters that couldn't be written are still good for this process.
+        Save(data);
+        shared_ptr<Table> updated = make_shared<Table>();
+        if (!updated->Own(&data)) {
+            error = -1;
+            break;
+        }
+        uv_mutex_lock(&lock);
+        table = updated;
+        uv_mutex_unlock(&lock);
+        current = updated;
+    }
+
+    for (size_t i = 1; i < threadCount; i++)
+        if (handles[i] != NULL)
+            git_repository_free(handles[i]);
+    uv_mutex_unlock(&updateLock);
+    return error;
+}
+
+shared_ptr<const ChangedPaths::Table> ChangedPaths::Current() {
+    uv_mutex_lock(&lock);
+    if (!loaded) {
+        loaded = true;
+        FILE *file = fopen(filtersPath.c_str(), "rb");
+        if (file != NULL) {
+            string data;
+            char buffer[65536];
+            size_t length;
+            while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+                data.append(buffer, length);
+            fclose(file);
+            shared_ptr<Table> read = make_shared<Table>();
+            if (read->Own(&data))
+                table = read;
+        }
+    }
+    shared_ptr<const Table> current = table;
+    uv_mutex_unlock(&lock);
+    return current;
+}
+
+bool ChangedPaths::Save(const string &data) {
+    // Write a temporary file and rename it over the filters so readers
+    // never see a partial file.
+    uv_fs_t request;
+    string directory = filtersPath.substr(0, filtersPath.rfind('/'));
+    uv_fs_mkdir(NULL, &request, directory.c_str(), 0777, NULL);
+    uv_fs_req_cleanup(&request);
+
+    string tempPath = filtersPath + ".tmp";
+    FILE *file = fopen(tempPath.c_str(), "wb");
+    if (file == NULL)
+        return false;
+    bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+    written = fclose(file) == 0 && written;
+
+    if (written) {
+        written = uv_fs_rename(NULL, &request, tempPath.c_str(),
+                               filtersPath.c_str(), NULL) == 0;
+        uv_fs_req_cleanup(&request);
+    }
+    if (!written)
+        remove(tempPath.c_str());
+    return written;
+}
+
+int PathHistory(git_repository *repository, ChangedPaths *changedPaths,
+                const git_oid *from, const string &path, size_t limit,
+                vector<git_oid> *commits) {
+    string trimmed(path);
+    while (!trimmed.empty() && trimmed[trimmed.size() - 1] == '/')
+        trimmed.erase(trimmed.size() - 1);
+    ChangedPaths::Key key = ChangedPaths::MakeKey(trimmed);
+
+    git_revwalk *walk;
+    int error = git_revwalk_new(&walk, repository);
+    if (error != GIT_OK)
+        return error;
+    git_revwalk_sorting(walk, GIT_SORT_TIME);
+    error = git_revwalk_push(walk, from);
+
+    git_oid id;
+    while (error == GIT_OK && commits->size() < limit &&
+           git_revwalk_next(&id, walk) == GIT_OK) {
+        if (changedPaths != NULL && !trimmed.empty() &&
+            !changedPaths->MaybeChanged(&id, key))
+            continue;
+        bool changed = false;
+        error = ChangedFromParent(repository, &id, trimmed, &changed);
+        if (error == GIT_OK && changed)
+            commits->push_back(id);
+    }
+    git_revwalk_free(walk);
+    return error;
+}
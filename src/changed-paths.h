@@ -0,0 +1,81 @@
+#ifndef SRC_CHANGED_PATHS_H_
+#define SRC_CHANGED_PATHS_H_
+
+#include <git2.h>
+#include <uv.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;  // NOLINT(build/namespaces)
+
+// Bloom filters of the paths every commit changed compared to its first
+// parent, in the spirit of the changed-path filters of git's commit-graph.
+//
+// A filter holds every changed path and the directories above it, 10 bits
+// per path and 7 hashes, so about one commit in a hundred that didn't touch a
+// path still needs its trees compared. Commits that changed more than 512
+// paths get a filter matching everything.
+//
+// The filters are stored next to the commit graph, in
+// <gitdir>/git-native/changed-paths, and keyed by commit id so they stay
+// valid whatever else changes. Lookups may happen from several threads at
+// once.
+class ChangedPaths {
+    private:
+        static const uint32_t VERSION = 1;
+
+        struct Table;
+
+        string filtersPath;
+        uv_mutex_t lock;
+        shared_ptr<const Table> table;
+        bool loaded = false;
+        bool buildTaken = false;
+        // Held while filters are added, only one update runs at a time.
+        uv_mutex_t updateLock;
+
+    public:
+        // The hashes of one path, computed once per query.
+        struct Key {
+            uint32_t hashes[7];
+        };
+
+        explicit ChangedPaths(const char *gitdir);
+        ~ChangedPaths();
+
+        // True the first time it is called, the caller should then run
+        // Update in the background.
+        bool TakeBuild();
+
+        // Whether filters were ever computed for this repository.
+        bool IsBuilt();
+
+        // Compute the filters of the commits of |ids| that have none yet on
+        // |threads| threads, 0 meaning one per core. Filters are saved every
+        // few thousand commits so an interrupted build isn't lost.
+        int Update(git_repository *repository, const vector<git_oid> &ids,
+                   size_t threads);
+
+        static Key MakeKey(const string &path);
+
+        // False when the commit |id| certainly didn't change the path of
+        // |key|. True when it may have or it has no filter yet.
+        bool MaybeChanged(const git_oid *id, const Key &key);
+
+    private:
+        shared_ptr<const Table> Current();
+        bool Save(const string &data);
+};
+
+// The commits reachable from |from| whose entry at |path| differs from the
+// one of their first parent, newest first. Stops after |limit| commits.
+// Unlike git log -- path there is no history simplification, every commit
+// is compared to its first parent. Commits the filters of |changedPaths|
+// rule out are skipped without reading their trees.
+int PathHistory(git_repository *repository, ChangedPaths *changedPaths,
+                const git_oid *from, const string &path, size_t limit,
+                vector<git_oid> *commits);
+
+#endif  // SRC_CHANGED_PATHS_H_
@@ -0,0 +1,158 @@
+#include <algorithm>
+#include "./commit-cache.h"
+#include "./parallel.h"
+
+namespace {
+
+// Misses read by one task, a handful of misses stay on the calling thread.
+const size_t COMMITS_PER_TASK = 32;
+const uint32_t ALL_FIELDS = LOG_PARENTS | LOG_AUTHOR | LOG_COMMITTER |
+    LOG_SUMMARY | LOG_MESSAGE;
+
+size_t CommitBytes(const LogCommit &commit) {
+    return sizeof(LogCommit) + commit.parents.size() * sizeof(git_oid) +
+        commit.author.name.size() + commit.author.email.size() +
+        commit.committer.name.size() + commit.committer.email.size() +
+        commit.summary.size() + commit.message.size();
+}
+
+}  // namespace
+
+CommitCache::CommitCache() {
+    uv_mutex_init(&lock);
+}
+
+CommitCache::~CommitCache() {
+    uv_mutex_destroy(&lock);
+}
+
+shared_ptr<CommitCache> CommitCache::ForPath(const string &gitdir) {
+    static unordered_map<string, weak_ptr<CommitCache>> caches;
+
+    unordered_map<string, weak_ptr<CommitCache>>::iterator entry =
+        caches.begin();
+    while (entry != caches.end()) {
+        if (entry->second.expired())
+            entry = caches.erase(entry);
+        else
+            ++entry;
+    }
+
+    shared_ptr<CommitCache> cache = caches[gitdir].lock();
+    if (!cache) {
+        cache = make_shared<CommitCache>();
+        caches[gitdir] = cache;
+    }
+    return cache;
+}
+
+int CommitCache::Lookup(git_repository *repository,
+                        const vector<git_oid> &ids, size_t threads,
+                        vector<shared_ptr<const LogCommit>> *commits) {
+    commits->assign(ids.size(), shared_ptr<const LogCommit>());
+    vector<size_t> missing;
+    for (size_t i = 0; i < ids.size(); i++) {
+        (*commits)[i] = Get(ids[i]);
+        if (!(*commits)[i])
+            missing.push_back(i);
+    }
+    if (missing.empty())
+        return GIT_OK;
+
+    size_t tasks = (missing.size() + COMMITS_PER_TASK - 1) / COMMITS_PER_TASK;
+    size_t threadCount = ParallelThreadCount(threads, tasks);
+    string gitPath(git_repository_path(repository));
+    vector<git_repository*> handles(threadCount, NULL);
+    handles[0] = repository;
+    vector<int> errors(tasks, GIT_OK);
+
+    ParallelFor(tasks, threadCount, [&](size_t task, size_t thread) {
+        if (handles[thread] == NULL &&
+            git_repository_open_ext(&handles[thread], gitPath.c_str(),
+                                    GIT_REPOSITORY_OPEN_NO_SEARCH, NULL)
+              != GIT_OK) {
+            handles[thread] = NULL;
+            errors[task] = -1;
+            return;
+        }
+        git_odb *odb;
+        errors[task] = git_repository_odb(&odb, handles[thread]);
+        if (errors[task] != GIT_OK)
+            return;
+
+        size_t end = min(missing.size(), (task + 1) * COMMITS_PER_TASK);
+        for (size_t i = task * COMMITS_PER_TASK; i < end; i++) {
+            const git_oid &id = ids[missing[i]];
+            git_odb_object *object;
+            int error = git_odb_read(&object, odb, &id);
+            if (error == GIT_ENOTFOUND)
+                continue;
+            if (error != GIT_OK) {
+                errors[task] = error;
+                break;
+            }
+            if (git_odb_object_type(object) == GIT_OBJ_COMMIT) {
+                shared_ptr<LogCommit> commit = make_shared<LogCommit>();
+                git_oid_cpy(&commit->id, &id);
+                DecodeCommit(
+                    static_cast<const char*>(git_odb_object_data(object)),
+                    git_odb_object_size(object), ALL_FIELDS, commit.get());
+                (*commits)[missing[i]] = commit;
+            }
+            git_odb_object_free(object);
+        }
+        git_odb_free(odb);
+    });
+
+    for (size_t i = 1; i < threadCount; i++)
+        if (handles[i] != NULL)
+            git_repository_free(handles[i]);
+
+    for (size_t i = 0; i < missing.size(); i++)
+        if ((*commits)[missing[i]])
+            Put((*commits)[missing[i]]);
+    for (size_t i = 0; i < tasks; i++)
+        if (errors[i] != GIT_OK)
+            return errors[i];
+    return GIT_OK;
+}
+
+CommitCache::Stats CommitCache::GetStats() {
+    uv_mutex_lock(&lock);
+    Stats stats = { hits, misses, entries.size(), bytes };
+    uv_mutex_unlock(&lock);
+    return stats;
+}
+
+shared_ptr<const LogCommit> CommitCache::Get(const git_oid &id) {
+    shared_ptr<const LogCommit> commit;
+    uv_mutex_lock(&lock);
+    auto found = index.find(id);
+    if (found != index.end()) {
+        entries.splice(entries.begin(), entries, found->second);
+        commit = found->second->commit;
+        hits++;
+    } else {
+        misses++;
+    }
+    uv_mutex_unlock(&lock);
+    return commit;
+}
+
+void CommitCache::Put(const shared_ptr<const LogCommit> &commit) {
+    uv_mutex_lock(&lock);
+    if (index.find(commit->id) == index.end()) {
+        Entry entry = { commit, CommitBytes(*commit) };
+        entries.push_front(entry);
+        index[commit->id] = entries.begin();
+        bytes += entry.bytes;
+
+        // Keep the newest commit even when it alone is over the budget.
+        while (bytes > MAX_BYTES && entries.size() > 1) {
+            bytes -= entries.back().bytes;
+            index.erase(entries.back().commit->id);
+            entries.pop_back();
+        }
+    }
+    uv_mutex_unlock(&lock);
+}
@@ -0,0 +1,86 @@
+#ifndef SRC_COMMIT_CACHE_H_
+#define SRC_COMMIT_CACHE_H_
+
+#include <git2.h>
+#include <uv.h>
+#include <stdint.h>
+#include <string.h>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "./commit-log.h"
+
+using namespace std;  // NOLINT(build/namespaces)
+
+// Parsed commits, most recently used first, shared by every Repository
+// opened on the same git directory.
+//
+// The same few hundred commits are looked up over and over to show their
+// author, date and subject. A hit skips the object database and the commit
+// parser. Commits never change, entries only leave the cache when it grows
+// past its budget, the least recently used first. Lookups may happen from
+// several threads at once.
+class CommitCache {
+    private:
+        static const size_t MAX_BYTES = 8 * 1024 * 1024;
+
+        struct OidHash {
+            size_t operator()(const git_oid &id) const {
+                size_t hash;
+                memcpy(&hash, id.id, sizeof(hash));
+                return hash;
+            }
+        };
+
+        struct OidEqual {
+            bool operator()(const git_oid &a, const git_oid &b) const {
+                return git_oid_equal(&a, &b) != 0;
+            }
+        };
+
+        struct Entry {
+            shared_ptr<const LogCommit> commit;
+            size_t bytes;
+        };
+
+        typedef list<Entry> Entries;
+
+        uv_mutex_t lock;
+        Entries entries;
+        unordered_map<git_oid, Entries::iterator, OidHash, OidEqual> index;
+        size_t bytes = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+
+    public:
+        struct Stats {
+            uint64_t hits;
+            uint64_t misses;
+            size_t entries;
+            size_t bytes;
+        };
+
+        CommitCache();
+        ~CommitCache();
+
+        // The cache of |gitdir|, created when no Repository on it holds one.
+        // Only call from the main thread.
+        static shared_ptr<CommitCache> ForPath(const string &gitdir);
+
+        // Fill |commits| with the commit of every id of |ids|, NULL for ids
+        // that aren't commits. The misses are read on |threads| threads, 0
+        // meaning one per core, and added to the cache.
+        int Lookup(git_repository *repository, const vector<git_oid> &ids,
+                   size_t threads,
+                   vector<shared_ptr<const LogCommit>> *commits);
+
+        Stats GetStats();
+
+    private:
+        shared_ptr<const LogCommit> Get(const git_oid &id);
+        void Put(const shared_ptr<const LogCommit> &commit);
+};
+
+#endif  // SRC_COMMIT_CACHE_H_
@@ -0,0 +1,780 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <queue>
+#include <unordered_map>
+#include "./commit-graph.h"
+
+namespace {
+
+const char MAGIC[4] = { 'G', 'N', 'C', 'G' };
+const size_t HEADER_SIZE = 16;
+const size_t FANOUT_SIZE = 256 * 4;
+const size_t RECORD_SIZE = 16;
+const uint32_t PARENT_NONE = 0x7fffffff;
+// Set on the second parent of an octopus merge, the rest of it is where its
+// parents start in the edge list. Also set on the last of those parents.
+const uint32_t EDGE_FLAG = 0x80000000;
+const uint32_t MAX_GENERATION = (1 << 30) - 1;
+const uint64_t TIME_MASK = (1ULL << 34) - 1;
+
+// Little-endian encoding of the graph file. Records are read in place from
+// the mapping, byte by byte so neither alignment nor byte order matter.
+uint32_t GetInt32(const unsigned char *data) {
+    return static_cast<uint32_t>(data[0]) |
+        (static_cast<uint32_t>(data[1]) << 8) |
+        (static_cast<uint32_t>(data[2]) << 16) |
+        (static_cast<uint32_t>(data[3]) << 24);
+}
+
+uint64_t GetInt64(const unsigned char *data) {
+    return GetInt32(data) | (static_cast<uint64_t>(GetInt32(data + 4)) << 32);
+}
+
+void PutInt(string *out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++)
+        out->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+}
+
+struct OidHash {
+    size_t operator()(const git_oid &id) const {
+        size_t hash;
+        memcpy(&hash, id.id, sizeof(hash));
+        return hash;
+    }
+};
+
+struct OidEqual {
+    bool operator()(const git_oid &a, const git_oid &b) const {
+        return git_oid_equal(&a, &b) != 0;
+    }
+};
+
+bool OidLess(const git_oid &a, const git_oid &b) {
+    return git_oid_cmp(&a, &b) < 0;
+}
+
+// A commit the graph doesn't have yet.
+struct NewCommit {
+    vector<git_oid> parents;
+    int64_t time = 0;
+    uint32_t generation = 0;
+};
+
+typedef unordered_map<git_oid, NewCommit, OidHash, OidEqual> NewCommits;
+
+// A commit waiting in a walk. The highest generation comes out first, the
+// most recent commit among equals.
+struct Queued {
+    uint32_t generation;
+    int64_t time;
+    uint32_t position;
+
+    bool operator<(const Queued &other) const {
+        if (generation != other.generation)
+            return generation < other.generation;
+        return time < other.time;
+    }
+};
+
+}  // namespace
+
+struct CommitGraph::Snapshot {
+    // The file is either mapped or, when it couldn't be written, held here.
+    string owned;
+    void *mapping = NULL;
+    size_t mappingSize = 0;
+
+    uint32_t count = 0;
+    uint32_t edgeCount = 0;
+    const unsigned char *fanout = NULL;
+    const unsigned char *ids = NULL;
+    const unsigned char *records = NULL;
+    const unsigned char *edges = NULL;
+
+    ~Snapshot() {
+#ifndef _WIN32
+        if (mapping != NULL)
+            munmap(mapping, mappingSize);
+#endif
+    }
+
+    bool Map(const string &path) {
+#ifdef _WIN32
+        FILE *file = fopen(path.c_str(), "rb");
+        if (file == NULL)
+            return false;
+        string data;
+        char buffer[65536];
+        size_t length;
+        while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+            data.append(buffer, length);
+        fclose(file);
+        return Own(&data);
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+            close(fd);
+            return false;
+        }
+        void *bytes = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (bytes == MAP_FAILED)
+            return false;
+        mapping = bytes;
+        mappingSize = st.st_size;
+        return Parse(static_cast<const unsigned char*>(bytes), mappingSize);
+#endif
+    }
+
+    bool Own(string *data) {
+        owned.swap(*data);
+        return Parse(reinterpret_cast<const unsigned char*>(owned.data()),
+                     owned.size());
+    }
+
+    bool Parse(const unsigned char *data, size_t size) {
+        if (size < HEADER_SIZE + FANOUT_SIZE ||
+            memcmp(data, MAGIC, sizeof(MAGIC)) != 0 ||
+            GetInt32(data + 4) != VERSION)
+            return false;
+
+        uint32_t commits = GetInt32(data + 8);
+        uint32_t extraEdges = GetInt32(data + 12);
+        if (size != HEADER_SIZE + FANOUT_SIZE +
+                static_cast<size_t>(commits) * (GIT_OID_RAWSZ + RECORD_SIZE) +
+                static_cast<size_t>(extraEdges) * 4 ||
+            GetInt32(data + HEADER_SIZE + 255 * 4) != commits)
+            return false;
+
+        count = commits;
+        edgeCount = extraEdges;
+        fanout = data + HEADER_SIZE;
+        ids = fanout + FANOUT_SIZE;
+        records = ids + static_cast<size_t>(count) * GIT_OID_RAWSZ;
+        edges = records + static_cast<size_t>(count) * RECORD_SIZE;
+        return true;
+    }
+
+    bool Find(const git_oid *id, uint32_t *position) const {
+        if (count == 0)
+            return false;
+
+        unsigned char first = id->id[0];
+        uint32_t low = first == 0 ? 0 : GetInt32(fanout + (first - 1) * 4);
+        uint32_t high = min(GetInt32(fanout + first * 4), count);
+        while (low < high) {
+            uint32_t middle = low + (high - low) / 2;
+            int cmp = memcmp(ids + static_cast<size_t>(middle) * GIT_OID_RAWSZ,
+                             id->id, GIT_OID_RAWSZ);
+            if (cmp == 0) {
+                *position = middle;
+                return true;
+            }
+            if (cmp < 0)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        return false;
+    }
+
+    const git_oid* Id(uint32_t position) const {
+        return reinterpret_cast<const git_oid*>(
+            ids + static_cast<size_t>(position) * GIT_OID_RAWSZ);
+    }
+
+    uint64_t Stamp(uint32_t position) const {
+        return GetInt64(records + static_cast<size_t>(position) * RECORD_SIZE +
+                        8);
+    }
+
+    uint32_t Generation(uint32_t position) const {
+        return static_cast<uint32_t>(Stamp(position) >> 34);
+    }
+
+    Queued Entry(uint32_t position) const {
+        uint64_t stamp = Stamp(position);
+        Queued entry = { static_cast<uint32_t>(stamp >> 34),
+                         static_cast<int64_t>(stamp & TIME_MASK), position };
+        return entry;
+    }
+
+    template<typename Visit>
+    void ForEachParent(uint32_t position, Visit visit) const {
+        const unsigned char *record =
+            records + static_cast<size_t>(position) * RECORD_SIZE;
+        uint32_t first = GetInt32(record);
+        if (first == PARENT_NONE)
+            return;
+        if (first < count)
+            visit(first);
+
+        uint32_t second = GetInt32(record + 4);
+        if (second == PARENT_NONE)
+            return;
+        if (!(second & EDGE_FLAG)) {
+            if (second < count)
+                visit(second);
+            return;
+        }
+        for (uint32_t edge = second & ~EDGE_FLAG; edge < edgeCount; edge++) {
+            uint32_t parent = GetInt32(edges + static_cast<size_t>(edge) * 4);
+            if ((parent & ~EDGE_FLAG) < count)
+                visit(parent & ~EDGE_FLAG);
+            if (parent & EDGE_FLAG)
+                break;
+        }
+    }
+
+    // Generations of |added|, whose parents are either in the graph or in
+    // |added| too.
+    void AssignGenerations(NewCommits *added) const {
+        NewCommits::iterator commit = added->begin();
+        for (; commit != added->end(); ++commit) {
+            vector<NewCommit*> pending(1, &commit->second);
+            while (!pending.empty()) {
+                NewCommit *entry = pending.back();
+                if (entry->generation != 0) {
+                    pending.pop_back();
+                    continue;
+                }
+
+                uint32_t highest = 0;
+                bool ready = true;
+                for (size_t i = 0; i < entry->parents.size(); i++) {
+                    uint32_t position;
+                    if (Find(&entry->parents[i], &position)) {
+                        highest = max(highest, Generation(position));
+                        continue;
+                    }
+                    NewCommit *parent = &added->find(entry->parents[i])->second;
+                    if (parent->generation == 0) {
+                        pending.push_back(parent);
+                        ready = false;
+                    } else {
+                        highest = max(highest, parent->generation);
+                    }
+                }
+                if (ready) {
+                    entry->generation = min(highest + 1, MAX_GENERATION);
+                    pending.pop_back();
+                }
+            }
+        }
+    }
+
+    // The contents of a graph file with the commits of this graph and
+    // |added|.
+    string Merge(const NewCommits &added) const {
+        vector<git_oid> addedIds;
+        NewCommits::const_iterator commit = added.begin();
+        for (; commit != added.end(); ++commit)
+            addedIds.push_back(commit->first);
+        sort(addedIds.begin(), addedIds.end(), OidLess);
+
+        // Merge the sorted ids, remembering where every commit comes from.
+        vector<git_oid> merged;
+        vector<int64_t> origins;
+        vector<uint32_t> newPositions(count);
+        merged.reserve(count + addedIds.size());
+        size_t next = 0;
+        for (uint32_t i = 0; i < count || next < addedIds.size();) {
+            if (next == addedIds.size() ||
+                (i < count && OidLess(*Id(i), addedIds[next]))) {
+                newPositions[i] = merged.size();
+                merged.push_back(*Id(i));
+                origins.push_back(i++);
+            } else {
+                merged.push_back(addedIds[next++]);
+                origins.push_back(-1);
+            }
+        }
+
+        uint32_t fanoutCounts[256] = { 0 };
+        string recordData;
+        string edgeData;
+        uint32_t edgeTotal = 0;
+        vector<uint32_t> parents;
+        for (size_t i = 0; i < merged.size(); i++) {
+            fanoutCounts[merged[i].id[0]]++;
+
+            parents.clear();
+            uint32_t generation;
+            int64_t time;
+            if (origins[i] >= 0) {
+                uint32_t old = static_cast<uint32_t>(origins[i]);
+                ForEachParent(old, [&](uint32_t parent) {
+                    parents.push_back(newPositions[parent]);
+                });
+                Queued entry = Entry(old);
+                generation = entry.generation;
+                time = entry.time;
+            } else {
+                const NewCommit &entry = added.find(merged[i])->second;
+                for (size_t j = 0; j < entry.parents.size(); j++)
+                    parents.push_back(lower_bound(merged.begin(), merged.end(),
+                                                  entry.parents[j], OidLess) -
+                                      merged.begin());
+                generation = entry.generation;
+                time = entry.time;
+            }
+
+            PutInt(&recordData, parents.empty() ? PARENT_NONE : parents[0], 4);
+            if (parents.size() <= 2) {
+                PutInt(&recordData,
+                       parents.size() < 2 ? PARENT_NONE : parents[1], 4);
+            } else {
+                PutInt(&recordData, EDGE_FLAG | edgeTotal, 4);
+                for (size_t j = 1; j < parents.size(); j++, edgeTotal++)
+                    PutInt(&edgeData, parents[j] |
+                           (j + 1 == parents.size() ? EDGE_FLAG : 0), 4);
+            }
+            uint64_t stamp = time < 0 ? 0 :
+                min(static_cast<uint64_t>(time), TIME_MASK);
+            PutInt(&recordData,
+                   (static_cast<uint64_t>(generation) << 34) | stamp, 8);
+        }
+
+        string data(MAGIC, sizeof(MAGIC));
+        PutInt(&data, VERSION, 4);
+        PutInt(&data, merged.size(), 4);
+        PutInt(&data, edgeTotal, 4);
+        uint32_t total = 0;
+        for (int i = 0; i < 256; i++) {
+            total += fanoutCounts[i];
+            PutInt(&data, total, 4);
+        }
+        for (size_t i = 0; i < merged.size(); i++)
+            data.append(reinterpret_cast<const char*>(merged[i].id),
+                        GIT_OID_RAWSZ);
+        data.append(recordData);
+        data.append(edgeData);
+        return data;
+    }
+
+    int Count(const git_oid *from, const git_oid *hide, size_t *result) const {
+        const uint8_t FROM = 1;
+        const uint8_t HIDDEN = 2;
+
+        uint32_t fromPosition, hidePosition;
+        if (!Find(from, &fromPosition) || !Find(hide, &hidePosition))
+            return -1;
+
+        vector<uint8_t> flags(count, 0);
+        priority_queue<Queued> queue;
+        flags[fromPosition] |= FROM;
+        flags[hidePosition] |= HIDDEN;
+        queue.push(Entry(fromPosition));
+        if (hidePosition != fromPosition)
+            queue.push(Entry(hidePosition));
+
+        // Queued commits only reachable from |from|. Once there are none
+        // left, everything still queued and below it is hidden.
+        size_t interesting = flags[fromPosition] == FROM ? 1 : 0;
+        *result = 0;
+        while (interesting > 0) {
+            uint32_t position = queue.top().position;
+            queue.pop();
+            uint8_t reach = flags[position];
+            if (reach == FROM) {
+                (*result)++;
+                interesting--;
+            }
+
+            ForEachParent(position, [&](uint32_t parent) {
+                uint8_t before = flags[parent];
+                flags[parent] |= reach;
+                if (before == 0) {
+                    queue.push(Entry(parent));
+                    if (flags[parent] == FROM)
+                        interesting++;
+                } else if (before == FROM && flags[parent] != FROM) {
+                    interesting--;
+                }
+            });
+        }
+        return GIT_OK;
+    }
+
+    int MergeBase(const git_oid *one, const git_oid *two,
+                  git_oid *base) const {
+        const uint8_t ONE = 1;
+        const uint8_t TWO = 2;
+
+        uint32_t onePosition, twoPosition;
+        if (!Find(one, &onePosition) || !Find(two, &twoPosition))
+            return -1;
+
+        vector<uint8_t> flags(count, 0);
+        priority_queue<Queued> queue;
+        flags[onePosition] |= ONE;
+        flags[twoPosition] |= TWO;
+        queue.push(Entry(onePosition));
+        if (twoPosition != onePosition)
+            queue.push(Entry(twoPosition));
+
+        // Every descendant of a commit comes out of the queue before it, the
+        // first commit reachable from both has no common descendant.
+        while (!queue.empty()) {
+            uint32_t position = queue.top().position;
+            queue.pop();
+            uint8_t reach = flags[position];
+            if (reach == (ONE | TWO)) {
+                git_oid_cpy(base, Id(position));
+                return GIT_OK;
+            }
+
+            ForEachParent(position, [&](uint32_t parent) {
+                if (flags[parent] == 0)
+                    queue.push(Entry(parent));
+                flags[parent] |= reach;
+            });
+        }
+        return GIT_ENOTFOUND;
+    }
+
+    int AheadBehind(const vector<git_oid> &locals,
+                    const vector<git_oid> &upstreams,
+                    vector<size_t> *ahead, vector<size_t> *behind) const {
+        // Pair i is reached from its local commit when bit 2i of a mask is
+        // set and from its upstream when bit 2i + 1 is.
+        const uint64_t LOCAL_BITS = 0x5555555555555555ULL;
+        const uint32_t NO_SLOT = 0xffffffff;
+        size_t pairs = locals.size();
+        size_t words = (2 * pairs + 63) / 64;
+        ahead->assign(pairs, 0);
+        behind->assign(pairs, 0);
+
+        // Masks are only allocated for the commits the walk reaches.
+        vector<uint32_t> slots(count, NO_SLOT);
+        vector<uint64_t> masks;
+        // Whether a queued commit is reached by only one side of a pair.
+        vector<bool> interesting;
+        size_t interestingCount = 0;
+        priority_queue<Queued> queue;
+
+        auto reach = [&](uint32_t position) -> size_t {
+            if (slots[position] == NO_SLOT) {
+                slots[position] = interesting.size();
+                masks.resize(masks.size() + words, 0);
+                interesting.push_back(false);
+                queue.push(Entry(position));
+            }
+            return slots[position];
+        };
+        auto update = [&](size_t slot) {
+            const uint64_t *mask = &masks[slot * words];
+            bool one = false;
+            for (size_t w = 0; w < words && !one; w++)
+                one = ((mask[w] ^ (mask[w] >> 1)) & LOCAL_BITS) != 0;
+            if (one != interesting[slot]) {
+                interesting[slot] = one;
+                if (one)
+                    interestingCount++;
+                else
+                    interestingCount--;
+            }
+        };
+
+        for (size_t i = 0; i < pairs; i++) {
+            uint32_t local, upstream;
+            if (!Find(&locals[i], &local) || !Find(&upstreams[i], &upstream))
+                return -1;
+            size_t localSlot = reach(local);
+            masks[localSlot * words + (2 * i) / 64] |= 1ULL << ((2 * i) % 64);
+            update(localSlot);
+            size_t upstreamSlot = reach(upstream);
+            masks[upstreamSlot * words + (2 * i + 1) / 64] |=
+                1ULL << ((2 * i + 1) % 64);
+            update(upstreamSlot);
+        }
+
+        // As with a single count, once no queued commit is reached by only
+        // one side of a pair, the rest of the history is shared.
+        while (interestingCount > 0) {
+            uint32_t position = queue.top().position;
+            queue.pop();
+            size_t slot = slots[position];
+            if (interesting[slot]) {
+                interesting[slot] = false;
+                interestingCount--;
+            }
+
+            for (size_t w = 0; w < words; w++) {
+                uint64_t mask = masks[slot * words + w];
+                uint64_t localOnly = mask & ~(mask >> 1) & LOCAL_BITS;
+                uint64_t upstreamOnly = (mask >> 1) & ~mask & LOCAL_BITS;
+                for (size_t bit = 0; (localOnly | upstreamOnly) != 0;
+                     bit += 2, localOnly >>= 2, upstreamOnly >>= 2) {
+                    if (localOnly & 1)
+                        (*ahead)[(w * 64 + bit) / 2]++;
+                    if (upstreamOnly & 1)
+                        (*behind)[(w * 64 + bit) / 2]++;
+                }
+            }
+
+            ForEachParent(position, [&](uint32_t parent) {
+                size_t parentSlot = reach(parent);
+                for (size_t w = 0; w < words; w++)
+                    masks[parentSlot * words + w] |= masks[slot * words + w];
+                update(parentSlot);
+            });
+        }
+        return GIT_OK;
+    }
+};
+
+CommitGraph::CommitGraph(const char *gitdir)
+    : graphPath(string(gitdir) + "git-native/commit-graph"),
+      snapshot(make_shared<Snapshot>()) {
+    uv_mutex_init(&lock);
+    uv_mutex_init(&updateLock);
+}
+
+CommitGraph::~CommitGraph() {
+    uv_mutex_destroy(&lock);
+    uv_mutex_destroy(&updateLock);
+}
+
+bool CommitGraph::TakeBuild() {
+    uv_mutex_lock(&lock);
+    bool take = needsBuild && !buildTaken;
+    if (take)
+        buildTaken = true;
+    uv_mutex_unlock(&lock);
+    return take;
+}
+
+int CommitGraph::Build(git_repository *repository) {
+    vector<git_oid> tips;
+    uv_mutex_lock(&lock);
+    tips.swap(wanted);
+    needsBuild = false;
+    buildTaken = false;
+    uv_mutex_unlock(&lock);
+
+    git_oid head;
+    if (git_reference_name_to_id(&head, repository, "HEAD") == GIT_OK)
+        tips.push_back(head);
+
+    git_reference_iterator *iterator;
+    int error = git_reference_iterator_new(&iterator, repository);
+    if (error != GIT_OK)
+        return error;
+    git_reference *reference;
+    while (git_reference_next(&reference, iterator) == GIT_OK) {
+        git_object *target;
+        if (git_reference_peel(&target, reference, GIT_OBJ_COMMIT) == GIT_OK) {
+            tips.push_back(*git_object_id(target));
+            git_object_free(target);
+        }
+        git_reference_free(reference);
+    }
+    git_reference_iterator_free(iterator);
+
+    return Update(repository, tips);
+}
+
+int CommitGraph::CountCommits(const git_oid *from, const git_oid *hide,
+                              size_t *count) {
+    vector<git_oid> tips;
+    tips.push_back(*from);
+    tips.push_back(*hide);
+    shared_ptr<const Snapshot> current = Covering(tips);
+    if (!current)
+        return -1;
+    return current->Count(from, hide, count);
+}
+
+int CommitGraph::MergeBase(const git_oid *one, const git_oid *two,
+                           git_oid *base) {
+    vector<git_oid> tips;
+    tips.push_back(*one);
+    tips.push_back(*two);
+    shared_ptr<const Snapshot> current = Covering(tips);
+    if (!current)
+        return -1;
+    return current->MergeBase(one, two, base);
+}
+
+int CommitGraph::AheadBehind(const vector<git_oid> &locals,
+                             const vector<git_oid> &upstreams,
+                             vector<size_t> *ahead, vector<size_t> *behind) {
+    vector<git_oid> tips(locals);
+    tips.insert(tips.end(), upstreams.begin(), upstreams.end());
+    shared_ptr<const Snapshot> current = Covering(tips);
+    if (!current)
+        return -1;
+    return current->AheadBehind(locals, upstreams, ahead, behind);
+}
+
+void CommitGraph::Commits(vector<git_oid> *ids) {
+    shared_ptr<const Snapshot> current = Current();
+    ids->reserve(ids->size() + current->count);
+    for (uint32_t i = 0; i < current->count; i++)
+        ids->push_back(*current->Id(i));
+}
+
+shared_ptr<const CommitGraph::Snapshot> CommitGraph::Current() {
+    uv_mutex_lock(&lock);
+    if (!loaded) {
+        loaded = true;
+        shared_ptr<Snapshot> mapped = make_shared<Snapshot>();
+        if (mapped->Map(graphPath))
+            snapshot = mapped;
+    }
+    shared_ptr<const Snapshot> current = snapshot;
+    uv_mutex_unlock(&lock);
+    return current;
+}
+
+shared_ptr<const CommitGraph::Snapshot> CommitGraph::Covering(
+        const vector<git_oid> &tips) {
+    shared_ptr<const Snapshot> current = Current();
+    vector<git_oid> missing;
+    uint32_t position;
+    for (size_t i = 0; i < tips.size(); i++) {
+        if (!current->Find(&tips[i], &position))
+            missing.push_back(tips[i]);
+    }
+    if (missing.empty())
+        return current;
+
+    // Ids that aren't commits would have every later query build again.
+    uv_mutex_lock(&lock);
+    for (size_t i = 0; i < missing.size(); i++) {
+        if (!binary_search(unreadable.begin(), unreadable.end(), missing[i],
+                           OidLess)) {
+            wanted.push_back(missing[i]);
+            needsBuild = true;
+        }
+    }
+    uv_mutex_unlock(&lock);
+    return nullptr;
+}
+
+int CommitGraph::Update(git_repository *repository,
+                        const vector<git_oid> &tips) {
+    shared_ptr<const Snapshot> current = Current();
+    uint32_t position;
+    bool complete = true;
+    for (size_t i = 0; i < tips.size() && complete; i++)
+        complete = current->Find(&tips[i], &position);
+    if (complete)
+        return GIT_OK;
+
+    uv_mutex_lock(&updateLock);
+    // Another update may have added the commits in the meantime.
+    current = Current();
+
+    NewCommits added;
+    vector<git_oid> missing;
+    vector<git_oid> pending(tips);
+    while (!pending.empty()) {
+        git_oid id = pending.back();
+        pending.pop_back();
+        if (current->Find(&id, &position) || added.count(id) > 0)
+            continue;
+        // The parents of the boundary commits of a shallow clone aren't in
+        // the repository, nor are the ids of queries that aren't commits.
+        git_commit *commit;
+        if (git_commit_lookup(&commit, repository, &id) != GIT_OK) {
+            missing.push_back(id);
+            continue;
+        }
+
+        NewCommit &entry = added[id];
+        entry.time = git_commit_time(commit);
+        unsigned int parentCount = git_commit_parentcount(commit);
+        for (unsigned int i = 0; i < parentCount; i++) {
+            entry.parents.push_back(*git_commit_parent_id(commit, i));
+            pending.push_back(entry.parents.back());
+        }
+        git_commit_free(commit);
+    }
+
+    if (!missing.empty()) {
+        sort(missing.begin(), missing.end(), OidLess);
+        NewCommits::iterator commit = added.begin();
+        for (; commit != added.end(); ++commit) {
+            vector<git_oid> &parents = commit->second.parents;
+            size_t before = parents.size();
+            parents.erase(remove_if(parents.begin(), parents.end(),
+                                    [&missing](const git_oid &parent) {
+                                        return binary_search(
+                                            missing.begin(), missing.end(),
+                                            parent, OidLess);
+                                    }),
+                          parents.end());
+            if (parents.size() != before)
+                shallow = true;
+        }
+
+        uv_mutex_lock(&lock);
+        unreadable.insert(unreadable.end(), missing.begin(), missing.end());
+        sort(unreadable.begin(), unreadable.end(), OidLess);
+        unreadable.erase(unique(unreadable.begin(), unreadable.end(),
+                                [](const git_oid &a, const git_oid &b) {
+                                    return git_oid_equal(&a, &b) != 0;
+                                }),
+                         unreadable.end());
+        uv_mutex_unlock(&lock);
+    }
+
+    int error = GIT_OK;
+    if (!added.empty()) {
+        current->AssignGenerations(&added);
+        string data = current->Merge(added);
+        // A graph that couldn't be written is still good for this process,
+        // a shallow one isn't written at all.
+        shared_ptr<Snapshot> updated = make_shared<Snapshot>();
+        if (shallow || !(Save(data) && updated->Map(graphPath))) {
+            updated = make_shared<Snapshot>();
+            if (!updated->Own(&data))
+                error = -1;
+        }
+        if (error == GIT_OK) {
+            uv_mutex_lock(&lock);
+            snapshot = updated;
+            uv_mutex_unlock(&lock);
+        }
+    }
+
+    uv_mutex_unlock(&updateLock);
+    return error;
+}
+
+bool CommitGraph::Save(const string &data) {
+    // Write a temporary file and rename it over the graph so readers never
+    // see a partial file.
+    uv_fs_t request;
+    string directory = graphPath.substr(0, graphPath.rfind('/'));
+    uv_fs_mkdir(NULL, &request, directory.c_str(), 0777, NULL);
+    uv_fs_req_cleanup(&request);
+
+    string tempPath = graphPath + ".tmp";
+    FILE *file = fopen(tempPath.c_str(), "wb");
+    if (file == NULL)
+        return false;
+    bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+    written = fclose(file) == 0 && written;
+
+    if (written) {
+        written = uv_fs_rename(NULL, &request, tempPath.c_str(),
+                               graphPath.c_str(), NULL) == 0;
+        uv_fs_req_cleanup(&request);
+    }
+    if (!written)
+        remove(tempPath.c_str());
+    return written;
+}
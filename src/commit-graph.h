@@ -0,0 +1,98 @@
+#ifndef SRC_COMMIT_GRAPH_H_
+#define SRC_COMMIT_GRAPH_H_
+
+#include <git2.h>
+#include <uv.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;  // NOLINT(build/namespaces)
+
+// Parents, generation numbers and commit dates of every commit reachable
+// from the refs, in the spirit of git's commit-graph file.
+//
+// Commits are sorted by id behind a fanout table, each with the positions of
+// its parents and its generation, one more than the highest generation of
+// its parents. A walk that visits commits by decreasing generation sees every
+// child of a commit before the commit itself, so counts and merge bases can
+// stop as soon as the rest of the queue can't change the answer, without
+// parsing a single commit object.
+//
+// The graph is stored in <gitdir>/git-native/commit-graph and mapped into
+// memory. Commits never change, the file can't go stale, it only misses the
+// commits created since it was written. Queries never parse commits: when
+// one misses a commit it fails with -1, so the caller falls back to a
+// revwalk, and the commit is added by the next Build, together with every
+// other commit missed in the meantime.
+//
+// The boundary commits of a shallow clone are roots in the graph. It is
+// then only kept in memory, since they have parents again once the clone is
+// deepened.
+// Queries may run on several threads at once.
+class CommitGraph {
+    private:
+        static const uint32_t VERSION = 1;
+
+        struct Snapshot;
+
+        string graphPath;
+        uv_mutex_t lock;
+        shared_ptr<const Snapshot> snapshot;
+        bool loaded = false;
+        // Set until the first Build, and when queries missed commits since.
+        bool needsBuild = true;
+        bool buildTaken = false;
+        // The commits queries missed, and the ones Build couldn't read.
+        vector<git_oid> wanted;
+        vector<git_oid> unreadable;
+        // Held while commits are added, only one update runs at a time.
+        uv_mutex_t updateLock;
+        // Whether parents were left out, guarded by updateLock.
+        bool shallow = false;
+
+    public:
+        explicit CommitGraph(const char *gitdir);
+        ~CommitGraph();
+
+        // True the first time it is called and after queries missed
+        // commits, unless a Build is already pending. The caller should then
+        // run Build in the background.
+        bool TakeBuild();
+
+        // Add every commit reachable from the refs and HEAD, and the commits
+        // queries missed.
+        int Build(git_repository *repository);
+
+        // Number of commits reachable from |from| but not from |hide|, like
+        // git rev-list --count ^hide from.
+        int CountCommits(const git_oid *from, const git_oid *hide,
+                         size_t *count);
+
+        // One of the best common ancestors of |one| and |two|, like git
+        // merge-base. GIT_ENOTFOUND when they have none.
+        int MergeBase(const git_oid *one, const git_oid *two, git_oid *base);
+
+        // How many commits every commit of |locals| has that the commit of
+        // |upstreams| at the same index doesn't and the other way around,
+        // like git rev-list --left-right --count. All pairs are counted in
+        // one walk.
+        int AheadBehind(const vector<git_oid> &locals,
+                        const vector<git_oid> &upstreams,
+                        vector<size_t> *ahead, vector<size_t> *behind);
+
+        // Every commit in the graph, in id order.
+        void Commits(vector<git_oid> *ids);
+
+    private:
+        shared_ptr<const Snapshot> Current();
+        // The graph when it has every commit of |tips|, NULL after
+        // remembering the missing ones for the next Build otherwise.
+        shared_ptr<const Snapshot> Covering(const vector<git_oid> &tips);
+        // Add every commit reachable from |tips| the graph doesn't have.
+        int Update(git_repository *repository, const vector<git_oid> &tips);
+        bool Save(const string &data);
+};
+
+#endif  // SRC_COMMIT_GRAPH_H_
@@ -0,0 +1,387 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sstream>
+#include "./commit-log.h"
+
+namespace {
+
+bool StartsWith(const char *line, const char *end, const char *prefix) {
+    size_t length = strlen(prefix);
+    return static_cast<size_t>(end - line) >= length &&
+        memcmp(line, prefix, length) == 0;
+}
+
+// Parse "Name <email> 1234567890 +0200", the value of an author or
+// committer header.
+void ParseSignature(const char *start, const char *end,
+                    LogSignature *signature) {
+    const char *open = static_cast<const char*>(memchr(start, '<',
+                                                       end - start));
+    const char *close = end;
+    while (close > start && close[-1] != '>')
+        close--;
+    if (open == NULL || close <= open)
+        return;
+
+    const char *nameEnd = open;
+    while (nameEnd > start && nameEnd[-1] == ' ')
+        nameEnd--;
+    signature->name.assign(start, nameEnd);
+    signature->email.assign(open + 1, close - 1);
+
+    string date(close, end);
+    const char *time = date.c_str();
+    char *next;
+    signature->time = strtoll(time, &next, 10);
+    while (*next == ' ')
+        next++;
+    if ((*next == '+' || *next == '-') && strlen(next) >= 5) {
+        int hours = (next[1] - '0') * 10 + (next[2] - '0');
+        int minutes = (next[3] - '0') * 10 + (next[4] - '0');
+        signature->offset = (hours * 60 + minutes) * (*next == '-' ? -1 : 1);
+    }
+}
+
+string Summary(const char *start, const char *end) {
+    while (start < end && (*start == '\n' || *start == ' '))
+        start++;
+
+    string summary;
+    for (const char *c = start; c < end; c++) {
+        if (*c != '\n') {
+            summary.push_back(*c);
+            continue;
+        }
+        if (c + 1 == end || c[1] == '\n')
+            break;
+        summary.push_back(' ');
+    }
+    while (!summary.empty() && summary[summary.size() - 1] == ' ')
+        summary.erase(summary.size() - 1);
+    return summary;
+}
+
+int PeelToCommit(git_object *object, git_oid *id) {
+    git_object *commit;
+    int error = git_object_peel(&commit, object, GIT_OBJ_COMMIT);
+    if (error != GIT_OK)
+        return error;
+    git_oid_cpy(id, git_object_id(commit));
+    git_object_free(commit);
+    return GIT_OK;
+}
+
+int ResolveRevision(git_repository *repository, const string &revision,
+                    LogOptions *options) {
+    bool hide = !revision.empty() && revision[0] == '^';
+    git_revspec spec;
+    int error = git_revparse(&spec, repository,
+                             revision.c_str() + (hide ? 1 : 0));
+    if (error != GIT_OK)
+        return error;
+
+    git_oid from, to;
+    if (spec.flags & GIT_REVPARSE_SINGLE) {
+        error = PeelToCommit(spec.from, &from);
+        if (error == GIT_OK)
+            (hide ? options->exclude : options->include).push_back(from);
+    } else {
+        error = PeelToCommit(spec.from, &from);
+        if (error == GIT_OK)
+            error = PeelToCommit(spec.to, &to);
+        git_oid base;
+        if (error == GIT_OK && (spec.flags & GIT_REVPARSE_MERGE_BASE)) {
+            // a...b, the commits of either side but not of both.
+            options->include.push_back(from);
+            options->include.push_back(to);
+            int found = git_merge_base(&base, repository, &from, &to);
+            if (found == GIT_OK)
+                options->exclude.push_back(base);
+            else if (found != GIT_ENOTFOUND)
+                error = found;
+        } else if (error == GIT_OK) {
+            options->exclude.push_back(from);
+            options->include.push_back(to);
+        }
+    }
+    git_object_free(spec.from);
+    git_object_free(spec.to);
+    return error;
+}
+
+string JoinOids(const vector<git_oid> &ids) {
+    string joined;
+    char hex[GIT_OID_HEXSZ + 1];
+    for (size_t i = 0; i < ids.size(); i++) {
+        if (i > 0)
+            joined.push_back(',');
+        git_oid_tostr(hex, sizeof(hex), &ids[i]);
+        joined.append(hex);
+    }
+    return joined;
+}
+
+bool SplitOids(const string &joined, vector<git_oid> *ids) {
+    ids->clear();
+    for (size_t start = 0; start < joined.size();) {
+        size_t comma = joined.find(',', start);
+        if (comma == string::npos)
+            comma = joined.size();
+        git_oid id;
+        if (comma - start != GIT_OID_HEXSZ ||
+            git_oid_fromstrn(&id, joined.c_str() + start, GIT_OID_HEXSZ)
+              != GIT_OK)
+            return false;
+        ids->push_back(id);
+        start = comma + 1;
+    }
+    return true;
+}
+
+// What identifies a walk whatever page it is on.
+string WalkKey(const LogOptions &options) {
+    std::ostringstream key;
+    key << options.sort << ':' << JoinOids(options.include) << ':'
+        << JoinOids(options.exclude);
+    return key.str();
+}
+
+}  // namespace
+
+void DecodeCommit(const char *data, size_t size, uint32_t fields,
+                  LogCommit *commit) {
+    const char *end = data + size;
+    const char *line = data;
+    while (line < end && *line != '\n') {
+        const char *eol = static_cast<const char*>(memchr(line, '\n',
+                                                          end - line));
+        if (eol == NULL)
+            eol = end;
+
+        git_oid parent;
+        if ((fields & LOG_PARENTS) && StartsWith(line, eol, "parent ") &&
+            git_oid_fromstrn(&parent, line + 7, eol - line - 7) == GIT_OK)
+            commit->parents.push_back(parent);
+        else if ((fields & LOG_AUTHOR) && StartsWith(line, eol, "author "))
+            ParseSignature(line + 7, eol, &commit->author);
+        else if ((fields & LOG_COMMITTER) &&
+                 StartsWith(line, eol, "committer "))
+            ParseSignature(line + 10, eol, &commit->committer);
+        line = eol < end ? eol + 1 : end;
+    }
+
+    const char *message = line < end ? line + 1 : end;
+    if (fields & LOG_SUMMARY)
+        commit->summary = Summary(message, end);
+    if (fields & LOG_MESSAGE)
+        commit->message.assign(message, end);
+}
+
+int ResolveLogRange(git_repository *repository, const string &range,
+                    LogOptions *options) {
+    options->include.clear();
+    options->exclude.clear();
+    std::istringstream revisions(range);
+    string revision;
+    while (revisions >> revision) {
+        int error = ResolveRevision(repository, revision, options);
+        if (error != GIT_OK)
+            return error;
+    }
+    if (options->include.empty() && options->exclude.empty())
+        return ResolveRevision(repository, "HEAD", options);
+    return GIT_OK;
+}
+
+string EncodeLogCursor(const LogOptions &options) {
+    std::ostringstream cursor;
+    cursor << "log1:" << options.offset << ':' << WalkKey(options);
+    return cursor.str();
+}
+
+bool DecodeLogCursor(const string &cursor, LogOptions *options) {
+    vector<string> parts;
+    for (size_t start = 0;;) {
+        size_t colon = cursor.find(':', start);
+        parts.push_back(cursor.substr(start, colon - start));
+        if (colon == string::npos)
+            break;
+        start = colon + 1;
+    }
+    if (parts.size() != 5 || parts[0] != "log1" || parts[1].empty() ||
+        parts[2].empty() ||
+        parts[1].find_first_not_of("0123456789") != string::npos ||
+        parts[2].find_first_not_of("0123456789") != string::npos)
+        return false;
+
+    options->offset = strtoull(parts[1].c_str(), NULL, 10);
+    options->sort = static_cast<unsigned int>(strtoul(parts[2].c_str(),
+                                                      NULL, 10));
+    return SplitOids(parts[3], &options->include) &&
+        SplitOids(parts[4], &options->exclude);
+}
+
+LogWalks::LogWalks() {
+    uv_mutex_init(&lock);
+}
+
+LogWalks::~LogWalks() {
+    for (size_t i = 0; i < paused.size(); i++)
+        Free(&paused[i]);
+    uv_mutex_destroy(&lock);
+}
+
+int LogWalks::Walk(git_repository *repository, const LogOptions &options,
+                   const LogBatchSink &sink, size_t *delivered, bool *more) {
+    *delivered = 0;
+    *more = false;
+
+    Paused walk;
+    walk.key = WalkKey(options);
+    if (!Take(walk.key, options.offset, &walk)) {
+        int error = Start(repository, options, &walk);
+        if (error != GIT_OK) {
+            Free(&walk);
+            return error == GIT_ITEROVER ? GIT_OK : error;
+        }
+    }
+
+    git_odb *odb = NULL;
+    int error = GIT_OK;
+    if (options.fields != 0)
+        error = git_repository_odb(&odb, walk.repository);
+
+    bool stopped = false;
+    size_t batchSize = options.batchSize > 0 ? options.batchSize : 1;
+    auto batch = make_shared<vector<LogCommit>>();
+    while (error == GIT_OK && *delivered + batch->size() < options.limit) {
+        git_oid id;
+        if (walk.hasNext) {
+            git_oid_cpy(&id, &walk.next);
+            walk.hasNext = false;
+        } else {
+            int next = git_revwalk_next(&id, walk.walk);
+            if (next == GIT_ITEROVER)
+                break;
+            if (next != GIT_OK) {
+                error = next;
+                break;
+            }
+        }
+
+        batch->push_back(LogCommit());
+        LogCommit &commit = batch->back();
+        git_oid_cpy(&commit.id, &id);
+        if (odb != NULL) {
+            git_odb_object *object;
+            error = git_odb_read(&object, odb, &id);
+            if (error != GIT_OK)
+                break;
+            DecodeCommit(static_cast<const char*>(git_odb_object_data(object)),
+                         git_odb_object_size(object), options.fields, &commit);
+            git_odb_object_free(object);
+        }
+
+        if (batch->size() == batchSize) {
+            if (!sink(batch)) {
+                stopped = true;
+                break;
+            }
+            *delivered += batch->size();
+            batch = make_shared<vector<LogCommit>>();
+        }
+    }
+    git_odb_free(odb);
+
+    if (error == GIT_OK && !stopped && !batch->empty()) {
+        if (sink(batch))
+            *delivered += batch->size();
+        else
+            stopped = true;
+    }
+
+    // Read ahead one commit to tell whether there is a next page.
+    if (error == GIT_OK && !stopped && *delivered == options.limit) {
+        int next = git_revwalk_next(&walk.next, walk.walk);
+        if (next == GIT_OK)
+            walk.hasNext = true;
+        else if (next != GIT_ITEROVER)
+            error = next;
+    }
+
+    // A page the sink stopped goes on from the last delivered commit,
+    // through a new walk.
+    *more = error == GIT_OK && (stopped || walk.hasNext);
+    if (error == GIT_OK && !stopped && walk.hasNext) {
+        walk.offset = options.offset + *delivered;
+        Pause(walk);
+    } else {
+        Free(&walk);
+    }
+    return error;
+}
+
+bool LogWalks::Take(const string &key, size_t offset, Paused *walk) {
+    uv_mutex_lock(&lock);
+    bool found = false;
+    for (deque<Paused>::iterator i = paused.begin(); i != paused.end(); ++i) {
+        if (i->offset == offset && i->key == key) {
+            *walk = *i;
+            paused.erase(i);
+            found = true;
+            break;
+        }
+    }
+    uv_mutex_unlock(&lock);
+    return found;
+}
+
+void LogWalks::Pause(const Paused &walk) {
+    Paused evicted;
+    uv_mutex_lock(&lock);
+    paused.push_back(walk);
+    if (paused.size() > MAX_PAUSED) {
+        evicted = paused.front();
+        paused.pop_front();
+    }
+    uv_mutex_unlock(&lock);
+    Free(&evicted);
+}
+
+void LogWalks::Free(Paused *walk) {
+    if (walk->walk != NULL)
+        git_revwalk_free(walk->walk);
+    if (walk->repository != NULL)
+        git_repository_free(walk->repository);
+    walk->walk = NULL;
+    walk->repository = NULL;
+}
+
+int LogWalks::Start(git_repository *repository, const LogOptions &options,
+                    Paused *walk) {
+    // The walk may outlive the handle it was asked on, it gets its own.
+    int error = git_repository_open_ext(&walk->repository,
+                                        git_repository_path(repository),
+                                        GIT_REPOSITORY_OPEN_NO_SEARCH, NULL);
+    if (error != GIT_OK) {
+        walk->repository = NULL;
+        return error;
+    }
+    error = git_revwalk_new(&walk->walk, walk->repository);
+    if (error != GIT_OK) {
+        walk->walk = NULL;
+        return error;
+    }
+
+    git_revwalk_sorting(walk->walk, options.sort);
+    for (size_t i = 0; i < options.include.size() && error == GIT_OK; i++)
+        error = git_revwalk_push(walk->walk, &options.include[i]);
+    for (size_t i = 0; i < options.exclude.size() && error == GIT_OK; i++)
+        error = git_revwalk_hide(walk->walk, &options.exclude[i]);
+
+    // Skip the commits of the previous pages.
+    git_oid id;
+    for (size_t i = 0; i < options.offset && error == GIT_OK; i++)
+        error = git_revwalk_next(&id, walk->walk);
+    return error;
+}
@@ -0,0 +1,117 @@
+#ifndef SRC_COMMIT_LOG_H_
+#define SRC_COMMIT_LOG_H_
+
+#include <git2.h>
+#include <uv.h>
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;  // NOLINT(build/namespaces)
+
+// Commit fields a log decodes on top of the id, see LogOptions::fields.
+enum LogField {
+    LOG_PARENTS = 1,
+    LOG_AUTHOR = 2,
+    LOG_COMMITTER = 4,
+    LOG_SUMMARY = 8,
+    LOG_MESSAGE = 16
+};
+
+struct LogSignature {
+    string name;
+    string email;
+    int64_t time = 0;
+    // Minutes east of UTC.
+    int offset = 0;
+};
+
+struct LogCommit {
+    git_oid id;
+    vector<git_oid> parents;
+    LogSignature author;
+    LogSignature committer;
+    // The first paragraph of the message on a single line.
+    string summary;
+    string message;
+};
+
+struct LogOptions {
+    // git_sort_t flags of the walk.
+    unsigned int sort = GIT_SORT_TIME;
+    vector<git_oid> include;
+    vector<git_oid> exclude;
+    // Commits delivered by the previous pages.
+    size_t offset = 0;
+    size_t limit = 100;
+    size_t batchSize = 50;
+    // LogField flags, commits are only read when one is set.
+    uint32_t fields = 0;
+};
+
+typedef function<bool(const shared_ptr<vector<LogCommit>> &commits)>
+    LogBatchSink;
+
+// Decode the |fields| of |commit| out of the raw commit object |data|,
+// skipping everything else.
+void DecodeCommit(const char *data, size_t size, uint32_t fields,
+                  LogCommit *commit);
+
+// Resolve |range|, revisions separated by spaces as git log takes them:
+// a..b, a...b, ^a and plain revisions. An empty range is HEAD.
+int ResolveLogRange(git_repository *repository, const string &range,
+                    LogOptions *options);
+
+// An opaque string the next page of |options| resumes from, and the other
+// way around. The walk and its tips are part of it so every page walks the
+// history the first page saw, even after refs moved.
+string EncodeLogCursor(const LogOptions &options);
+bool DecodeLogCursor(const string &cursor, LogOptions *options);
+
+// Walks the pages of commit logs.
+//
+// Paging through a long history by skipping the commits of the previous
+// pages walks the first commits over and over. Instead, the walk of a page
+// that has more commits is paused, with the repository handle it walks on,
+// and the next page picks it up where it stopped. Only a few walks are kept,
+// a page whose walk was dropped starts over and skips the commits already
+// delivered. Pages may be walked from several threads at once.
+class LogWalks {
+    private:
+        static const size_t MAX_PAUSED = 4;
+
+        struct Paused {
+            string key;
+            size_t offset = 0;
+            git_repository *repository = NULL;
+            git_revwalk *walk = NULL;
+            // The first commit of the next page, read to know there is one.
+            git_oid next;
+            bool hasNext = false;
+        };
+
+        uv_mutex_t lock;
+        deque<Paused> paused;
+
+    public:
+        LogWalks();
+        ~LogWalks();
+
+        // Deliver the page of |options| to |sink| in batches. |more| is set
+        // when the log goes on, the cursor of the next page then has an
+        // offset of |options.offset| + |delivered|.
+        int Walk(git_repository *repository, const LogOptions &options,
+                 const LogBatchSink &sink, size_t *delivered, bool *more);
+
+    private:
+        bool Take(const string &key, size_t offset, Paused *walk);
+        void Pause(const Paused &walk);
+        static void Free(Paused *walk);
+        static int Start(git_repository *repository,
+                         const LogOptions &options, Paused *walk);
+};
+
+#endif  // SRC_COMMIT_LOG_H_
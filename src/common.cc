@@ -4,12 +4,19 @@ Progress::Progress(
     const Nan::AsyncProgressWorker::ExecutionProgress* notifier)
     : nanProgress(notifier) {
         uv_mutex_init(&async_lock);
+        uv_cond_init(&chunksTaken);
 }
 
 Progress::~Progress() {
+    uv_cond_destroy(&chunksTaken);
     uv_mutex_destroy(&async_lock);
 }
 
+void Progress::SetNotifier(
+    const Nan::AsyncProgressWorker::ExecutionProgress* notifier) {
+    nanProgress = notifier;
+}
+
 void Progress::Step(const char* name, int stepIdx) {
     if (lastStepIdx < stepIdx)
         return;
@@ -75,7 +82,61 @@ v8::Local<v8::Value> Progress::ToJsProgress(v8::Isolate *isolate) {
     return scope.Escape(obj);
 }
 
+bool Progress::PushChunk(GetResult chunk) {
+    uv_mutex_lock(&async_lock);
+    while (chunks.size() >= MAX_PENDING_CHUNKS && !cancelled)
+        uv_cond_wait(&chunksTaken, &async_lock);
+    bool accepted = !cancelled;
+    if (accepted)
+        chunks.push_back(chunk);
+    uv_mutex_unlock(&async_lock);
+
+    if (accepted)
+        Notify();
+    return accepted;
+}
+
+void Progress::TakeChunks(vector<GetResult> *taken) {
+    uv_mutex_lock(&async_lock);
+    taken->insert(taken->end(), chunks.begin(), chunks.end());
+    chunks.clear();
+    uv_cond_broadcast(&chunksTaken);
+    uv_mutex_unlock(&async_lock);
+}
+
+bool Progress::TakeUpdate() {
+    uv_mutex_lock(&async_lock);
+    bool wasUpdated = updated;
+    updated = false;
+    uv_mutex_unlock(&async_lock);
+    return wasUpdated;
+}
+
+void Progress::Cancel() {
+    uv_mutex_lock(&async_lock);
+    cancelled = true;
+    uv_cond_broadcast(&chunksTaken);
+    uv_mutex_unlock(&async_lock);
+}
+
+bool Progress::IsCancelled() {
+    uv_mutex_lock(&async_lock);
+    bool wasCancelled = cancelled;
+    uv_mutex_unlock(&async_lock);
+    return wasCancelled;
+}
+
 void Progress::Update() {
+    uv_mutex_lock(&async_lock);
+    updated = true;
+    uv_mutex_unlock(&async_lock);
+    Notify();
+}
+
+void Progress::Notify() {
+    if (nanProgress == nullptr)
+        return;
+
     ProgressWrapper wrapper = {this};
     nanProgress->Send(
         reinterpret_cast<const char*>(&wrapper),
@@ -3,6 +3,7 @@
 
 #include <git2.h>
 #include <nan.h>
+#include <deque>
 #include <string>
 #include <functional>
 #include <vector>
@@ -11,10 +12,17 @@ using namespace std;  // NOLINT(build/namespaces)
 using namespace v8;  // NOLINT(build/namespaces)
 using namespace Nan;  // NOLINT(build/namespaces)
 
+typedef function<Local<Value>()> GetResult;
+
 class Progress {
     private:
         const int PROGESS_UNKNOWN = -1;
+        const size_t MAX_PENDING_CHUNKS = 4;
         uv_mutex_t async_lock;
+        uv_cond_t chunksTaken;
+        deque<GetResult> chunks;
+        bool updated = false;
+        bool cancelled = false;
         vector<string*> messages;
         const AsyncProgressWorker::ExecutionProgress* nanProgress;
         string lastStepName;
@@ -29,21 +37,38 @@ class Progress {
             Progress *progress;
         };
         explicit Progress(
-            const Nan::AsyncProgressWorker::ExecutionProgress* notifier);
+            const Nan::AsyncProgressWorker::ExecutionProgress* notifier =
+                nullptr);
 
         ~Progress();
 
+        void SetNotifier(
+            const Nan::AsyncProgressWorker::ExecutionProgress* notifier);
         void Step(const char* name, int stepIdx);
         void Message(const char* message, int len);
         void ProgressChange(int done, int total);
         Local<Value> ToJsProgress(Isolate *isolate);
 
+        // Hand a chunk of results to the progress callback. Blocks while
+        // MAX_PENDING_CHUNKS chunks wait for the main thread so a fast
+        // producer can't buffer everything. Returns false once the
+        // consumer cancelled.
+        bool PushChunk(GetResult chunk);
+        void TakeChunks(vector<GetResult> *taken);
+        // Whether Step, Message or ProgressChange were called since the
+        // last call.
+        bool TakeUpdate();
+        void Cancel();
+        bool IsCancelled();
+
     private:
         void Update();
+        void Notify();
 };
 
-typedef function<Local<Value>()> GetResult;
 typedef function<GetResult(Progress *progress)>  Work;
+typedef function<GetResult(git_repository *repository, Progress *progress)>
+    RepositoryWork;
 
 template<typename... Args>
 using RemoteAction =  GetResult(*)(git_remote *remote, Args ...params);
@@ -0,0 +1,244 @@
+#include <ctype.h>
+#include <string.h>
+#include "./diff-session.h"
+#include "./diff-text.h"
+#include "./myers.h"
+
+Nan::Persistent<Function> DiffSession::constructor;
+
+void DiffSession::Init() {
+    Local<FunctionTemplate> newTemplate =
+        Nan::New<FunctionTemplate>(DiffSession::New);
+    newTemplate->SetClassName(Nan::New<String>("DiffSession").ToLocalChecked());
+    newTemplate->InstanceTemplate()->SetInternalFieldCount(1);
+
+    Local<ObjectTemplate> proto = newTemplate->PrototypeTemplate();
+    Nan::SetMethod(proto, "setText", DiffSession::SetText);
+    Nan::SetMethod(proto, "edit", DiffSession::Edit);
+    Nan::SetMethod(proto, "getLineDiffs", DiffSession::GetLineDiffs);
+
+    constructor.Reset(newTemplate->GetFunction());
+}
+
+Local<Value> DiffSession::NewInstance(git_blob *blob,
+                                      bool ignoreEolWhitespace) {
+    Local<Object> instance = Nan::NewInstance(
+        Nan::New(constructor), 0, {}).ToLocalChecked();
+    DiffSession *session = Nan::ObjectWrap::Unwrap<DiffSession>(instance);
+
+    session->ignoreEolWhitespace = ignoreEolWhitespace;
+    git_oid_cpy(&session->baseId, git_blob_id(blob));
+    SplitLines(static_cast<const char*>(git_blob_rawcontent(blob)),
+               static_cast<size_t>(git_blob_rawsize(blob)),
+               &session->baseLines);
+    session->baseIds.reserve(session->baseLines.size());
+    for (size_t i = 0; i < session->baseLines.size(); i++)
+        session->baseIds.push_back(session->LineId(session->baseLines[i]));
+
+    // The buffer starts out as the base.
+    session->lines = session->baseLines;
+    session->ids = session->baseIds;
+    return instance;
+}
+
+NAN_METHOD(DiffSession::New) {
+    DiffSession *session = new DiffSession();
+    session->Wrap(info.This());
+    info.GetReturnValue().SetUndefined();
+}
+
+NAN_METHOD(DiffSession::SetText) {
+    DiffSession *session = Nan::ObjectWrap::Unwrap<DiffSession>(info.This());
+    DiffText text(info[0]);
+
+    git_oid id;
+    if (git_odb_hash(&id, text.Data(), text.Length(), GIT_OBJ_BLOB) == GIT_OK &&
+        git_oid_equal(&id, &session->baseId)) {
+        session->lines = session->baseLines;
+        session->ids = session->baseIds;
+        session->hunks.clear();
+        session->hunksValid = true;
+        return info.GetReturnValue().SetUndefined();
+    }
+
+    session->lines.clear();
+    SplitLines(text.Data(), text.Length(), &session->lines);
+    session->ids.resize(session->lines.size());
+    for (size_t i = 0; i < session->lines.size(); i++)
+        session->ids[i] = session->LineId(session->lines[i]);
+    session->hunksValid = false;
+
+    session->PruneLineIds();
+    info.GetReturnValue().SetUndefined();
+}
+
+NAN_METHOD(DiffSession::Edit) {
+    DiffSession *session = Nan::ObjectWrap::Unwrap<DiffSession>(info.This());
+    if (info.Length() < 3 || !info[0]->IsNumber() || !info[1]->IsNumber())
+        return Nan::ThrowTypeError(
+            "A row, a row count and a text are required");
+
+    size_t lineCount = session->lines.size();
+    double rowValue = info[0]->NumberValue();
+    double countValue = info[1]->NumberValue();
+    size_t row = rowValue > 0 ? static_cast<size_t>(rowValue) : 0;
+    size_t count = countValue > 0 ? static_cast<size_t>(countValue) : 0;
+    if (row > lineCount)
+        row = lineCount;
+    if (count > lineCount - row)
+        count = lineCount - row;
+
+    DiffText value(info[2]);
+    string text(value.Data(), value.Length());
+
+    // Text added after a last line without a newline continues that line.
+    if (row == lineCount && row > 0) {
+        const string &last = session->lines[row - 1];
+        if (last.empty() || last[last.size() - 1] != '\n') {
+            row--;
+            count = 1;
+            text = last + text;
+        }
+    }
+
+    vector<string> replacement;
+    SplitLines(text.data(), text.size(), &replacement);
+
+    // The rest of a row that doesn't end the text joins the next row.
+    if (!replacement.empty() && row + count < lineCount) {
+        string &last = replacement.back();
+        if (last[last.size() - 1] != '\n') {
+            last += session->lines[row + count];
+            count++;
+        }
+    }
+
+    vector<uint32_t> replacementIds(replacement.size());
+    for (size_t i = 0; i < replacement.size(); i++)
+        replacementIds[i] = session->LineId(replacement[i]);
+
+    session->lines.erase(session->lines.begin() + row,
+                         session->lines.begin() + row + count);
+    session->lines.insert(session->lines.begin() + row,
+                          replacement.begin(), replacement.end());
+    session->ids.erase(session->ids.begin() + row,
+                       session->ids.begin() + row + count);
+    session->ids.insert(session->ids.begin() + row,
+                        replacementIds.begin(), replacementIds.end());
+    session->hunksValid = false;
+
+    session->PruneLineIds();
+    info.GetReturnValue().SetUndefined();
+}
+
+NAN_METHOD(DiffSession::GetLineDiffs) {
+    DiffSession *session = Nan::ObjectWrap::Unwrap<DiffSession>(info.This());
+    if (!session->hunksValid)
+        session->ComputeHunks();
+
+    const vector<Hunk> &hunks = session->hunks;
+    Local<Object> v8Ranges = Nan::New<Array>(hunks.size());
+    for (size_t i = 0; i < hunks.size(); i++) {
+        Local<Object> v8Range = Nan::New<Object>();
+        v8Range->Set(Nan::New<String>("oldStart").ToLocalChecked(),
+                     Nan::New<Number>(hunks[i].oldStart));
+        v8Range->Set(Nan::New<String>("oldLines").ToLocalChecked(),
+                     Nan::New<Number>(hunks[i].oldLines));
+        v8Range->Set(Nan::New<String>("newStart").ToLocalChecked(),
+                     Nan::New<Number>(hunks[i].newStart));
+        v8Range->Set(Nan::New<String>("newLines").ToLocalChecked(),
+                     Nan::New<Number>(hunks[i].newLines));
+        v8Ranges->Set(i, v8Range);
+    }
+    info.GetReturnValue().Set(v8Ranges);
+}
+
+void DiffSession::SplitLines(const char *data, size_t length,
+                             vector<string> *lines) {
+    size_t start = 0;
+    while (start < length) {
+        const void *newline = memchr(data + start, '\n', length - start);
+        size_t end = newline == NULL ? length :
+            static_cast<const char*>(newline) - data + 1;
+        lines->push_back(string(data + start, end - start));
+        start = end;
+    }
+}
+
+uint32_t DiffSession::LineId(const string &line) {
+    // Like xdiff, ignoring whitespace at the end of lines also ignores a
+    // missing newline on the last one.
+    size_t length = line.size();
+    if (ignoreEolWhitespace) {
+        while (length > 0 && isspace(static_cast<unsigned char>(
+                   line[length - 1])))
+            length--;
+    }
+
+    unordered_map<string, uint32_t>::iterator found =
+        lineIds.emplace(line.substr(0, length), lineIds.size()).first;
+    return found->second;
+}
+
+void DiffSession::PruneLineIds() {
+    // Lines that were edited away keep their ids, drop them once they
+    // outnumber the lines still in use.
+    if (lineIds.size() <= 2 * (baseLines.size() + lines.size()) + 4096)
+        return;
+
+    lineIds.clear();
+    for (size_t i = 0; i < baseLines.size(); i++)
+        baseIds[i] = LineId(baseLines[i]);
+    for (size_t i = 0; i < lines.size(); i++)
+        ids[i] = LineId(lines[i]);
+}
+
+void DiffSession::ComputeHunks() {
+    hunks.clear();
+    hunksValid = true;
+
+    size_t oldLength = baseIds.size();
+    size_t newLength = ids.size();
+    size_t prefix = 0;
+    while (prefix < oldLength && prefix < newLength &&
+           baseIds[prefix] == ids[prefix])
+        prefix++;
+    size_t suffix = 0;
+    while (suffix < oldLength - prefix && suffix < newLength - prefix &&
+           baseIds[oldLength - 1 - suffix] == ids[newLength - 1 - suffix])
+        suffix++;
+
+    size_t oldCount = oldLength - prefix - suffix;
+    size_t newCount = newLength - prefix - suffix;
+    if (oldCount == 0 && newCount == 0)
+        return;
+
+    vector<bool> removed, added;
+    MyersDiff(baseIds.data() + prefix, oldCount, ids.data() + prefix,
+              newCount, &removed, &added);
+
+    // Hunks without context, numbered like git's: 1-based, and an empty
+    // side starts at the line before the change.
+    size_t i = 0, j = 0;
+    while (i < oldCount || j < newCount) {
+        if ((i < oldCount && removed[i]) || (j < newCount && added[j])) {
+            size_t oldFirst = i, newFirst = j;
+            while (i < oldCount && removed[i])
+                i++;
+            while (j < newCount && added[j])
+                j++;
+
+            Hunk hunk;
+            hunk.oldLines = static_cast<int>(i - oldFirst);
+            hunk.newLines = static_cast<int>(j - newFirst);
+            hunk.oldStart = static_cast<int>(prefix + oldFirst) +
+                (hunk.oldLines > 0 ? 1 : 0);
+            hunk.newStart = static_cast<int>(prefix + newFirst) +
+                (hunk.newLines > 0 ? 1 : 0);
+            hunks.push_back(hunk);
+        } else {
+            i++;
+            j++;
+        }
+    }
+}
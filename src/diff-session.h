@@ -0,0 +1,65 @@
+#ifndef SRC_DIFF_SESSION_H_
+#define SRC_DIFF_SESSION_H_
+
+#include <nan.h>
+#include <git2.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;  // NOLINT(build/namespaces)
+using namespace v8;  // NOLINT(build/namespaces)
+
+// Line diffs of an editor buffer against one base blob, kept across edits.
+//
+// The base blob is split into lines once and every distinct line gets an
+// id, so diffing compares integers. Edits replace whole rows and only the
+// new rows are split and looked up. A diff skips the rows both sides start
+// and end with and runs Myers' algorithm on what is left, usually a few
+// rows around the edits. Setting a text whose blob id is the base's skips
+// the diff altogether.
+class DiffSession : public Nan::ObjectWrap {
+    private:
+        struct Hunk {
+            int oldStart;
+            int oldLines;
+            int newStart;
+            int newLines;
+        };
+
+        static Nan::Persistent<Function> constructor;
+
+        bool ignoreEolWhitespace = false;
+        git_oid baseId;
+        unordered_map<string, uint32_t> lineIds;
+        vector<string> baseLines;
+        vector<uint32_t> baseIds;
+        vector<string> lines;
+        vector<uint32_t> ids;
+
+        bool hunksValid = true;
+        vector<Hunk> hunks;
+
+    public:
+        static void Init();
+
+        // A session diffing against |blob|, which is not kept.
+        static Local<Value> NewInstance(git_blob *blob,
+                                        bool ignoreEolWhitespace);
+
+    private:
+        static NAN_METHOD(New);
+        static NAN_METHOD(SetText);
+        static NAN_METHOD(Edit);
+        static NAN_METHOD(GetLineDiffs);
+
+        static void SplitLines(const char *data, size_t length,
+                               vector<string> *lines);
+
+        uint32_t LineId(const string &line);
+        void PruneLineIds();
+        void ComputeHunks();
+};
+
+#endif  // SRC_DIFF_SESSION_H_
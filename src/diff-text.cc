@@ -0,0 +1,54 @@
+#include "./diff-text.h"
+
+DiffText::DiffText(Local<Value> value) : data(NULL), length(0) {
+    if (value->IsArrayBufferView()) {
+        // Buffer() moves the contents of a small typed array off the V8
+        // heap, where they could move, for good.
+        Local<ArrayBufferView> view = Local<ArrayBufferView>::Cast(value);
+        Local<ArrayBuffer> buffer = view->Buffer();
+        data = static_cast<const char*>(buffer->GetContents().Data()) +
+            view->ByteOffset();
+        length = view->ByteLength();
+        pinned.Reset(value);
+        return;
+    }
+
+    Local<String> string = Nan::To<String>(value).ToLocalChecked();
+    const String::ExternalOneByteStringResource *external =
+        string->GetExternalOneByteStringResource();
+    if (external != NULL && IsAscii(external->data(), external->length())) {
+        data = external->data();
+        length = external->length();
+        pinned.Reset(string);
+        return;
+    }
+
+    if (string->IsOneByte()) {
+        copy.resize(string->Length());
+        if (!copy.empty())
+            string->WriteOneByte(reinterpret_cast<uint8_t*>(&copy[0]), 0,
+                                 -1, String::NO_NULL_TERMINATION);
+        if (IsAscii(copy.data(), copy.size())) {
+            data = copy.data();
+            length = copy.size();
+            return;
+        }
+    }
+
+    String::Utf8Value utf8(string);
+    copy.assign(*utf8, utf8.length());
+    data = copy.data();
+    length = copy.size();
+    utf16Offsets = true;
+}
+
+DiffText::~DiffText() {
+    pinned.Reset();
+}
+
+bool DiffText::IsAscii(const char *data, size_t length) {
+    for (size_t i = 0; i < length; i++)
+        if (static_cast<unsigned char>(data[i]) >= 0x80)
+            return false;
+    return true;
+}
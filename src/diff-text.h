@@ -0,0 +1,44 @@
+#ifndef SRC_DIFF_TEXT_H_
+#define SRC_DIFF_TEXT_H_
+
+#include <nan.h>
+#include <string>
+
+using namespace std;  // NOLINT(build/namespaces)
+using namespace v8;  // NOLINT(build/namespaces)
+
+// The text side of a diff, read from a JS value with as little copying as
+// possible.
+//
+// A Buffer or Uint8Array is used in place. An external one-byte string of
+// ASCII, like a string node read from a file, is used in place too. Other
+// one-byte strings of ASCII are copied without transcoding, anything else
+// is transcoded to UTF-8.
+//
+// Text used in place is pinned by a persistent handle. Create and destroy
+// a DiffText on the main thread only, work on other threads may read it in
+// between. JS must not change a Buffer while it is being diffed.
+class DiffText {
+    private:
+        Nan::Persistent<Value> pinned;
+        string copy;
+        const char *data;
+        size_t length;
+        bool utf16Offsets = false;
+
+    public:
+        explicit DiffText(Local<Value> value);
+        ~DiffText();
+
+        const char* Data() const { return data; }
+        size_t Length() const { return length; }
+
+        // Whether offsets into the text have to be converted to UTF-16
+        // units for JS, true for strings that aren't plain ASCII.
+        bool NeedsUtf16Offsets() const { return utf16Offsets; }
+
+    private:
+        static bool IsAscii(const char *data, size_t length);
+};
+
+#endif  // SRC_DIFF_TEXT_H_
@@ -14,10 +14,32 @@ GitWorker::GitWorker(
     SaveToPersistent("resolver", resolver);
 }
 
+GitWorker::GitWorker(
+    Callback *progress,
+    RepositoryWork work,
+    WorkQueue *queue,
+    Local<Promise::Resolver> resolver,
+    int errClass,
+    const char* defaultError) :
+        AsyncProgressWorker(progress),
+        _progress(progress),
+        _repositoryWork(work),
+        _queue(queue),
+        _defaultErrClass(errClass),
+        _error(defaultError) {
+    SaveToPersistent("resolver", resolver);
+}
+
 void GitWorker::Execute(
     const AsyncProgressWorker::ExecutionProgress& nanProgress) {
-    Progress progress(&nanProgress);
-    _val =_work(&progress);
+    _progressState.SetNotifier(&nanProgress);
+    if (_queue)
+        _repository = _queue->AcquireHandle();
+    if (_repositoryWork)
+        _val = _repositoryWork(_repository, &_progressState);
+    else
+        _val =_work(&_progressState);
+    _progressState.SetNotifier(nullptr);
     if (!_val) {
         auto last = giterr_last();
         _error = last ? last->message: _error;
@@ -31,14 +53,45 @@ void GitWorker::HandleProgressCallback(const char *data, size_t size) {
     auto progressData = reinterpret_cast<Progress::ProgressWrapper*>(
         const_cast<char*>(data))->progress;
 
+    DeliverChunks();
+    if (!progressData->TakeUpdate() || !_progress)
+        return;
+
     Local<Value> msgArgs[] = {
         progressData->ToJsProgress(Isolate::GetCurrent())
     };
     _progress->Call(1, msgArgs);
 }
 
+void GitWorker::DeliverChunks() {
+    vector<GetResult> chunks;
+    _progressState.TakeChunks(&chunks);
+    if (!_progress)
+        return;
+
+    for (size_t i = 0; i < chunks.size(); i++) {
+        if (_progressState.IsCancelled())
+            break;
+        Local<Value> chunkArgs[] = { chunks[i]() };
+        Local<Value> result = _progress->Call(1, chunkArgs);
+        if (!result.IsEmpty() && result->IsFalse())
+            _progressState.Cancel();
+    }
+}
+
+
+void GitWorker::WorkComplete() {
+    // Hand the lane over before resolving so queued work can start while
+    // the result is marshalled.
+    if (_queue)
+        _queue->Done(this);
+    AsyncProgressWorker::WorkComplete();
+}
 
 void GitWorker::HandleOKCallback() {
+    Nan::HandleScope scope;
+    DeliverChunks();
+
     auto resolver = GetFromPersistent("resolver")
         .As<Promise::Resolver>();
     if (!_val) {;
@@ -53,6 +106,7 @@ void GitWorker::HandleOKCallback() {
 
 void GitWorker::RunAsync(
     const Nan::FunctionCallbackInfo<Value>* info,
+    Scheduler::Lane lane,
     Callback *progress,
     Work work,
     int errClass,
@@ -66,6 +120,61 @@ void GitWorker::RunAsync(
         resolver,
         errClass,
         defaultError);
-    Nan::AsyncQueueWorker(worker);
+    // Keep the receiver alive while the work is in flight, the work usually
+    // captures the native object wrapped by it.
+    worker->_lane = Scheduler::LaneFromArgs(*info, lane);
+    worker->SaveToPersistent("receiver", info->This());
+    Scheduler::Queue(worker, worker->_lane);
     info->GetReturnValue().Set(scope.Escape(resolver->GetPromise()));
 }
+
+void GitWorker::RunAsync(
+    const Nan::FunctionCallbackInfo<Value>* info,
+    WorkQueue *queue,
+    WorkQueue::Access access,
+    Scheduler::Lane lane,
+    Callback *progress,
+    RepositoryWork work,
+    int errClass,
+    const char* defaultError) {
+
+    Nan::EscapableHandleScope scope;
+    auto resolver = Promise::Resolver::New(info->GetIsolate());
+    auto worker = new GitWorker(
+        progress,
+        work,
+        queue,
+        resolver,
+        errClass,
+        defaultError);
+    worker->_lane = Scheduler::LaneFromArgs(*info, lane);
+    worker->SaveToPersistent("receiver", info->This());
+    queue->Push(worker, access);
+    info->GetReturnValue().Set(scope.Escape(resolver->GetPromise()));
+}
+
+void GitWorker::RunDetached(
+    const string &gitPath,
+    Scheduler::Lane lane,
+    RepositoryWork work) {
+
+    Nan::HandleScope scope;
+    auto resolver = Promise::Resolver::New(Isolate::GetCurrent());
+    Work ownHandleWork = [gitPath, work](Progress *progress) -> GetResult {
+        git_repository *repository = NULL;
+        if (git_repository_open_ext(&repository, gitPath.c_str(),
+                GIT_REPOSITORY_OPEN_NO_SEARCH, NULL) != GIT_OK)
+            repository = NULL;
+        GetResult result = work(repository, progress);
+        git_repository_free(repository);
+        return result;
+    };
+    auto worker = new GitWorker(
+        nullptr,
+        ownHandleWork,
+        resolver,
+        GITERR_NONE,
+        "");
+    worker->_lane = lane;
+    Scheduler::Queue(worker, lane);
+}
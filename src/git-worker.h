@@ -8,6 +8,8 @@
 #include <string>
 #include <ctime>
 #include "./common.h"
+#include "./work-queue.h"
+#include "./scheduler.h"
 
 using namespace v8;  // NOLINT(build/namespaces)
 using namespace Nan;  // NOLINT(build/namespaces)
@@ -16,6 +18,13 @@ class  GitWorker: public AsyncProgressWorker {
     private:
         Callback *_progress;
         Work _work;
+        RepositoryWork _repositoryWork;
+        WorkQueue *_queue = nullptr;
+        WorkQueue::Access _access = WorkQueue::EXCLUSIVE;
+        git_repository *_repository = nullptr;
+        Scheduler::Lane _lane = Scheduler::INTERACTIVE;
+        // Outlives Execute, progress callbacks may still read it.
+        Progress _progressState;
         int _defaultErrClass;
         const char* _error;
         GetResult _val;
@@ -28,9 +37,25 @@ class  GitWorker: public AsyncProgressWorker {
             int errClass,
             const char* defaultError);
 
+       explicit GitWorker(
+            Callback *progress,
+            RepositoryWork work,
+            WorkQueue *queue,
+            Local<Promise::Resolver> resolver,
+            int errClass,
+            const char* defaultError);
+
         ~GitWorker() {
         }
 
+        void SetAccess(WorkQueue::Access access) { _access = access; }
+        WorkQueue::Access GetAccess() { return _access; }
+        void SetRepository(git_repository *repository) {
+            _repository = repository;
+        }
+        git_repository* GetRepository() { return _repository; }
+        Scheduler::Lane GetLane() { return _lane; }
+
         void Execute(
             const AsyncProgressWorker::ExecutionProgress& nanProgress);
 
@@ -38,13 +63,45 @@ class  GitWorker: public AsyncProgressWorker {
 
         void HandleOKCallback();
 
+        void WorkComplete();
+
+    private:
+        // Pass the chunks pushed by the work to the progress callback, a
+        // callback returning false cancels the work.
+        void DeliverChunks();
 
+    public:
+        // |lane| is used unless the call ends with a `{ lane: ... }` object.
         static void RunAsync(
             const Nan::FunctionCallbackInfo<Value>* info,
+            Scheduler::Lane lane,
             Callback *progress,
             Work work,
             int errClass,
             const char* defaultError);
+
+        // Queue |work| on the repository lane |queue|, the work receives a
+        // repository handle nobody else uses while it runs.
+        static void RunAsync(
+            const Nan::FunctionCallbackInfo<Value>* info,
+            WorkQueue *queue,
+            WorkQueue::Access access,
+            Scheduler::Lane lane,
+            Callback *progress,
+            RepositoryWork work,
+            int errClass,
+            const char* defaultError);
+
+        // Run |work| for housekeeping nobody waits for, like warming caches
+        // or building indexes, outside of any WorkQueue. It gets a
+        // repository handle on |gitPath| of its own, opened and freed on the
+        // worker thread, so it never holds up the queued calls of the
+        // repository however long it runs. |work| must capture everything
+        // it uses.
+        static void RunDetached(
+            const string &gitPath,
+            Scheduler::Lane lane,
+            RepositoryWork work);
 };
 
 
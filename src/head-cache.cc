@@ -0,0 +1,172 @@
+#include "./head-cache.h"
+
+HeadCache::HeadCache(const char *gitdir) : gitdir(gitdir) {
+    uv_mutex_init(&lock);
+}
+
+HeadCache::~HeadCache() {
+    uv_mutex_destroy(&lock);
+}
+
+int HeadCache::GetTree(git_repository *repository, git_tree **tree) {
+    uv_mutex_lock(&lock);
+    int error = Refresh(repository);
+    git_oid id = treeId;
+    uv_mutex_unlock(&lock);
+
+    if (error != GIT_OK)
+        return error;
+    return git_tree_lookup(tree, repository, &id);
+}
+
+int HeadCache::GetEntry(git_repository *repository, const string &path,
+                        git_oid *id, git_filemode_t *mode) {
+    uv_mutex_lock(&lock);
+    int error = Refresh(repository);
+    if (error == GIT_OK && !entriesLoaded)
+        error = LoadEntries(repository);
+    if (error == GIT_OK) {
+        unordered_map<string, Entry>::iterator entry = entries.find(path);
+        if (entry == entries.end()) {
+            error = GIT_ENOTFOUND;
+        } else {
+            git_oid_cpy(id, &entry->second.id);
+            if (mode != NULL)
+                *mode = entry->second.mode;
+        }
+    }
+    uv_mutex_unlock(&lock);
+    return error;
+}
+
+int HeadCache::GetEntries(git_repository *repository,
+                          const vector<string> &paths,
+                          vector<git_oid> *ids,
+                          vector<git_filemode_t> *modes,
+                          vector<bool> *found) {
+    ids->resize(paths.size());
+    modes->resize(paths.size());
+    found->assign(paths.size(), false);
+
+    uv_mutex_lock(&lock);
+    int error = Refresh(repository);
+    if (error == GIT_OK && !entriesLoaded)
+        error = LoadEntries(repository);
+    for (size_t i = 0; error == GIT_OK && i < paths.size(); i++) {
+        unordered_map<string, Entry>::iterator entry = entries.find(paths[i]);
+        if (entry == entries.end())
+            continue;
+        git_oid_cpy(&(*ids)[i], &entry->second.id);
+        (*modes)[i] = entry->second.mode;
+        (*found)[i] = true;
+    }
+    uv_mutex_unlock(&lock);
+    return error;
+}
+
+void HeadCache::Warm(git_repository *repository) {
+    uv_mutex_lock(&lock);
+    if (Refresh(repository) == GIT_OK && !entriesLoaded)
+        LoadEntries(repository);
+    uv_mutex_unlock(&lock);
+}
+
+int HeadCache::Refresh(git_repository *repository) {
+    // Stat before resolving, a change racing with the resolution is then
+    // seen by the next call.
+    FileStamp current[STAMP_COUNT];
+    Stamp(current);
+
+    bool unchanged = valid;
+    for (int i = 0; unchanged && i < STAMP_COUNT; i++)
+        unchanged = current[i] == stamps[i];
+    if (unchanged)
+        return GIT_OK;
+
+    git_reference *head = NULL;
+    int error = git_repository_head(&head, repository);
+    if (error != GIT_OK) {
+        valid = false;
+        return error;
+    }
+
+    const git_oid *headId = git_reference_target(head);
+    if (!valid || git_oid_cmp(headId, &commitId) != 0) {
+        git_commit *commit = NULL;
+        error = git_commit_lookup(&commit, repository, headId);
+        if (error != GIT_OK) {
+            git_reference_free(head);
+            valid = false;
+            return error;
+        }
+
+        git_oid_cpy(&commitId, headId);
+        git_oid_cpy(&treeId, git_commit_tree_id(commit));
+        git_commit_free(commit);
+        entries.clear();
+        entriesLoaded = false;
+    }
+
+    // A commit on the checked out branch rewrites the branch ref, stat it
+    // too in case the reflog is disabled.
+    string branch = git_reference_name(head);
+    git_reference_free(head);
+    if (branch != branchPath) {
+        branchPath = branch;
+        Stamp(current);
+    }
+
+    for (int i = 0; i < STAMP_COUNT; i++)
+        stamps[i] = current[i];
+    valid = true;
+    return GIT_OK;
+}
+
+int HeadCache::LoadEntries(git_repository *repository) {
+    git_tree *tree = NULL;
+    int error = git_tree_lookup(&tree, repository, &treeId);
+    if (error != GIT_OK)
+        return error;
+
+    entries.clear();
+    error = git_tree_walk(tree, GIT_TREEWALK_PRE, TreeWalkCallback, this);
+    git_tree_free(tree);
+
+    entriesLoaded = error == GIT_OK;
+    if (!entriesLoaded)
+        entries.clear();
+    return error;
+}
+
+void HeadCache::Stamp(FileStamp *current) {
+    string paths[STAMP_COUNT] = {
+        gitdir + "HEAD",
+        gitdir + "logs/HEAD",
+        gitdir + "packed-refs",
+        branchPath.empty() ? string() : gitdir + branchPath
+    };
+
+    for (int i = 0; i < STAMP_COUNT; i++) {
+        current[i] = FileStamp();
+        if (paths[i].empty())
+            continue;
+
+        uv_fs_t request;
+        if (uv_fs_stat(NULL, &request, paths[i].c_str(), NULL) == 0) {
+            current[i].mtimeSec = request.statbuf.st_mtim.tv_sec;
+            current[i].mtimeNsec = request.statbuf.st_mtim.tv_nsec;
+            current[i].size = request.statbuf.st_size;
+        }
+        uv_fs_req_cleanup(&request);
+    }
+}
+
+int HeadCache::TreeWalkCallback(const char *root,
+                                const git_tree_entry *entry,
+                                void *payload) {
+    HeadCache *cache = static_cast<HeadCache*>(payload);
+    Entry &cached = cache->entries[string(root) + git_tree_entry_name(entry)];
+    git_oid_cpy(&cached.id, git_tree_entry_id(entry));
+    cached.mode = git_tree_entry_filemode(entry);
+    return GIT_OK;
+}
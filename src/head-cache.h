@@ -0,0 +1,85 @@
+#ifndef SRC_HEAD_CACHE_H_
+#define SRC_HEAD_CACHE_H_
+
+#include <git2.h>
+#include <uv.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;  // NOLINT(build/namespaces)
+
+// Snapshot of the tree HEAD points to, shared by every handle opened on a
+// repository.
+//
+// Resolving HEAD to its tree and walking the tree for a path is repeated by
+// every blob, diff and stats lookup. The snapshot keeps the HEAD commit and
+// tree ids and, once a path was asked for, a table of every entry of the
+// tree. Only ids are kept so the snapshot can be used from any handle.
+//
+// The snapshot is keyed by the HEAD commit id. HEAD, its reflog, the branch
+// HEAD points to and packed-refs are stat'ed on every use, HEAD is resolved
+// again only when one of them changed.
+class HeadCache {
+    private:
+        struct FileStamp {
+            int64_t mtimeSec = -1;
+            int64_t mtimeNsec = -1;
+            uint64_t size = 0;
+
+            bool operator==(const FileStamp &other) const {
+                return mtimeSec == other.mtimeSec &&
+                    mtimeNsec == other.mtimeNsec && size == other.size;
+            }
+        };
+
+        struct Entry {
+            git_oid id;
+            git_filemode_t mode;
+        };
+
+        static const int STAMP_COUNT = 4;
+
+        string gitdir;
+        uv_mutex_t lock;
+        bool valid = false;
+        string branchPath;
+        FileStamp stamps[STAMP_COUNT];
+        git_oid commitId;
+        git_oid treeId;
+        bool entriesLoaded = false;
+        unordered_map<string, Entry> entries;
+
+    public:
+        explicit HeadCache(const char *gitdir);
+        ~HeadCache();
+
+        // Look up the HEAD tree on |repository|.
+        int GetTree(git_repository *repository, git_tree **tree);
+
+        // Id and mode of |path| in the HEAD tree, GIT_ENOTFOUND when HEAD
+        // has no such path. |mode| may be NULL.
+        int GetEntry(git_repository *repository, const string &path,
+                     git_oid *id, git_filemode_t *mode);
+
+        // GetEntry for every path of |paths| under a single lock. |found|
+        // tells which paths HEAD has, a path that isn't found leaves its id
+        // and mode untouched.
+        int GetEntries(git_repository *repository, const vector<string> &paths,
+                       vector<git_oid> *ids, vector<git_filemode_t> *modes,
+                       vector<bool> *found);
+
+        // Resolve HEAD and build the entry table ahead of the first lookup.
+        void Warm(git_repository *repository);
+
+    private:
+        int Refresh(git_repository *repository);
+        int LoadEntries(git_repository *repository);
+        void Stamp(FileStamp *current);
+        static int TreeWalkCallback(const char *root,
+                                    const git_tree_entry *entry,
+                                    void *payload);
+};
+
+#endif  // SRC_HEAD_CACHE_H_
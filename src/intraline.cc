@@ -0,0 +1,243 @@
+#include "./intraline.h"
+
+#include <unordered_map>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#define INTRALINE_SSE2 1
+#endif
+
+#include "./myers.h"
+
+namespace {
+
+// Longer lines are most likely minified or generated, diffing their tokens
+// costs more than it tells.
+const size_t MAX_LINE_LENGTH = 16 * 1024;
+
+enum ByteClass {
+    PUNCTUATION,
+    WORD,
+    SPACE
+};
+
+ByteClass Classify(unsigned char c) {
+    if (c == ' ' || (c >= '\t' && c <= '\r'))
+        return SPACE;
+    if ((c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') ||
+        c == '_' || c >= 0x80)
+        return WORD;
+    return PUNCTUATION;
+}
+
+#ifdef INTRALINE_SSE2
+// Bit i is set when byte i of |block| is in [low, high].
+inline uint32_t InRange(__m128i block, char low, char high) {
+    __m128i offset = _mm_sub_epi8(block, _mm_set1_epi8(low));
+    __m128i limit = _mm_set1_epi8(static_cast<char>(high - low));
+    return _mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_min_epu8(offset, limit), offset));
+}
+
+inline uint32_t Equal(__m128i block, char value) {
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(value)));
+}
+#endif
+
+void TokenizeWords(const char *data, size_t length,
+                   vector<uint32_t> *starts) {
+    size_t i = 0;
+    ByteClass previous = PUNCTUATION;
+    bool first = true;
+
+#ifdef INTRALINE_SSE2
+    // Bit masks of the word and space bytes of each block, a token starts
+    // where the class changes and at every punctuation byte.
+    uint32_t previousWord = 0, previousSpace = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(data + i));
+        uint32_t space = Equal(block, ' ') | InRange(block, '\t', '\r');
+        __m128i lower = _mm_or_si128(block, _mm_set1_epi8(0x20));
+        uint32_t word = InRange(block, '0', '9') | InRange(lower, 'a', 'z') |
+            Equal(block, '_') | _mm_movemask_epi8(block);
+        uint32_t punctuation = ~(word | space) & 0xffff;
+
+        uint32_t wordStarts = word & ~((word << 1) | previousWord);
+        uint32_t spaceStarts = space & ~((space << 1) | previousSpace);
+        uint32_t tokenStarts = (wordStarts | spaceStarts | punctuation) &
+            0xffff;
+        if (first) {
+            tokenStarts |= 1;
+            first = false;
+        }
+        while (tokenStarts != 0) {
+            int bit = __builtin_ctz(tokenStarts);
+            starts->push_back(static_cast<uint32_t>(i + bit));
+            tokenStarts &= tokenStarts - 1;
+        }
+
+        previousWord = (word >> 15) & 1;
+        previousSpace = (space >> 15) & 1;
+    }
+    if (i > 0)
+        previous = previousWord ? WORD : (previousSpace ? SPACE : PUNCTUATION);
+#endif
+
+    for (; i < length; i++) {
+        ByteClass current = Classify(static_cast<unsigned char>(data[i]));
+        if (first || current != previous || current == PUNCTUATION)
+            starts->push_back(static_cast<uint32_t>(i));
+        previous = current;
+        first = false;
+    }
+}
+
+void TokenizeCharacters(const char *data, size_t length,
+                        vector<uint32_t> *starts) {
+    size_t i = 0;
+
+#ifdef INTRALINE_SSE2
+    // Every byte but UTF-8 continuation bytes starts a character.
+    const __m128i high = _mm_set1_epi8(static_cast<char>(0xc0));
+    const __m128i continuation = _mm_set1_epi8(static_cast<char>(0x80));
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(data + i));
+        uint32_t tokenStarts = ~_mm_movemask_epi8(_mm_cmpeq_epi8(
+            _mm_and_si128(block, high), continuation)) & 0xffff;
+        while (tokenStarts != 0) {
+            int bit = __builtin_ctz(tokenStarts);
+            starts->push_back(static_cast<uint32_t>(i + bit));
+            tokenStarts &= tokenStarts - 1;
+        }
+    }
+#endif
+
+    for (; i < length; i++)
+        if ((static_cast<unsigned char>(data[i]) & 0xc0) != 0x80)
+            starts->push_back(static_cast<uint32_t>(i));
+}
+
+uint64_t HashToken(const char *data, size_t length) {
+    // 64-bit FNV-1a.
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Give the tokens of |line| ids shared through |ids|. Tokens with the same
+// hash are taken to be equal, a collision only makes a range look unchanged.
+void TokenIds(const IntralineLine &line, const vector<uint32_t> &starts,
+              unordered_map<uint64_t, uint32_t> *ids,
+              vector<uint32_t> *tokens) {
+    tokens->resize(starts.size());
+    for (size_t i = 0; i < starts.size(); i++) {
+        size_t end = i + 1 < starts.size() ? starts[i + 1] : line.length;
+        uint64_t hash = HashToken(line.content + starts[i], end - starts[i]);
+        (*tokens)[i] = ids->emplace(hash, ids->size()).first->second;
+    }
+}
+
+// Merge the changed tokens of a line into byte ranges.
+void ToRanges(const IntralineLine &line, const vector<uint32_t> &starts,
+              const vector<bool> &changed, vector<IntralineRange> *ranges) {
+    for (size_t i = 0; i < starts.size(); i++) {
+        if (!changed[i])
+            continue;
+        size_t end = i + 1 < starts.size() ? starts[i + 1] : line.length;
+        if (!ranges->empty() &&
+            ranges->back().start + ranges->back().length == starts[i]) {
+            ranges->back().length += static_cast<uint32_t>(end - starts[i]);
+        } else {
+            IntralineRange range = {
+                starts[i], static_cast<uint32_t>(end - starts[i])
+            };
+            ranges->push_back(range);
+        }
+    }
+}
+
+}  // namespace
+
+void TokenizeLine(const char *data, size_t length, IntralineMode mode,
+                  vector<uint32_t> *starts) {
+    if (mode == INTRALINE_CHAR)
+        TokenizeCharacters(data, length, starts);
+    else
+        TokenizeWords(data, length, starts);
+}
+
+void DiffIntraline(const vector<IntralineLine> &lines, IntralineMode mode,
+                   vector<vector<IntralineRange>> *ranges) {
+    ranges->assign(lines.size(), vector<IntralineRange>());
+    if (mode == INTRALINE_NONE)
+        return;
+
+    vector<size_t> removed, added;
+    vector<uint32_t> oldStarts, newStarts, oldTokens, newTokens;
+    vector<bool> oldChanged, newChanged;
+    unordered_map<uint64_t, uint32_t> ids;
+
+    size_t i = 0;
+    while (i < lines.size()) {
+        removed.clear();
+        added.clear();
+        int hunk = lines[i].hunk;
+        for (; i < lines.size() && lines[i].hunk == hunk; i++)
+            (lines[i].added ? added : removed).push_back(i);
+
+        size_t pairs = removed.size() < added.size() ?
+            removed.size() : added.size();
+        for (size_t pair = 0; pair < pairs; pair++) {
+            const IntralineLine &oldLine = lines[removed[pair]];
+            const IntralineLine &newLine = lines[added[pair]];
+            if (oldLine.length > MAX_LINE_LENGTH ||
+                newLine.length > MAX_LINE_LENGTH)
+                continue;
+
+            oldStarts.clear();
+            newStarts.clear();
+            TokenizeLine(oldLine.content, oldLine.length, mode, &oldStarts);
+            TokenizeLine(newLine.content, newLine.length, mode, &newStarts);
+
+            ids.clear();
+            TokenIds(oldLine, oldStarts, &ids, &oldTokens);
+            TokenIds(newLine, newStarts, &ids, &newTokens);
+            MyersDiff(oldTokens.data(), oldTokens.size(), newTokens.data(),
+                      newTokens.size(), &oldChanged, &newChanged);
+
+            ToRanges(oldLine, oldStarts, oldChanged,
+                     &(*ranges)[removed[pair]]);
+            ToRanges(newLine, newStarts, newChanged,
+                     &(*ranges)[added[pair]]);
+        }
+    }
+}
+
+void ToUtf16Ranges(const char *line, size_t length,
+                   vector<IntralineRange> *ranges) {
+    size_t byte = 0, unit = 0;
+    for (size_t i = 0; i < ranges->size(); i++) {
+        IntralineRange &range = (*ranges)[i];
+        size_t end = range.start + range.length;
+        uint32_t start = 0;
+        for (; byte <= end && byte < length; byte++) {
+            if (byte == range.start)
+                start = static_cast<uint32_t>(unit);
+            if (byte == end)
+                break;
+            unsigned char c = static_cast<unsigned char>(line[byte]);
+            // A unit per character, two for characters outside the BMP.
+            if ((c & 0xc0) != 0x80)
+                unit += c >= 0xf0 ? 2 : 1;
+        }
+        if (range.start >= length)
+            start = static_cast<uint32_t>(unit);
+        range.length = static_cast<uint32_t>(unit) - start;
+        range.start = start;
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef SRC_INTRALINE_H_
+#define SRC_INTRALINE_H_
+
+#include <stdint.h>
+#include <vector>
+
+using namespace std;  // NOLINT(build/namespaces)
+
+enum IntralineMode {
+    INTRALINE_NONE,
+    // Runs of letters, digits, underscores and non-ASCII characters, runs
+    // of whitespace and single punctuation characters.
+    INTRALINE_WORD,
+    // Single UTF-8 characters.
+    INTRALINE_CHAR
+};
+
+struct IntralineRange {
+    uint32_t start;
+    uint32_t length;
+};
+
+// A removed or added line of a hunk, |content| without its newline.
+struct IntralineLine {
+    int hunk;
+    bool added;
+    const char *content;
+    size_t length;
+};
+
+// Split |data| into the tokens of |mode|, appending the offset each token
+// starts at to |starts|. Classifies 16 bytes at a time with SSE2 where
+// available.
+void TokenizeLine(const char *data, size_t length, IntralineMode mode,
+                  vector<uint32_t> *starts);
+
+// Pair the n-th removed line of every hunk of |lines| with its n-th added
+// line, in the order the lines are given, and diff their tokens.
+// |ranges|[i] gets the byte ranges of |lines|[i] that changed. Lines
+// without a partner, and pairs of very long lines, get no ranges.
+void DiffIntraline(const vector<IntralineLine> &lines, IntralineMode mode,
+                   vector<vector<IntralineRange>> *ranges);
+
+// Turn byte |ranges| into the line into UTF-16 units.
+void ToUtf16Ranges(const char *line, size_t length,
+                   vector<IntralineRange> *ranges);
+
+#endif  // SRC_INTRALINE_H_
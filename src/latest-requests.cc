@@ -0,0 +1,51 @@
+#include "./latest-requests.h"
+
+LatestRequests::LatestRequests() {
+    uv_mutex_init(&lock);
+}
+
+LatestRequests::~LatestRequests() {
+    uv_mutex_destroy(&lock);
+}
+
+uint64_t LatestRequests::Take(const string &key) {
+    uv_mutex_lock(&lock);
+    uint64_t ticket = nextTicket++;
+    latest[key] = ticket;
+    requested++;
+    uv_mutex_unlock(&lock);
+    return ticket;
+}
+
+bool LatestRequests::IsLatest(const string &key, uint64_t ticket) {
+    uv_mutex_lock(&lock);
+    unordered_map<string, uint64_t>::iterator found = latest.find(key);
+    bool isLatest = found != latest.end() && found->second == ticket;
+    uv_mutex_unlock(&lock);
+    return isLatest;
+}
+
+void LatestRequests::Drop() {
+    uv_mutex_lock(&lock);
+    dropped++;
+    uv_mutex_unlock(&lock);
+}
+
+void LatestRequests::Cancel() {
+    uv_mutex_lock(&lock);
+    cancelled++;
+    uv_mutex_unlock(&lock);
+}
+
+void LatestRequests::Complete() {
+    uv_mutex_lock(&lock);
+    completed++;
+    uv_mutex_unlock(&lock);
+}
+
+LatestRequests::Stats LatestRequests::GetStats() {
+    uv_mutex_lock(&lock);
+    Stats stats = { requested, dropped, cancelled, completed };
+    uv_mutex_unlock(&lock);
+    return stats;
+}
@@ -0,0 +1,58 @@
+#ifndef SRC_LATEST_REQUESTS_H_
+#define SRC_LATEST_REQUESTS_H_
+
+#include <uv.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+
+using namespace std;  // NOLINT(build/namespaces)
+
+// Latest-wins bookkeeping for requests that only matter for their newest
+// instance, like diffing an editor buffer that keeps changing.
+//
+// Every request takes a ticket for its key, which supersedes the tickets
+// taken before it. Work holding a superseded ticket is dropped when it
+// starts and stops early at its next check when it already runs. Safe to
+// use from any thread.
+class LatestRequests {
+    private:
+        uv_mutex_t lock;
+        // One entry per key ever requested, a finished request can't tell
+        // whether an older one is still running.
+        unordered_map<string, uint64_t> latest;
+        uint64_t nextTicket = 1;
+
+        uint64_t requested = 0;
+        uint64_t dropped = 0;
+        uint64_t cancelled = 0;
+        uint64_t completed = 0;
+
+    public:
+        struct Stats {
+            uint64_t requested;
+            uint64_t dropped;
+            uint64_t cancelled;
+            uint64_t completed;
+        };
+
+        LatestRequests();
+        ~LatestRequests();
+
+        // A ticket superseding every earlier ticket for |key|.
+        uint64_t Take(const string &key);
+
+        bool IsLatest(const string &key, uint64_t ticket);
+
+        // Record that a superseded request was skipped before doing any
+        // work, or given up part way.
+        void Drop();
+        void Cancel();
+
+        // Record that a request ran to the end.
+        void Complete();
+
+        Stats GetStats();
+};
+
+#endif  // SRC_LATEST_REQUESTS_H_
@@ -0,0 +1,157 @@
+#include <limits.h>
+#include "./myers.h"
+
+namespace {
+
+const int UNREACHED = INT_MIN / 2;
+
+class Myers {
+    private:
+        const uint32_t *a;
+        const uint32_t *b;
+        vector<bool> *removed;
+        vector<bool> *added;
+
+        // Furthest reaching x on each diagonal, forward and from the end.
+        vector<int> forward;
+        vector<int> backward;
+        int offset;
+
+    public:
+        Myers(const uint32_t *a, int aLength, const uint32_t *b, int bLength,
+              vector<bool> *removed, vector<bool> *added)
+            : a(a), b(b), removed(removed), added(added),
+              forward(2 * (aLength + bLength) + 3),
+              backward(2 * (aLength + bLength) + 3),
+              offset(aLength + bLength + 1) {
+        }
+
+        void Compare(int aBegin, int aEnd, int bBegin, int bEnd) {
+            while (aBegin < aEnd && bBegin < bEnd && a[aBegin] == b[bBegin]) {
+                aBegin++;
+                bBegin++;
+            }
+            while (aBegin < aEnd && bBegin < bEnd &&
+                   a[aEnd - 1] == b[bEnd - 1]) {
+                aEnd--;
+                bEnd--;
+            }
+
+            if (aBegin == aEnd || bBegin == bEnd) {
+                for (int i = aBegin; i < aEnd; i++)
+                    (*removed)[i] = true;
+                for (int j = bBegin; j < bEnd; j++)
+                    (*added)[j] = true;
+                return;
+            }
+
+            int x, y;
+            MiddleSnake(aBegin, aEnd, bBegin, bEnd, &x, &y);
+            if ((x == aBegin && y == bBegin) || (x == aEnd && y == bEnd)) {
+                // Can't happen once both ends are trimmed, but never recurse
+                // on the same range.
+                for (int i = aBegin; i < aEnd; i++)
+                    (*removed)[i] = true;
+                for (int j = bBegin; j < bEnd; j++)
+                    (*added)[j] = true;
+                return;
+            }
+            Compare(aBegin, x, bBegin, y);
+            Compare(x, aEnd, y, bEnd);
+        }
+
+    private:
+        // Extend the path on diagonal |k| of |v| by one edit and then along
+        // its snake. |at(x, y)| compares the lines at that point.
+        template <typename Equal>
+        int Extend(vector<int> *v, int k, int n, int m, const Equal &equal) {
+            int right = (*v)[offset + k - 1];
+            if (right != UNREACHED)
+                right++;
+            if (right > n)
+                right = UNREACHED;
+            int down = (*v)[offset + k + 1];
+            if (down != UNREACHED && down - k > m)
+                down = UNREACHED;
+
+            int x = right > down ? right : down;
+            if (x != UNREACHED) {
+                while (x < n && x - k < m && equal(x, x - k))
+                    x++;
+            }
+            (*v)[offset + k] = x;
+            return x;
+        }
+
+        void MiddleSnake(int aBegin, int aEnd, int bBegin, int bEnd,
+                         int *splitX, int *splitY) {
+            int n = aEnd - aBegin;
+            int m = bEnd - bBegin;
+            int delta = n - m;
+            bool odd = (delta & 1) != 0;
+            int maxD = (n + m + 1) / 2;
+
+            for (int k = -maxD - 1; k <= maxD + 1; k++) {
+                forward[offset + k] = UNREACHED;
+                backward[offset + k] = UNREACHED;
+            }
+            forward[offset + 1] = 0;
+            backward[offset + 1] = 0;
+
+            const uint32_t *aFirst = a + aBegin;
+            const uint32_t *bFirst = b + bBegin;
+            const uint32_t *aLast = a + aEnd - 1;
+            const uint32_t *bLast = b + bEnd - 1;
+            auto forwardEqual = [aFirst, bFirst](int x, int y) {
+                return aFirst[x] == bFirst[y];
+            };
+            auto backwardEqual = [aLast, bLast](int x, int y) {
+                return aLast[-x] == bLast[-y];
+            };
+
+            for (int d = 0; d <= maxD; d++) {
+                for (int k = -d; k <= d; k += 2) {
+                    int x = Extend(&forward, k, n, m, forwardEqual);
+                    if (x == UNREACHED || !odd ||
+                        k < delta - (d - 1) || k > delta + (d - 1))
+                        continue;
+                    int reverse = backward[offset + delta - k];
+                    if (reverse != UNREACHED && x + reverse >= n) {
+                        *splitX = aBegin + x;
+                        *splitY = bBegin + x - k;
+                        return;
+                    }
+                }
+
+                for (int k = -d; k <= d; k += 2) {
+                    int x = Extend(&backward, k, n, m, backwardEqual);
+                    if (x == UNREACHED || odd ||
+                        k < delta - d || k > delta + d)
+                        continue;
+                    int straight = forward[offset + delta - k];
+                    if (straight != UNREACHED && x + straight >= n) {
+                        *splitX = aEnd - x;
+                        *splitY = bEnd - (x - k);
+                        return;
+                    }
+                }
+            }
+
+            *splitX = aBegin;
+            *splitY = bBegin;
+        }
+};
+
+}  // namespace
+
+void MyersDiff(const uint32_t *a, size_t aLength,
+               const uint32_t *b, size_t bLength,
+               vector<bool> *removed, vector<bool> *added) {
+    removed->assign(aLength, false);
+    added->assign(bLength, false);
+
+    int n = static_cast<int>(aLength);
+    int m = static_cast<int>(bLength);
+    Myers myers(a, n, b, m, removed, added);
+    myers.Compare(0, n, 0, m);
+}
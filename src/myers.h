@@ -0,0 +1,19 @@
+#ifndef SRC_MYERS_H_
+#define SRC_MYERS_H_
+
+#include <stdint.h>
+#include <vector>
+
+using namespace std;  // NOLINT(build/namespaces)
+
+// Compute a shortest edit script between the line ids |a| and |b| with the
+// linear space variant of Myers' algorithm, the one xdiff uses.
+//
+// Marks the lines of |a| that are not part of the longest common
+// subsequence in |removed| and those of |b| in |added|, both are resized to
+// the length of their side.
+void MyersDiff(const uint32_t *a, size_t aLength,
+               const uint32_t *b, size_t bLength,
+               vector<bool> *removed, vector<bool> *added);
+
+#endif  // SRC_MYERS_H_
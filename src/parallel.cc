@@ -0,0 +1,76 @@
+#include <atomic>
+#include <vector>
+#include "./parallel.h"
+
+namespace {
+
+struct ParallelState {
+    const function<void(size_t, size_t)> *body;
+    size_t count;
+    atomic<size_t> next;
+};
+
+struct ThreadState {
+    ParallelState *state;
+    size_t thread;
+};
+
+void RunTasks(ParallelState *state, size_t thread) {
+    for (;;) {
+        size_t index = state->next++;
+        if (index >= state->count)
+            break;
+        (*state->body)(index, thread);
+    }
+}
+
+void ThreadMain(void *data) {
+    ThreadState *thread = static_cast<ThreadState*>(data);
+    RunTasks(thread->state, thread->thread);
+}
+
+}  // namespace
+
+size_t ParallelThreadCount(size_t requested, size_t tasks) {
+    size_t threads = requested;
+    if (threads == 0) {
+        uv_cpu_info_t *cpus;
+        int count = 0;
+        if (uv_cpu_info(&cpus, &count) == 0) {
+            uv_free_cpu_info(cpus, count);
+            threads = count;
+        }
+        if (threads == 0)
+            threads = 1;
+    }
+
+    return threads < tasks ? threads : (tasks > 0 ? tasks : 1);
+}
+
+void ParallelFor(size_t count, size_t threads,
+                 const function<void(size_t index, size_t thread)> &body) {
+    ParallelState state;
+    state.body = &body;
+    state.count = count;
+    state.next = 0;
+
+    if (threads < 2) {
+        RunTasks(&state, 0);
+        return;
+    }
+
+    vector<uv_thread_t> handles(threads - 1);
+    vector<ThreadState> threadStates(threads - 1);
+    size_t started = 0;
+    for (; started < handles.size(); started++) {
+        threadStates[started] = { &state, started + 1 };
+        if (uv_thread_create(&handles[started], ThreadMain,
+                             &threadStates[started]) != 0)
+            break;
+    }
+
+    RunTasks(&state, 0);
+
+    for (size_t i = 0; i < started; i++)
+        uv_thread_join(&handles[i]);
+}
@@ -0,0 +1,20 @@
+#ifndef SRC_PARALLEL_H_
+#define SRC_PARALLEL_H_
+
+#include <uv.h>
+#include <functional>
+
+using namespace std;  // NOLINT(build/namespaces)
+
+// Number of threads to use for |tasks| tasks when |requested| threads were
+// asked for, 0 meaning one per core. Never more threads than tasks.
+size_t ParallelThreadCount(size_t requested, size_t tasks);
+
+// Runs |body| for every index in [0, count) on |threads| threads and waits
+// for all of them. Indexes are handed out one at a time so uneven tasks
+// balance out. |thread| is in [0, threads) and identifies the thread running
+// the task, thread 0 being the calling thread.
+void ParallelFor(size_t count, size_t threads,
+                 const function<void(size_t index, size_t thread)> &body);
+
+#endif  // SRC_PARALLEL_H_
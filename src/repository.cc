@@ -19,13 +19,25 @@
 // OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
 // WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <algorithm>
+#include <limits>
 #include <utility>
 #include <map>
+#include <set>
 #include <vector>
 
 #include "./repository.h"
 #include "./git-worker.h"
+#include "./blob-stream.h"
+#include "./diff-session.h"
+#include "./diff-text.h"
+#include "./intraline.h"
+#include "./parallel.h"
+#include "./tree-diff.h"
+#include "./untracked-cache.h"
 
 
 Nan::Persistent<v8::Function> Repository::constructor;
@@ -65,6 +77,9 @@ void Repository::Init(Local<Object> exports) {
   Nan::SetMethod(proto, "getHeadBlob", Repository::GetHeadBlob);
   Nan::SetMethod(proto, "getCommitCount", Repository::GetCommitCount);
   Nan::SetMethod(proto, "getMergeBase", Repository::GetMergeBase);
+  Nan::SetMethod(proto, "getUpstreamBranch", Repository::GetUpstreamBranch);
+  Nan::SetMethod(proto, "getAheadBehindCount",
+                        Repository::GetAheadBehindCount);
   Nan::SetMethod(proto, "_release", Repository::Release);
   Nan::SetMethod(proto, "getLineDiffs", Repository::GetLineDiffs);
   Nan::SetMethod(proto, "getLineDiffDetails", Repository::GetLineDiffDetails);
@@ -73,12 +88,64 @@ void Repository::Init(Local<Object> exports) {
   Nan::SetMethod(proto, "checkoutReference", Repository::CheckoutReference);
   Nan::SetMethod(proto, "add", Repository::Add);
   Nan::SetMethod(proto, "commit", Repository::Commit);
+  Nan::SetMethod(proto, "watch", Repository::Watch);
+  Nan::SetMethod(proto, "unwatch", Repository::Unwatch);
+
+  Nan::SetMethod(proto, "getStatusAsync", Repository::GetStatusAsync);
+  Nan::SetMethod(proto, "getStatusForPathsAsync",
+                        Repository::GetStatusForPathsAsync);
+  Nan::SetMethod(proto, "checkoutHeadAsync", Repository::CheckoutHeadAsync);
+  Nan::SetMethod(proto, "getDiffStatsAsync", Repository::GetDiffStatsAsync);
+  Nan::SetMethod(proto, "getIndexBlobAsync", Repository::GetIndexBlobAsync);
+  Nan::SetMethod(proto, "getHeadBlobAsync", Repository::GetHeadBlobAsync);
+  Nan::SetMethod(proto, "getCommitCountAsync",
+                        Repository::GetCommitCountAsync);
+  Nan::SetMethod(proto, "getMergeBaseAsync", Repository::GetMergeBaseAsync);
+  Nan::SetMethod(proto, "getAheadBehindCounts",
+                        Repository::GetAheadBehindCounts);
+  Nan::SetMethod(proto, "getPathHistory", Repository::GetPathHistory);
+  Nan::SetMethod(proto, "getLog", Repository::GetLog);
+  Nan::SetMethod(proto, "getCommits", Repository::GetCommits);
+  Nan::SetMethod(proto, "getCommitCacheStats",
+                        Repository::GetCommitCacheStats);
+  Nan::SetMethod(proto, "getLineDiffsAsync", Repository::GetLineDiffsAsync);
+  Nan::SetMethod(proto, "getLineDiffDetailsAsync",
+                        Repository::GetLineDiffDetailsAsync);
+  Nan::SetMethod(proto, "getLineDiffStats", Repository::GetLineDiffStats);
+  Nan::SetMethod(proto, "checkoutReferenceAsync",
+                        Repository::CheckoutReferenceAsync);
+  Nan::SetMethod(proto, "addAsync", Repository::AddAsync);
+  Nan::SetMethod(proto, "commitAsync", Repository::CommitAsync);
+  Nan::SetMethod(proto, "getSubmodulePathsAsync",
+                        Repository::GetSubmodulePathsAsync);
+  Nan::SetMethod(proto, "getHeadAsync", Repository::GetHeadAsync);
+  Nan::SetMethod(proto, "refreshIndexAsync", Repository::RefreshIndexAsync);
+  Nan::SetMethod(proto, "isIgnoredAsync", Repository::IsIgnoredAsync);
+  Nan::SetMethod(proto, "isSubmoduleAsync", Repository::IsSubmoduleAsync);
+  Nan::SetMethod(proto, "getConfigValueAsync",
+                        Repository::GetConfigValueAsync);
+  Nan::SetMethod(proto, "setConfigValueAsync",
+                        Repository::SetConfigValueAsync);
+  Nan::SetMethod(proto, "getReferenceTargetAsync",
+                        Repository::GetReferenceTargetAsync);
+  Nan::SetMethod(proto, "getReferencesAsync", Repository::GetReferencesAsync);
+  Nan::SetMethod(proto, "getStatusStream", Repository::GetStatusStream);
+  Nan::SetMethod(proto, "getStatusSummary", Repository::GetStatusSummary);
+  Nan::SetMethod(proto, "getHeadBlobs", Repository::GetHeadBlobs);
+  Nan::SetMethod(proto, "getIndexBlobs", Repository::GetIndexBlobs);
+  Nan::SetMethod(proto, "getHeadBlobStream", Repository::GetHeadBlobStream);
+  Nan::SetMethod(proto, "getTreeDiffStream", Repository::GetTreeDiffStream);
+  Nan::SetMethod(proto, "getIndexBlobStream", Repository::GetIndexBlobStream);
+  Nan::SetMethod(proto, "createDiffSession", Repository::CreateDiffSession);
 
   exports->Set(Nan::New<String>("open").ToLocalChecked(),
     Nan::New<FunctionTemplate>(Repository::Open)->GetFunction());
   exports->Set(Nan::New<String>("clone").ToLocalChecked(),
     Nan::New<FunctionTemplate>(Repository::Clone)->GetFunction());
+  exports->Set(Nan::New<String>("getSchedulerStats").ToLocalChecked(),
+    Nan::New<FunctionTemplate>(Scheduler::GetStats)->GetFunction());
   constructor.Reset(newTemplate->GetFunction());
+  DiffSession::Init();
 }
 
 NODE_MODULE(git, Repository::Init);
@@ -89,6 +156,28 @@ v8::Local<v8::Value> ToRepository(git_repository* res) {
   auto obj = Nan::ObjectWrap::Unwrap<Repository>(instance);
 
   obj->repository = res;
+  obj->queue.SetPath(git_repository_path(res));
+  obj->headCache = std::make_shared<HeadCache>(git_repository_path(res));
+  obj->commitGraph =
+    std::make_shared<CommitGraph>(git_repository_path(res));
+  obj->changedPaths =
+    std::make_shared<ChangedPaths>(git_repository_path(res));
+  obj->logWalks = std::make_shared<LogWalks>();
+  obj->commitCache = CommitCache::ForPath(git_repository_path(res));
+
+  // Warm the HEAD snapshot while the caller is still setting up. Off the
+  // repository's queue, the first queued call shouldn't wait for a
+  // background thread to be free.
+  std::shared_ptr<HeadCache> headCache = obj->headCache;
+  GitWorker::RunDetached(
+    git_repository_path(res),
+    Scheduler::BACKGROUND,
+    [headCache](git_repository* repository, Progress* progress)
+        -> GetResult {
+      if (repository != NULL && !git_repository_is_bare(repository))
+        headCache->Warm(repository);
+      return FFL([]() { return Nan::Undefined(); });
+    });
 
   return instance;
 }
@@ -155,12 +244,16 @@ v8::Local<v8::Value> ToReferences(git_strarray* strarray) {
 }
 template<typename... Args>
 GetResult Repository::RunOnRemote(
+  git_repository *repository,
   RemoteAction<Args...> action,
   const git_remote_callbacks *callbacks,
   git_direction direction,
   Args ...params) {
   git_remote *remote;
 
+  if (repository == NULL)
+    return nullptr;
+
   if (git_remote_lookup(&remote, repository, "origin") != GIT_OK)
     return false;
 
@@ -278,6 +371,7 @@ NAN_METHOD(Repository::Open) {
 
   GitWorker::RunAsync(
     &info,
+    Scheduler::INTERACTIVE,
     nullptr,
     res,
     GITERR_REPOSITORY,
@@ -304,23 +398,66 @@ NAN_METHOD(Repository::Clone) {
 
   GitWorker::RunAsync(
     &info,
+    Scheduler::BACKGROUND,
     callback,
     res,
     GITERR_REPOSITORY,
     "Could not clone repository");
 }
 
+// Bring the commit graph up to date with the refs, and the changed-path
+// filters too once they were built or when |buildFilters| is set.
+void UpdateHistoryIndexes(git_repository* repository,
+                          CommitGraph* commitGraph,
+                          ChangedPaths* changedPaths, bool buildFilters) {
+  if (commitGraph->Build(repository) != GIT_OK)
+    return;
+  if (!buildFilters && !changedPaths->IsBuilt())
+    return;
+
+  std::vector<git_oid> ids;
+  commitGraph->Commits(&ids);
+  changedPaths->Update(repository, ids, 0);
+}
+
 NAN_METHOD(Repository::Fetch) {
   auto repo = GetRepository(info);
   std::string path(*String::Utf8Value(info[1]));
-
-  Work res =
-    [repo](Progress* progress) {
-      return repo->RunOnRemote(GitFetch, nullptr, GIT_DIRECTION_FETCH);
+  std::string gitPath(git_repository_path(repo->repository));
+  std::shared_ptr<CommitGraph> commitGraph = repo->commitGraph;
+  std::shared_ptr<ChangedPaths> changedPaths = repo->changedPaths;
+
+  RepositoryWork res =
+    [gitPath, commitGraph, changedPaths](git_repository* repository,
+                                         Progress* progress) -> GetResult {
+      GetResult fetched =
+        RunOnRemote(repository, GitFetch, nullptr, GIT_DIRECTION_FETCH);
+      if (!fetched)
+        return fetched;
+
+      // Index the fetched commits in the background once the fetch is
+      // done, so the next history query doesn't have to. The update runs
+      // off the queue, queued calls don't wait for it.
+      return FFL([fetched, gitPath, commitGraph, changedPaths]() {
+        GitWorker::RunDetached(
+          gitPath,
+          Scheduler::BACKGROUND,
+          [commitGraph, changedPaths](git_repository* repository,
+                                      Progress* progress) -> GetResult {
+            if (repository != NULL)
+              UpdateHistoryIndexes(repository, commitGraph.get(),
+                                   changedPaths.get(), false);
+            return FFL([]() { return Nan::Undefined(); });
+          });
+        return fetched();
+      });
     };
 
   GitWorker::RunAsync(
     &info,
+    &repo->queue,
+    WorkQueue::EXCLUSIVE,
+    Scheduler::BACKGROUND,
     nullptr,
     res,
     GITERR_REPOSITORY,
@@ -342,9 +479,10 @@ NAN_METHOD(Repository::Push) {
   git_remote_callbacks callbacks = GIT_REMOTE_CALLBACKS_INIT;
   callbacks.credentials = OnCredentials;
   callbacks.payload = payload;
-  Work res =
-    [repo, branch, callbacks, payload](Progress* progress) {
-      auto res = repo->RunOnRemote(GitPush, &callbacks,
+  RepositoryWork res =
+    [branch, callbacks, payload](
+        git_repository* repository, Progress* progress) {
+      auto res = RunOnRemote(repository, GitPush, &callbacks,
         GIT_DIRECTION_PUSH, &branch, &callbacks);
       delete payload;
       return res;
@@ -352,6 +490,9 @@ NAN_METHOD(Repository::Push) {
 
   GitWorker::RunAsync(
     &info,
+    &repo->queue,
+    WorkQueue::EXCLUSIVE,
+    Scheduler::BACKGROUND,
     nullptr,
     res,
     GITERR_REPOSITORY,
@@ -372,18 +513,27 @@ git_repository* Repository::GetGitRepository(Nan::NAN_METHOD_ARGS_TYPE args) {
   return Nan::ObjectWrap::Unwrap<Repository>(args.This())->repository;
 }
 
+bool GetBoolOption(Local<Value> options, const char* name) {
+  if (!options->IsObject())
+    return false;
+
+  return Local<Object>::Cast(options)->Get(
+      Nan::New<String>(name).ToLocalChecked())->BooleanValue();
+}
+
 int Repository::GetBlob(Nan::NAN_METHOD_ARGS_TYPE args,
                         git_repository* repo, git_blob*& blob) {
   std::string path(*String::Utf8Value(args[0]));
 
-  int useIndex = false;
-  if (args.Length() >= 3) {
-    Local<Object> optionsArg(Local<Object>::Cast(args[2]));
-    if (optionsArg->Get(
-        Nan::New<String>("useIndex").ToLocalChecked())->BooleanValue())
-      useIndex = true;
-  }
+  bool useIndex = args.Length() >= 3 && GetBoolOption(args[2], "useIndex");
+  return LookupBlob(repo, path, useIndex, blob,
+                    GetRepository(args)->headCache.get());
+}
 
+int Repository::LookupBlob(git_repository* repo, const std::string& path,
+                           bool useIndex, git_blob*& blob,
+                           HeadCache* headCache) {
+  blob = NULL;
   if (useIndex) {
     git_index* index;
     if (git_repository_index(&index, repo) != GIT_OK)
@@ -399,6 +549,13 @@ int Repository::GetBlob(Nan::NAN_METHOD_ARGS_TYPE args,
     const git_oid* blobSha = &entry->id;
     if (blobSha != NULL && git_blob_lookup(&blob, repo, blobSha) != GIT_OK)
       blob = NULL;
+    git_index_free(index);
+  } else if (headCache != NULL) {
+    git_oid blobSha;
+    if (headCache->GetEntry(repo, path, &blobSha, NULL) != GIT_OK)
+      return -1;
+    if (git_blob_lookup(&blob, repo, &blobSha) != GIT_OK)
+      blob = NULL;
   } else {
     git_reference* head;
     if (git_repository_head(&head, repo) != GIT_OK)
@@ -471,18 +628,15 @@ NAN_METHOD(Repository::GetSubmodulePaths) {
   git_repository* repository = GetGitRepository(info);
   std::vector<std::string> paths;
   git_submodule_foreach(repository, SubmoduleCallback, &paths);
-  Local<Object> v8Paths = Nan::New<Array>(paths.size());
-  for (size_t i = 0; i < paths.size(); i++)
-    v8Paths->Set(i, Nan::New<String>(paths[i].data()).ToLocalChecked());
-  info.GetReturnValue().Set(v8Paths);
+  info.GetReturnValue().Set(ConvertStringVectorToV8Array(paths));
 }
 
-NAN_METHOD(Repository::GetHead) {
-  Nan::HandleScope scope;
-  git_repository* repository = GetGitRepository(info);
+// The SHA of a detached HEAD, the name of the reference it points to
+// otherwise.
+int ReadHead(git_repository* repository, std::string* name) {
   git_reference* head;
   if (git_repository_head(&head, repository) != GIT_OK)
-    return info.GetReturnValue().Set(Nan::Null());
+    return -1;
 
   if (git_repository_head_detached(repository) == 1) {
     const git_oid* sha = git_reference_target(head);
@@ -490,42 +644,64 @@ NAN_METHOD(Repository::GetHead) {
       char oid[GIT_OID_HEXSZ + 1];
       git_oid_tostr(oid, GIT_OID_HEXSZ + 1, sha);
       git_reference_free(head);
-      return info.GetReturnValue().Set(Nan::New<String>(oid, -1)
-                                        .ToLocalChecked());
+      *name = oid;
+      return GIT_OK;
     }
   }
 
-  Local<String> referenceName = Nan::New<String>(git_reference_name(head))
-                                    .ToLocalChecked();
+  *name = git_reference_name(head);
   git_reference_free(head);
-  return info.GetReturnValue().Set(referenceName);
+  return GIT_OK;
 }
 
-NAN_METHOD(Repository::RefreshIndex) {
+NAN_METHOD(Repository::GetHead) {
   Nan::HandleScope scope;
-  git_repository* repository = GetGitRepository(info);
+  std::string head;
+  if (ReadHead(GetGitRepository(info), &head) != GIT_OK)
+    return info.GetReturnValue().Set(Nan::Null());
+  return info.GetReturnValue().Set(Nan::New<String>(head).ToLocalChecked());
+}
+
+void ReloadIndex(git_repository* repository) {
   git_index* index;
   if (git_repository_index(&index, repository) == GIT_OK) {
     git_index_read(index, 0);
     git_index_free(index);
   }
+}
+
+NAN_METHOD(Repository::RefreshIndex) {
+  Nan::HandleScope scope;
+  ReloadIndex(GetGitRepository(info));
   info.GetReturnValue().SetUndefined();
 }
 
+bool IsPathIgnored(git_repository* repository, const std::string& path) {
+  int ignored;
+  return git_ignore_path_is_ignored(&ignored, repository, path.c_str()) ==
+    GIT_OK && ignored == 1;
+}
+
 NAN_METHOD(Repository::IsIgnored) {
   Nan::HandleScope scope;
   if (info.Length() < 1)
     return info.GetReturnValue().Set(Nan::New<Boolean>(false));
 
-  git_repository* repository = GetGitRepository(info);
   std::string path(*String::Utf8Value(info[0]));
-  int ignored;
-  if (git_ignore_path_is_ignored(&ignored,
-                                 repository,
-                                 path.c_str()) == GIT_OK)
-    return info.GetReturnValue().Set(Nan::New<Boolean>(ignored == 1));
-  else
-    return info.GetReturnValue().Set(Nan::New<Boolean>(false));
+  return info.GetReturnValue().Set(
+      Nan::New<Boolean>(IsPathIgnored(GetGitRepository(info), path)));
+}
+
+bool IsSubmodulePath(git_repository* repository, const std::string& path) {
+  git_index* index;
+  if (git_repository_index(&index, repository) != GIT_OK)
+    return false;
+
+  const git_index_entry* entry = git_index_get_bypath(index, path.c_str(), 0);
+  bool isSubmodule =
+      entry != NULL && (entry->mode & S_IFMT) == GIT_FILEMODE_COMMIT;
+  git_index_free(index);
+  return isSubmodule;
 }
 
 NAN_METHOD(Repository::IsSubmodule) {
@@ -533,18 +709,23 @@ NAN_METHOD(Repository::IsSubmodule) {
   if (info.Length() < 1)
     return info.GetReturnValue().Set(Nan::New<Boolean>(false));
 
-  git_index* index;
-  git_repository* repository = GetGitRepository(info);
-  if (git_repository_index(&index, repository) == GIT_OK) {
-    std::string path(*String::Utf8Value(info[0]));
-    const git_index_entry* entry = git_index_get_bypath(index, path.c_str(), 0);
-    Local<Boolean> isSubmodule = Nan::New<Boolean>(
-        entry != NULL && (entry->mode & S_IFMT) == GIT_FILEMODE_COMMIT);
-    git_index_free(index);
-    return info.GetReturnValue().Set(isSubmodule);
-  } else {
-    return info.GetReturnValue().Set(Nan::New<Boolean>(false));
-  }
+  std::string path(*String::Utf8Value(info[0]));
+  return info.GetReturnValue().Set(
+      Nan::New<Boolean>(IsSubmodulePath(GetGitRepository(info), path)));
+}
+
+int ReadConfigValue(git_repository* repository, const std::string& key,
+                    std::string* value) {
+  git_config* config;
+  if (git_repository_config_snapshot(&config, repository) != GIT_OK)
+    return -1;
+
+  const char* configValue;
+  int error = git_config_get_string(&configValue, config, key.c_str());
+  if (error == GIT_OK)
+    *value = configValue;
+  git_config_free(config);
+  return error;
 }
 
 NAN_METHOD(Repository::GetConfigValue) {
@@ -552,22 +733,24 @@ NAN_METHOD(Repository::GetConfigValue) {
   if (info.Length() < 1)
     return info.GetReturnValue().Set(Nan::Null());
 
-  git_config* config;
-  git_repository* repository = GetGitRepository(info);
-  if (git_repository_config_snapshot(&config, repository) != GIT_OK)
-    return info.GetReturnValue().Set(Nan::Null());
-
   std::string configKey(*String::Utf8Value(info[0]));
-  const char* configValue;
-  if (git_config_get_string(
-        &configValue, config, configKey.c_str()) == GIT_OK) {
-    git_config_free(config);
-    return info.GetReturnValue().Set(Nan::New<String>(configValue)
-                                      .ToLocalChecked());
-  } else {
-    git_config_free(config);
+  std::string configValue;
+  if (ReadConfigValue(
+        GetGitRepository(info), configKey, &configValue) != GIT_OK)
     return info.GetReturnValue().Set(Nan::Null());
-  }
+  return info.GetReturnValue().Set(Nan::New<String>(configValue)
+                                    .ToLocalChecked());
+}
+
+int WriteConfigValue(git_repository* repository, const std::string& key,
+                     const std::string& value) {
+  git_config* config;
+  if (git_repository_config(&config, repository) != GIT_OK)
+    return -1;
+
+  int error = git_config_set_string(config, key.c_str(), value.c_str());
+  git_config_free(config);
+  return error;
 }
 
 NAN_METHOD(Repository::SetConfigValue) {
@@ -575,738 +758,3835 @@ NAN_METHOD(Repository::SetConfigValue) {
   if (info.Length() != 2)
     return info.GetReturnValue().Set(Nan::New<Boolean>(false));
 
-  git_config* config;
-  git_repository* repository = GetGitRepository(info);
-  if (git_repository_config(&config, repository) != GIT_OK)
-    return info.GetReturnValue().Set(Nan::New<Boolean>(false));
-
   std::string configKey(*String::Utf8Value(info[0]));
   std::string configValue(*String::Utf8Value(info[1]));
 
-  int errorCode = git_config_set_string(
-      config, configKey.c_str(), configValue.c_str());
-  git_config_free(config);
+  int errorCode = WriteConfigValue(
+      GetGitRepository(info), configKey, configValue);
   return info.GetReturnValue().Set(Nan::New<Boolean>(errorCode == GIT_OK));
 }
 
-
-NAN_METHOD(Repository::GetStatus) {
-  Nan::HandleScope scope;
-  if (info.Length() < 1) {
-    Local<Object> result = Nan::New<Object>();
-    std::map<std::string, unsigned int> statuses;
-    git_status_options options = GIT_STATUS_OPTIONS_INIT;
-    options.flags = GIT_STATUS_OPT_INCLUDE_UNTRACKED |
-                    GIT_STATUS_OPT_RECURSE_UNTRACKED_DIRS;
-    if (git_status_foreach_ext(GetGitRepository(info),
-                               &options,
-                               StatusCallback,
-                               &statuses) == GIT_OK) {
-      std::map<std::string, unsigned int>::iterator iter = statuses.begin();
-      for (; iter != statuses.end(); ++iter)
-        result->Set(Nan::New<String>(iter->first.c_str()).ToLocalChecked(),
-                    Nan::New<Number>(iter->second));
-    }
-    return info.GetReturnValue().Set(result);
-  } else {
-    git_repository* repository = GetGitRepository(info);
-    std::string path(*String::Utf8Value(info[0]));
-    unsigned int status = 0;
-    if (git_status_file(&status, repository, path.c_str()) == GIT_OK)
-      return info.GetReturnValue().Set(Nan::New<Number>(status));
-    else
-      return info.GetReturnValue().Set(Nan::New<Number>(0));
-  }
-}
-
-NAN_METHOD(Repository::GetStatusForPaths) {
-  Nan::HandleScope scope;
-
+Local<Value> ToStatusObject(
+    const std::map<std::string, unsigned int>& statuses) {
   Local<Object> result = Nan::New<Object>();
-  if (info.Length() < 1)
-    return info.GetReturnValue().Set(result);
+  std::map<std::string, unsigned int>::const_iterator iter = statuses.begin();
+  for (; iter != statuses.end(); ++iter)
+    result->Set(Nan::New<String>(iter->first.c_str()).ToLocalChecked(),
+                Nan::New<Number>(iter->second));
+  return result;
+}
 
-  std::map<std::string, unsigned int> statuses;
-  git_status_options options = GIT_STATUS_OPTIONS_INIT;
-  options.flags = GIT_STATUS_OPT_INCLUDE_UNTRACKED |
-                  GIT_STATUS_OPT_RECURSE_UNTRACKED_DIRS |
-                  GIT_STATUS_OPT_DISABLE_PATHSPEC_MATCH;
-
-  Array *pathsArg = Array::Cast(*info[0]);
-  unsigned int pathsLength = pathsArg->Length();
-  if (pathsLength < 1)
-    return info.GetReturnValue().Set(result);
-
-  char *path = NULL;
-  char **paths = reinterpret_cast<char **>(malloc(pathsLength * sizeof(path)));
-  for (unsigned int i = 0; i < pathsLength; i++) {
-    String::Utf8Value utf8Path(pathsArg->Get(i));
-    path = strdup(*utf8Path);
-    paths[i] = path;
-  }
-
-  git_strarray pathsArray;
-  pathsArray.count = pathsLength;
-  pathsArray.strings = paths;
-  options.pathspec = pathsArray;
-
-  if (git_status_foreach_ext(GetGitRepository(info),
-                             &options,
-                             StatusCallback,
-                             &statuses) == GIT_OK) {
-    std::map<std::string, unsigned int>::iterator iter = statuses.begin();
-    for (; iter != statuses.end(); ++iter)
-      result->Set(Nan::New<String>(iter->first.c_str()).ToLocalChecked(),
-                  Nan::New<Number>(iter->second));
-  }
+// Statuses as one buffer of concatenated paths, the offset of every path in
+// it followed by the total length, and the flags of every path.
+struct PackedStatus {
+  std::string paths;
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> flags;
+};
 
-  if (paths != NULL) {
-    git_strarray_free(&pathsArray);
-  }
+int PackedStatusCallback(const char* path, unsigned int status,
+                         void* payload) {
+  PackedStatus* packed = static_cast<PackedStatus*>(payload);
+  packed->offsets.push_back(packed->paths.size());
+  packed->paths.append(path);
+  packed->flags.push_back(status);
+  return GIT_OK;
+}
 
-  return info.GetReturnValue().Set(result);
+void PackStatuses(const StatusMap& statuses, PackedStatus* packed) {
+  StatusMap::const_iterator iter = statuses.begin();
+  for (; iter != statuses.end(); ++iter)
+    PackedStatusCallback(iter->first.c_str(), iter->second, packed);
 }
 
-NAN_METHOD(Repository::CheckoutHead) {
-  Nan::HandleScope scope;
-  if (info.Length() < 1)
-    return info.GetReturnValue().Set(Nan::New<Boolean>(false));
+Local<Value> ToUint32Array(const std::vector<uint32_t>& values) {
+  size_t length = values.size() * sizeof(uint32_t);
+  Local<ArrayBuffer> buffer = ArrayBuffer::New(Isolate::GetCurrent(), length);
+  if (length > 0)
+    memcpy(buffer->GetContents().Data(), values.data(), length);
+  return Uint32Array::New(buffer, 0, values.size());
+}
 
-  String::Utf8Value utf8Path(info[0]);
-  char* path = *utf8Path;
+Local<Value> ToInt32Array(const std::vector<int32_t>& values) {
+  size_t length = values.size() * sizeof(int32_t);
+  Local<ArrayBuffer> buffer = ArrayBuffer::New(Isolate::GetCurrent(), length);
+  if (length > 0)
+    memcpy(buffer->GetContents().Data(), values.data(), length);
+  return Int32Array::New(buffer, 0, values.size());
+}
 
-  git_checkout_options options = GIT_CHECKOUT_OPTIONS_INIT;
-  options.checkout_strategy = GIT_CHECKOUT_FORCE |
-                              GIT_CHECKOUT_DISABLE_PATHSPEC_MATCH;
-  git_strarray paths;
-  paths.count = 1;
-  paths.strings = &path;
-  options.paths = paths;
+Local<Value> ToPackedStatus(const PackedStatus& packed) {
+  std::vector<uint32_t> offsets(packed.offsets);
+  offsets.push_back(packed.paths.size());
 
-  int result = git_checkout_head(GetGitRepository(info), &options);
-  return info.GetReturnValue().Set(Nan::New<Boolean>(result == GIT_OK));
+  Local<Object> result = Nan::New<Object>();
+  result->Set(Nan::New<String>("paths").ToLocalChecked(),
+              Nan::CopyBuffer(packed.paths.data(), packed.paths.size())
+                .ToLocalChecked());
+  result->Set(Nan::New<String>("offsets").ToLocalChecked(),
+              ToUint32Array(offsets));
+  result->Set(Nan::New<String>("flags").ToLocalChecked(),
+              ToUint32Array(packed.flags));
+  return result;
 }
 
-NAN_METHOD(Repository::GetReferenceTarget) {
-  Nan::HandleScope scope;
-  if (info.Length() < 1)
-    return info.GetReturnValue().Set(Nan::Null());
-
-  std::string refName(*String::Utf8Value(info[0]));
-  git_oid sha;
-  if (git_reference_name_to_id(
-        &sha, GetGitRepository(info), refName.c_str()) == GIT_OK) {
-    char oid[GIT_OID_HEXSZ + 1];
-    git_oid_tostr(oid, GIT_OID_HEXSZ + 1, &sha);
-    return info.GetReturnValue().Set(Nan::New<String>(oid, -1)
-                                  .ToLocalChecked());
-  } else {
-    return info.GetReturnValue().Set(Nan::Null());
+Local<Value> ToStatusObject(const PackedStatus& packed) {
+  Local<Object> result = Nan::New<Object>();
+  for (size_t i = 0; i < packed.flags.size(); i++) {
+    size_t end = i + 1 < packed.offsets.size() ?
+        packed.offsets[i + 1] : packed.paths.size();
+    result->Set(Nan::New<String>(packed.paths.data() + packed.offsets[i],
+                                 end - packed.offsets[i]).ToLocalChecked(),
+                Nan::New<Number>(packed.flags[i]));
   }
+  return result;
 }
 
-NAN_METHOD(Repository::GetDiffStats) {
-  Nan::HandleScope scope;
+bool IsPackedFormat(Local<Value> options) {
+  if (!options->IsObject())
+    return false;
 
-  int added = 0;
-  int deleted = 0;
+  Local<Value> format = Local<Object>::Cast(options)->Get(
+      Nan::New<String>("format").ToLocalChecked());
+  return format->IsString() &&
+    strcmp(*String::Utf8Value(format), "packed") == 0;
+}
+
+Local<Value> ToDiffStats(int added, int deleted) {
   Local<Object> result = Nan::New<Object>();
   result->Set(Nan::New<String>("added").ToLocalChecked(),
                 Nan::New<Number>(added));
   result->Set(Nan::New<String>("deleted").ToLocalChecked(),
                 Nan::New<Number>(deleted));
+  return result;
+}
 
-  if (info.Length() < 1)
-    return info.GetReturnValue().Set(result);
-
-  git_repository* repository = GetGitRepository(info);
-  git_reference* head;
-  if (git_repository_head(&head, repository) != GIT_OK)
-    return info.GetReturnValue().Set(result);
+void FreeBlobBuffer(char* data, void* blob) {
+  git_blob_free(static_cast<git_blob*>(blob));
+}
 
-  const git_oid* sha = git_reference_target(head);
-  git_commit* commit;
-  int commitStatus = git_commit_lookup(&commit, repository, sha);
-  git_reference_free(head);
-  if (commitStatus != GIT_OK)
-    return info.GetReturnValue().Set(result);
+// Contents of |blob| as a string, or as a Buffer over the blob's own memory
+// that keeps the blob alive until the Buffer is collected.
+Local<Value> ToBlobContent(git_blob* blob, bool asBuffer = false) {
+  char* content = static_cast<char*>(
+      const_cast<void*>(git_blob_rawcontent(blob)));
+  size_t size = static_cast<size_t>(git_blob_rawsize(blob));
+  if (asBuffer)
+    return Nan::NewBuffer(content, size, FreeBlobBuffer, blob)
+      .ToLocalChecked();
+
+  Local<Value> value = Nan::New<String>(content, size).ToLocalChecked();
+  git_blob_free(blob);
+  return value;
+}
 
-  git_tree* tree;
-  int treeStatus = git_commit_tree(&tree, commit);
-  git_commit_free(commit);
-  if (treeStatus != GIT_OK)
-    return info.GetReturnValue().Set(result);
+struct UntrackedDirectoriesPayload {
+  git_status_cb callback;
+  void* payload;
+  std::vector<std::string> directories;
+};
 
-  String::Utf8Value utf8Path(info[0]);
-  char* path = *utf8Path;
+// Set aside the untracked directories reported by a non-recursive scan.
+int UntrackedDirectoriesCallback(
+    const char* path, unsigned int status, void* data) {
+  UntrackedDirectoriesPayload* untracked =
+      static_cast<UntrackedDirectoriesPayload*>(data);
+  size_t length = strlen(path);
+  if (status == GIT_STATUS_WT_NEW && length > 0 && path[length - 1] == '/') {
+    untracked->directories.push_back(path);
+    return GIT_OK;
+  }
+  return untracked->callback(path, status, untracked->payload);
+}
 
-  git_diff_options options = CreateDefaultGitDiffOptions();
-  git_strarray paths;
-  paths.count = 1;
-  paths.strings = &path;
-  options.pathspec = paths;
-  options.context_lines = 0;
-  options.flags = GIT_DIFF_DISABLE_PATHSPEC_MATCH;
+bool MatchesPathspec(const std::string& path,
+                     const std::vector<std::string>& paths) {
+  for (size_t i = 0; i < paths.size(); i++) {
+    const std::string& prefix = paths[i];
+    if (path.compare(0, prefix.size(), prefix) == 0 &&
+        (path.size() == prefix.size() || path[prefix.size()] == '/' ||
+         prefix[prefix.size() - 1] == '/'))
+      return true;
+  }
+  return false;
+}
 
-  git_diff* diffs;
-  int diffStatus = git_diff_tree_to_workdir(&diffs, repository, tree, &options);
-  git_tree_free(tree);
-  if (diffStatus != GIT_OK)
-    return info.GetReturnValue().Set(result);
+int CollectStatuses(git_repository* repository,
+                    const std::vector<std::string>* paths,
+                    git_status_cb callback,
+                    void* payload,
+                    UntrackedCache* untrackedCache = NULL) {
+  git_status_options options = GIT_STATUS_OPTIONS_INIT;
+  options.flags = GIT_STATUS_OPT_INCLUDE_UNTRACKED;
+  if (untrackedCache == NULL)
+    options.flags |= GIT_STATUS_OPT_RECURSE_UNTRACKED_DIRS;
 
-  int deltas = git_diff_num_deltas(diffs);
-  if (deltas != 1) {
-    git_diff_free(diffs);
-    return info.GetReturnValue().Set(result);
+  std::vector<char*> pathspec;
+  if (paths != NULL) {
+    options.flags |= GIT_STATUS_OPT_DISABLE_PATHSPEC_MATCH;
+    for (size_t i = 0; i < paths->size(); i++)
+      pathspec.push_back(const_cast<char*>(paths->at(i).c_str()));
+    options.pathspec.count = pathspec.size();
+    options.pathspec.strings = pathspec.data();
   }
 
-  git_patch* patch;
-  int patchStatus = git_patch_from_diff(&patch, diffs, 0);
-  git_diff_free(diffs);
-  if (patchStatus != GIT_OK)
-    return info.GetReturnValue().Set(result);
+  if (untrackedCache == NULL)
+    return git_status_foreach_ext(repository, &options, callback, payload);
+
+  // Without recursion libgit2 reports untracked directories as a single
+  // "dir/" entry, the cache expands them into their files.
+  UntrackedDirectoriesPayload untracked = { callback, payload };
+  int error = git_status_foreach_ext(
+      repository, &options, UntrackedDirectoriesCallback, &untracked);
+  if (error != GIT_OK)
+    return error;
+
+  for (size_t i = 0; i < untracked.directories.size(); i++) {
+    std::vector<std::string> files;
+    untrackedCache->ListUntracked(
+        repository, untracked.directories[i], &files);
+    for (size_t j = 0; j < files.size(); j++) {
+      if (paths != NULL && !MatchesPathspec(files[j], *paths))
+        continue;
+      error = callback(files[j].c_str(), GIT_STATUS_WT_NEW, payload);
+      if (error != GIT_OK)
+        return error;
+    }
+  }
+  return GIT_OK;
+}
 
-  int hunks = git_patch_num_hunks(patch);
-  for (int i = 0; i < hunks; i++) {
-    int lines = git_patch_num_lines_in_hunk(patch, i);
-    for (int j = 0; j < lines; j++) {
-      const git_diff_line* line;
-      if (git_patch_get_line_in_hunk(&line, patch, i, j) == GIT_OK) {
-        switch (line->origin) {
-          case GIT_DIFF_LINE_ADDITION:
-            added++;
-            break;
-          case GIT_DIFF_LINE_DELETION:
-            deleted++;
-            break;
-        }
+// Split the working directory into status scans that cover disjoint paths:
+// one per top-level directory and one for all top-level files. Names are
+// taken from the working directory, the index and HEAD so deleted paths are
+// covered too.
+std::vector<std::vector<std::string>> PartitionWorkingDirectory(
+    git_repository* repository) {
+  std::set<std::string> names, directories;
+
+  uv_fs_t scandir;
+  if (uv_fs_scandir(NULL, &scandir, git_repository_workdir(repository), 0,
+                    NULL) >= 0) {
+    uv_dirent_t entry;
+    while (uv_fs_scandir_next(&scandir, &entry) != UV_EOF) {
+      if (strcmp(entry.name, ".git") == 0)
+        continue;
+      names.insert(entry.name);
+      if (entry.type == UV_DIRENT_DIR)
+        directories.insert(entry.name);
+    }
+  }
+  uv_fs_req_cleanup(&scandir);
+
+  git_index* index = NULL;
+  if (git_repository_index(&index, repository) == GIT_OK &&
+      git_index_read(index, 0) == GIT_OK) {
+    size_t count = git_index_entrycount(index);
+    for (size_t i = 0; i < count; i++) {
+      const char* path = git_index_get_byindex(index, i)->path;
+      const char* separator = strchr(path, '/');
+      if (separator == NULL) {
+        names.insert(path);
+      } else {
+        std::string directory(path, separator - path);
+        names.insert(directory);
+        directories.insert(directory);
       }
     }
   }
-  git_patch_free(patch);
-
-  result->Set(Nan::New<String>("added").ToLocalChecked(),
-                Nan::New<Number>(added));
-  result->Set(Nan::New<String>("deleted").ToLocalChecked(),
-                Nan::New<Number>(deleted));
+  git_index_free(index);
 
-  return info.GetReturnValue().Set(result);
+  git_object* tree = NULL;
+  if (git_revparse_single(&tree, repository, "HEAD^{tree}") == GIT_OK) {
+    size_t count = git_tree_entrycount(reinterpret_cast<git_tree*>(tree));
+    for (size_t i = 0; i < count; i++) {
+      const git_tree_entry* entry =
+          git_tree_entry_byindex(reinterpret_cast<git_tree*>(tree), i);
+      names.insert(git_tree_entry_name(entry));
+      if (git_tree_entry_type(entry) == GIT_OBJ_TREE)
+        directories.insert(git_tree_entry_name(entry));
+    }
+  }
+  git_object_free(tree);
+
+  std::vector<std::vector<std::string>> partitions;
+  std::vector<std::string> files;
+  for (std::set<std::string>::iterator name = names.begin();
+       name != names.end(); ++name) {
+    if (directories.count(*name) > 0)
+      partitions.push_back(std::vector<std::string>(1, *name));
+    else
+      files.push_back(*name);
+  }
+  if (!files.empty())
+    partitions.push_back(files);
+  return partitions;
 }
 
-NAN_METHOD(Repository::GetHeadBlob) {
-  Nan::HandleScope scope;
-  if (info.Length() < 1)
-    return info.GetReturnValue().Set(Nan::Null());
+size_t GetParallelOption(Local<Value> options) {
+  if (!options->IsObject())
+    return 1;
 
-  std::string path(*String::Utf8Value(info[0]));
+  Local<Value> parallel = Local<Object>::Cast(options)->Get(
+      Nan::New<String>("parallel").ToLocalChecked());
+  if (parallel->IsNumber() && parallel->NumberValue() >= 1)
+    return static_cast<size_t>(parallel->NumberValue());
+  return parallel->BooleanValue() ? 0 : 1;
+}
 
-  git_repository* repo = GetGitRepository(info);
-  git_reference* head;
-  if (git_repository_head(&head, repo) != GIT_OK)
-    return info.GetReturnValue().Set(Nan::Null());
+// -1 when |options| has no untrackedCache key, core.untrackedCache decides.
+int GetUntrackedCacheOption(Local<Value> options) {
+  if (!options->IsObject())
+    return -1;
 
-  const git_oid* sha = git_reference_target(head);
-  git_commit* commit;
-  int commitStatus = git_commit_lookup(&commit, repo, sha);
-  git_reference_free(head);
-  if (commitStatus != GIT_OK)
-    return info.GetReturnValue().Set(Nan::Null());
+  Local<Value> untrackedCache = Local<Object>::Cast(options)->Get(
+      Nan::New<String>("untrackedCache").ToLocalChecked());
+  if (untrackedCache->IsUndefined())
+    return -1;
+  return untrackedCache->BooleanValue() ? 1 : 0;
+}
 
-  git_tree* tree;
-  int treeStatus = git_commit_tree(&tree, commit);
-  git_commit_free(commit);
-  if (treeStatus != GIT_OK)
-    return info.GetReturnValue().Set(Nan::Null());
+// Scan straight into |packed|, without building a map first.
+int ScanStatusPacked(git_repository* repository,
+                     const std::vector<std::string>* paths,
+                     int untrackedCache, PackedStatus* packed) {
+  std::unique_ptr<UntrackedCache> cache(
+      UntrackedCache::Open(repository, untrackedCache));
+  int error = CollectStatuses(repository, paths, PackedStatusCallback, packed,
+                              cache.get());
+  if (cache && error == GIT_OK)
+    cache->Save(paths == NULL);
+  return error;
+}
 
-  git_tree_entry* treeEntry;
-  if (git_tree_entry_bypath(&treeEntry, tree, path.c_str()) != GIT_OK) {
-    git_tree_free(tree);
-    return info.GetReturnValue().Set(Nan::Null());
+// Cuts the statuses of a scan into chunks handed to the progress channel.
+struct StatusStream {
+  Progress* progress;
+  size_t chunkSize;
+  bool packed;
+  std::shared_ptr<PackedStatus> chunk;
+  double total;
+
+  bool Flush() {
+    if (chunk->flags.empty())
+      return true;
+
+    std::shared_ptr<PackedStatus> statuses = chunk;
+    bool asPacked = packed;
+    chunk.reset(new PackedStatus());
+    return progress->PushChunk(FFL([statuses, asPacked]() {
+      return asPacked ? ToPackedStatus(*statuses) : ToStatusObject(*statuses);
+    }));
   }
+};
 
-  git_blob* blob = NULL;
-  const git_oid* blobSha = git_tree_entry_id(treeEntry);
-  if (blobSha != NULL && git_blob_lookup(&blob, repo, blobSha) != GIT_OK)
-    blob = NULL;
-  git_tree_entry_free(treeEntry);
-  git_tree_free(tree);
-  if (blob == NULL)
-    return info.GetReturnValue().Set(Nan::Null());
-
-  const char* content = static_cast<const char*>(git_blob_rawcontent(blob));
-  Local<Value> value = Nan::New<String>(content).ToLocalChecked();
-  git_blob_free(blob);
-  return info.GetReturnValue().Set(value);
+int StatusStreamCallback(const char* path, unsigned int status,
+                         void* payload) {
+  StatusStream* stream = static_cast<StatusStream*>(payload);
+  PackedStatusCallback(path, status, stream->chunk.get());
+  stream->total++;
+  if (stream->chunk->flags.size() >= stream->chunkSize && !stream->Flush())
+    return GIT_EUSER;
+  return GIT_OK;
 }
 
-NAN_METHOD(Repository::GetIndexBlob) {
-  Nan::HandleScope scope;
-  if (info.Length() < 1)
-    return info.GetReturnValue().Set(Nan::Null());
+size_t GetChunkSizeOption(Local<Value> options) {
+  if (!options->IsObject())
+    return 1000;
 
-  std::string path(*String::Utf8Value(info[0]));
+  Local<Value> chunkSize = Local<Object>::Cast(options)->Get(
+      Nan::New<String>("chunkSize").ToLocalChecked());
+  if (chunkSize->IsNumber() && chunkSize->NumberValue() >= 1)
+    return static_cast<size_t>(chunkSize->NumberValue());
+  return 1000;
+}
 
-  git_repository* repo = GetGitRepository(info);
-  git_index* index;
-  if (git_repository_index(&index, repo) != GIT_OK)
-    return info.GetReturnValue().Set(Nan::Null());
+struct StatusSummary {
+  bool dirtyOnly;
+  bool dirty;
+  double added;
+  double modified;
+  double deleted;
+  double staged;
+  double conflicted;
+};
 
-  git_index_read(index, 0);
-  const git_index_entry* entry = git_index_get_bypath(index, path.data(), 0);
-  if (entry == NULL) {
+int StatusSummaryCallback(const char* path, unsigned int status,
+                          void* payload) {
+  StatusSummary* summary = static_cast<StatusSummary*>(payload);
+  summary->dirty = true;
+  if (summary->dirtyOnly)
+    return GIT_EUSER;
+
+  if (status & GIT_STATUS_WT_NEW)
+    summary->added++;
+  if (status & (GIT_STATUS_WT_MODIFIED | GIT_STATUS_WT_TYPECHANGE))
+    summary->modified++;
+  if (status & GIT_STATUS_WT_DELETED)
+    summary->deleted++;
+  if (status & (GIT_STATUS_INDEX_NEW | GIT_STATUS_INDEX_MODIFIED |
+                GIT_STATUS_INDEX_DELETED | GIT_STATUS_INDEX_RENAMED |
+                GIT_STATUS_INDEX_TYPECHANGE))
+    summary->staged++;
+  return GIT_OK;
+}
+
+// Number of paths with merge conflicts in the index.
+int CountConflicts(git_repository* repository, double* conflicted) {
+  git_index* index = NULL;
+  int error = git_repository_index(&index, repository);
+  if (error == GIT_OK)
+    error = git_index_read(index, 0);
+  if (error != GIT_OK || !git_index_has_conflicts(index)) {
     git_index_free(index);
-    return info.GetReturnValue().Set(Nan::Null());
+    return error;
   }
 
-  git_blob* blob = NULL;
-  const git_oid* blobSha = &entry->id;
-  if (blobSha != NULL && git_blob_lookup(&blob, repo, blobSha) != GIT_OK)
-    blob = NULL;
+  git_index_conflict_iterator* iterator = NULL;
+  error = git_index_conflict_iterator_new(&iterator, index);
+  if (error == GIT_OK) {
+    const git_index_entry *ancestor, *ours, *theirs;
+    while (git_index_conflict_next(&ancestor, &ours, &theirs, iterator)
+           == GIT_OK)
+      (*conflicted)++;
+  }
+  git_index_conflict_iterator_free(iterator);
   git_index_free(index);
-  if (blob == NULL)
-    return info.GetReturnValue().Set(Nan::Null());
+  return error;
+}
 
-  const char* content = static_cast<const char*>(git_blob_rawcontent(blob));
-  Local<Value> value = Nan::New<String>(content).ToLocalChecked();
-  git_blob_free(blob);
-  return info.GetReturnValue().Set(value);
+Local<Value> ToStatusSummary(const StatusSummary& summary) {
+  Local<Object> result = Nan::New<Object>();
+  result->Set(Nan::New<String>("dirty").ToLocalChecked(),
+              Nan::New<Boolean>(summary.dirty));
+  if (summary.dirtyOnly)
+    return result;
+
+  result->Set(Nan::New<String>("new").ToLocalChecked(),
+              Nan::New<Number>(summary.added));
+  result->Set(Nan::New<String>("modified").ToLocalChecked(),
+              Nan::New<Number>(summary.modified));
+  result->Set(Nan::New<String>("deleted").ToLocalChecked(),
+              Nan::New<Number>(summary.deleted));
+  result->Set(Nan::New<String>("staged").ToLocalChecked(),
+              Nan::New<Number>(summary.staged));
+  result->Set(Nan::New<String>("conflicted").ToLocalChecked(),
+              Nan::New<Number>(summary.conflicted));
+  return result;
 }
 
-int Repository::StatusCallback(
-    const char* path, unsigned int status, void* payload) {
-  std::map<std::string, unsigned int>* statuses =
-      static_cast<std::map<std::string, unsigned int>*>(payload);
-  statuses->insert(std::make_pair(std::string(path), status));
-  return GIT_OK;
+// Contents of many blobs packed one after the other, |offsets| has the start
+// of every blob followed by the total size.
+struct BlobBatch {
+  char* data;
+  size_t size;
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> missing;
+};
+
+bool IsBlobMode(git_filemode_t mode) {
+  return mode == GIT_FILEMODE_BLOB || mode == GIT_FILEMODE_BLOB_EXECUTABLE ||
+    mode == GIT_FILEMODE_LINK;
 }
 
-int Repository::SubmoduleCallback(
-    git_submodule* submodule, const char* name, void* payload) {
-  std::vector<std::string>* submodules =
-      static_cast<std::vector<std::string>*>(payload);
-  const char* submodulePath = git_submodule_path(submodule);
-  if (submodulePath != NULL)
-    submodules->push_back(submodulePath);
-  return GIT_OK;
+// Find the blob ids of |paths| in the index or in HEAD.
+int FindBlobIds(git_repository* repository,
+                const std::vector<std::string>& paths, bool useIndex,
+                HeadCache* headCache, std::vector<git_oid>* ids,
+                std::vector<bool>* found) {
+  ids->resize(paths.size());
+  found->assign(paths.size(), false);
+
+  if (useIndex) {
+    git_index* index = NULL;
+    int error = git_repository_index(&index, repository);
+    if (error == GIT_OK)
+      error = git_index_read(index, 0);
+    for (size_t i = 0; error == GIT_OK && i < paths.size(); i++) {
+      const git_index_entry* entry =
+          git_index_get_bypath(index, paths[i].c_str(), 0);
+      if (entry == NULL || !IsBlobMode(git_filemode_t(entry->mode)))
+        continue;
+      git_oid_cpy(&(*ids)[i], &entry->id);
+      (*found)[i] = true;
+    }
+    git_index_free(index);
+    return error;
+  }
+
+  if (headCache != NULL) {
+    std::vector<git_filemode_t> modes;
+    int error = headCache->GetEntries(repository, paths, ids, &modes, found);
+    for (size_t i = 0; error == GIT_OK && i < paths.size(); i++)
+      (*found)[i] = (*found)[i] && IsBlobMode(modes[i]);
+    return error;
+  }
+
+  git_object* tree = NULL;
+  int error = git_revparse_single(&tree, repository, "HEAD^{tree}");
+  for (size_t i = 0; error == GIT_OK && i < paths.size(); i++) {
+    git_tree_entry* entry = NULL;
+    if (git_tree_entry_bypath(&entry, reinterpret_cast<git_tree*>(tree),
+                              paths[i].c_str()) != GIT_OK)
+      continue;
+    if (IsBlobMode(git_tree_entry_filemode(entry))) {
+      git_oid_cpy(&(*ids)[i], git_tree_entry_id(entry));
+      (*found)[i] = true;
+    }
+    git_tree_entry_free(entry);
+  }
+  git_object_free(tree);
+  return error;
 }
 
-NAN_METHOD(Repository::Release) {
-  Nan::HandleScope scope;
-  Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(info.This());
-  if (repo->repository != NULL) {
-    git_repository_free(repo->repository);
-    repo->repository = NULL;
+// Read the blobs of |paths| on up to |threads| threads into |batch|. Paths
+// that don't name a blob are listed in |batch->missing|.
+int ReadBlobs(git_repository* repository,
+              const std::vector<std::string>& paths, bool useIndex,
+              HeadCache* headCache, size_t threads, BlobBatch* batch) {
+  std::vector<git_oid> ids;
+  std::vector<bool> found;
+  int error = FindBlobIds(repository, paths, useIndex, headCache, &ids,
+                          &found);
+  if (error != GIT_OK)
+    return error;
+
+  // Read in path order, neighbouring paths tend to be stored close to each
+  // other in packs.
+  std::vector<size_t> order;
+  for (size_t i = 0; i < paths.size(); i++)
+    if (found[i])
+      order.push_back(i);
+  std::sort(order.begin(), order.end(), [&paths](size_t a, size_t b) {
+    return paths[a] < paths[b];
+  });
+
+  const size_t BLOBS_PER_TASK = 32;
+  size_t tasks = (order.size() + BLOBS_PER_TASK - 1) / BLOBS_PER_TASK;
+  threads = ParallelThreadCount(threads, tasks);
+
+  std::string gitPath(git_repository_path(repository));
+  std::vector<git_repository*> handles(threads, NULL);
+  std::vector<git_blob*> blobs(paths.size(), NULL);
+  std::vector<int> errors(tasks, GIT_OK);
+  handles[0] = repository;
+
+  ParallelFor(tasks, threads, [&](size_t task, size_t thread) {
+    if (handles[thread] == NULL &&
+        git_repository_open_ext(&handles[thread], gitPath.c_str(),
+                                GIT_REPOSITORY_OPEN_NO_SEARCH, NULL)
+          != GIT_OK) {
+      handles[thread] = NULL;
+      errors[task] = -1;
+      return;
+    }
+
+    size_t end = std::min(order.size(), (task + 1) * BLOBS_PER_TASK);
+    for (size_t i = task * BLOBS_PER_TASK; i < end; i++) {
+      size_t index = order[i];
+      int lookupError = git_blob_lookup(&blobs[index], handles[thread],
+                                        &ids[index]);
+      if (lookupError != GIT_OK) {
+        blobs[index] = NULL;
+        if (lookupError != GIT_ENOTFOUND) {
+          errors[task] = lookupError;
+          break;
+        }
+      }
+    }
+  });
+
+  for (size_t i = 1; i < threads; i++)
+    git_repository_free(handles[i]);
+
+  // A task that failed would report its blobs as missing.
+  for (size_t i = 0; i < tasks && error == GIT_OK; i++)
+    error = errors[i];
+  if (error != GIT_OK) {
+    for (size_t i = 0; i < blobs.size(); i++)
+      git_blob_free(blobs[i]);
+    return error;
   }
-  info.GetReturnValue().SetUndefined();
+
+  size_t total = 0;
+  for (size_t i = 0; i < blobs.size(); i++)
+    if (blobs[i] != NULL)
+      total += static_cast<size_t>(git_blob_rawsize(blobs[i]));
+
+  batch->size = total;
+  batch->data = total <= std::numeric_limits<uint32_t>::max() ?
+      static_cast<char*>(malloc(total > 0 ? total : 1)) : NULL;
+  if (batch->data == NULL)
+    error = -1;
+
+  size_t offset = 0;
+  for (size_t i = 0; i < blobs.size(); i++) {
+    batch->offsets.push_back(offset);
+    if (blobs[i] == NULL) {
+      batch->missing.push_back(i);
+      continue;
+    }
+
+    size_t size = static_cast<size_t>(git_blob_rawsize(blobs[i]));
+    if (batch->data != NULL)
+      memcpy(batch->data + offset, git_blob_rawcontent(blobs[i]), size);
+    offset += size;
+    git_blob_free(blobs[i]);
+  }
+  batch->offsets.push_back(offset);
+  return error;
 }
 
-NAN_METHOD(Repository::GetCommitCount) {
-  Nan::HandleScope scope;
-  if (info.Length() < 2)
-    return info.GetReturnValue().Set(Nan::New<Number>(0));
+Local<Value> ToBlobBatch(BlobBatch* batch) {
+  Local<Object> result = Nan::New<Object>();
+  result->Set(Nan::New<String>("contents").ToLocalChecked(),
+              Nan::NewBuffer(batch->data, batch->size).ToLocalChecked());
+  batch->data = NULL;
+  result->Set(Nan::New<String>("offsets").ToLocalChecked(),
+              ToUint32Array(batch->offsets));
+  result->Set(Nan::New<String>("missing").ToLocalChecked(),
+              ToUint32Array(batch->missing));
+  return result;
+}
 
-  std::string fromCommitId(*String::Utf8Value(info[0]));
-  git_oid fromCommit;
-  if (git_oid_fromstr(&fromCommit, fromCommitId.c_str()) != GIT_OK)
-    return info.GetReturnValue().Set(Nan::New<Number>(0));
+void RunBlobsAsync(Nan::NAN_METHOD_ARGS_TYPE info, Repository* repo,
+                   bool useIndex) {
+  std::vector<std::string> paths;
+  if (info.Length() >= 1)
+    paths = ToStringVector(info[0]);
+  // Inflate on one thread per core unless told otherwise.
+  size_t threads = 0;
+  if (info[1]->IsObject() && !Local<Object>::Cast(info[1])->Get(
+        Nan::New<String>("parallel").ToLocalChecked())->IsUndefined())
+    threads = GetParallelOption(info[1]);
+  std::shared_ptr<HeadCache> headCache = repo->headCache;
+
+  RepositoryWork work =
+    [paths, useIndex, threads, headCache](
+        git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
+
+      std::shared_ptr<BlobBatch> batch(new BlobBatch(), [](BlobBatch* b) {
+        free(b->data);
+        delete b;
+      });
+      if (ReadBlobs(repository, paths, useIndex, headCache.get(), threads,
+                    batch.get()) != GIT_OK)
+        return nullptr;
+      return FFL([batch]() { return ToBlobBatch(batch.get()); });
+    };
 
-  std::string toCommitId(*String::Utf8Value(info[1]));
-  git_oid toCommit;
-  if (git_oid_fromstr(&toCommit, toCommitId.c_str()) != GIT_OK)
-    return info.GetReturnValue().Set(Nan::New<Number>(0));
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_REPOSITORY,
+    "Could not read blobs");
+}
 
-  git_revwalk* revWalk;
-  if (git_revwalk_new(&revWalk, GetGitRepository(info)) != GIT_OK)
-    return info.GetReturnValue().Set(Nan::New<Number>(0));
+// A chunk of a streamed blob, freed unless it was handed to JS.
+struct BlobChunk {
+  char* data;
+  size_t size;
 
-  git_revwalk_push(revWalk, &fromCommit);
-  git_revwalk_hide(revWalk, &toCommit);
-  git_oid currentCommit;
-  int count = 0;
-  while (git_revwalk_next(&currentCommit, revWalk) == GIT_OK)
-    count++;
-  git_revwalk_free(revWalk);
-  return info.GetReturnValue().Set(Nan::New<Number>(count));
+  ~BlobChunk() {
+    free(data);
+  }
+};
+
+size_t GetBlobChunkSizeOption(Local<Value> options) {
+  const size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+  if (!options->IsObject())
+    return DEFAULT_CHUNK_SIZE;
+
+  Local<Value> chunkSize = Local<Object>::Cast(options)->Get(
+      Nan::New<String>("chunkSize").ToLocalChecked());
+  if (chunkSize->IsNumber() && chunkSize->NumberValue() >= 1)
+    return static_cast<size_t>(chunkSize->NumberValue());
+  return DEFAULT_CHUNK_SIZE;
 }
 
-NAN_METHOD(Repository::GetMergeBase) {
-  Nan::HandleScope scope;
-  if (info.Length() < 2)
-    return info.GetReturnValue().Set(Nan::Null());
+void RunBlobStreamAsync(Nan::NAN_METHOD_ARGS_TYPE info, Repository* repo,
+                        bool useIndex) {
+  if (info.Length() < 2 || !info[1]->IsFunction())
+    return Nan::ThrowTypeError("A chunk callback is required");
+
+  std::vector<std::string> paths(1, *String::Utf8Value(info[0]));
+  Callback* onChunk = new Callback(Local<Function>::Cast(info[1]));
+  size_t chunkSize = GetBlobChunkSizeOption(info[2]);
+  std::shared_ptr<HeadCache> headCache = repo->headCache;
+
+  RepositoryWork work =
+    [paths, useIndex, chunkSize, headCache](
+        git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
+
+      std::vector<git_oid> ids;
+      std::vector<bool> found;
+      if (FindBlobIds(repository, paths, useIndex, headCache.get(), &ids,
+                      &found) != GIT_OK)
+        return nullptr;
+      if (!found[0])
+        return FFL([]() { return Nan::Null(); });
+
+      // PushChunk blocks while JS is behind, so no more than a few chunks
+      // are ever held in memory.
+      BlobChunkSink sink = [progress](char* data, size_t size) {
+        std::shared_ptr<BlobChunk> chunk(new BlobChunk { data, size });
+        return progress->PushChunk(FFL([chunk]() {
+          Local<Object> buffer =
+            Nan::NewBuffer(chunk->data, chunk->size).ToLocalChecked();
+          chunk->data = NULL;
+          return buffer;
+        }));
+      };
+      uint64_t size = 0;
+      if (StreamBlob(repository, &ids[0], chunkSize, sink, &size) != GIT_OK &&
+          !progress->IsCancelled())
+        return nullptr;
+
+      double total = static_cast<double>(size);
+      return FFL([total]() { return Nan::New<Number>(total); });
+    };
 
-  std::string commitOneId(*String::Utf8Value(info[0]));
-  git_oid commitOne;
-  if (git_oid_fromstr(&commitOne, commitOneId.c_str()) != GIT_OK)
-    return info.GetReturnValue().Set(Nan::Null());
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::INTERACTIVE,
+    onChunk,
+    work,
+    GITERR_REPOSITORY,
+    "Could not read blob");
+}
 
-  std::string commitTwoId(*String::Utf8Value(info[1]));
-  git_oid commitTwo;
-  if (git_oid_fromstr(&commitTwo, commitTwoId.c_str()) != GIT_OK)
-    return info.GetReturnValue().Set(Nan::Null());
+// Peel |spec|, anything git rev-parse understands, to a tree. An empty spec
+// stands for the empty tree and leaves |tree| NULL.
+int LookupSpecTree(git_repository* repository, const std::string& spec,
+                   git_tree** tree) {
+  *tree = NULL;
+  if (spec.empty())
+    return GIT_OK;
+
+  git_object* object;
+  int error = git_revparse_single(&object, repository, spec.c_str());
+  if (error != GIT_OK)
+    return error;
+  git_object* peeled;
+  error = git_object_peel(&peeled, object, GIT_OBJ_TREE);
+  git_object_free(object);
+  if (error == GIT_OK)
+    *tree = reinterpret_cast<git_tree*>(peeled);
+  return error;
+}
 
-  git_oid mergeBase;
-  if (git_merge_base(
-        &mergeBase, GetGitRepository(info), &commitOne, &commitTwo) == GIT_OK) {
-    char mergeBaseId[GIT_OID_HEXSZ + 1];
-    git_oid_tostr(mergeBaseId, GIT_OID_HEXSZ + 1, &mergeBase);
-    return info.GetReturnValue().Set(Nan::New<String>(mergeBaseId, -1)
-        .ToLocalChecked());
+TreeDiffOptions GetTreeDiffOptions(Local<Value> options) {
+  TreeDiffOptions diffOptions;
+  diffOptions.renames = GetBoolOption(options, "renames");
+  diffOptions.statsOnly = GetBoolOption(options, "statsOnly");
+  if (!options->IsObject())
+    return diffOptions;
+
+  Local<Object> object = Local<Object>::Cast(options);
+  Local<Value> threshold =
+    object->Get(Nan::New<String>("renameThreshold").ToLocalChecked());
+  if (threshold->IsNumber() && threshold->NumberValue() >= 0 &&
+      threshold->NumberValue() <= 100)
+    diffOptions.renameThreshold =
+      static_cast<uint16_t>(threshold->NumberValue());
+  Local<Value> contextLines =
+    object->Get(Nan::New<String>("contextLines").ToLocalChecked());
+  if (contextLines->IsNumber() && contextLines->NumberValue() >= 0)
+    diffOptions.contextLines =
+      static_cast<uint32_t>(contextLines->NumberValue());
+  if (!object->Get(Nan::New<String>("parallel").ToLocalChecked())
+        ->IsUndefined())
+    diffOptions.threads = GetParallelOption(options);
+  return diffOptions;
+}
+
+Local<Value> ToTreeDiffFile(const TreeDiffFile& file, bool statsOnly) {
+  Local<Object> result = Nan::New<Object>();
+  result->Set(Nan::New<String>("status").ToLocalChecked(),
+              Nan::New<String>(&file.status, 1).ToLocalChecked());
+  result->Set(Nan::New<String>("oldPath").ToLocalChecked(),
+              Nan::New<String>(file.oldPath).ToLocalChecked());
+  result->Set(Nan::New<String>("newPath").ToLocalChecked(),
+              Nan::New<String>(file.newPath).ToLocalChecked());
+  if (file.status == 'R' || file.status == 'C')
+    result->Set(Nan::New<String>("similarity").ToLocalChecked(),
+                Nan::New<Number>(file.similarity));
+  result->Set(Nan::New<String>("added").ToLocalChecked(),
+              Nan::New<Number>(file.added));
+  result->Set(Nan::New<String>("deleted").ToLocalChecked(),
+              Nan::New<Number>(file.deleted));
+  if (statsOnly)
+    return result;
+
+  Local<Array> hunks = Nan::New<Array>(file.hunks.size());
+  for (size_t i = 0; i < file.hunks.size(); i++) {
+    const TreeDiffHunk& hunk = file.hunks[i];
+    Local<Object> value = Nan::New<Object>();
+    value->Set(Nan::New<String>("oldStart").ToLocalChecked(),
+               Nan::New<Number>(hunk.oldStart));
+    value->Set(Nan::New<String>("oldLines").ToLocalChecked(),
+               Nan::New<Number>(hunk.oldLines));
+    value->Set(Nan::New<String>("newStart").ToLocalChecked(),
+               Nan::New<Number>(hunk.newStart));
+    value->Set(Nan::New<String>("newLines").ToLocalChecked(),
+               Nan::New<Number>(hunk.newLines));
+    Local<Array> lines = Nan::New<Array>(hunk.lines.size());
+    for (size_t j = 0; j < hunk.lines.size(); j++)
+      lines->Set(j, Nan::New<String>(hunk.lines[j]).ToLocalChecked());
+    value->Set(Nan::New<String>("lines").ToLocalChecked(), lines);
+    hunks->Set(i, value);
   }
+  result->Set(Nan::New<String>("hunks").ToLocalChecked(), hunks);
+  return result;
+}
 
-  return info.GetReturnValue().Set(Nan::Null());
+std::vector<std::string> ToStringVector(Local<Value> value) {
+  std::vector<std::string> strings;
+  if (!value->IsArray())
+    return strings;
+
+  Array *array = Array::Cast(*value);
+  for (unsigned int i = 0; i < array->Length(); i++)
+    strings.push_back(*String::Utf8Value(array->Get(i)));
+  return strings;
 }
 
-int Repository::DiffHunkCallback(const git_diff_delta* delta,
-                                 const git_diff_hunk* range,
-                                 void* payload) {
-  std::vector<git_diff_hunk>* ranges =
-      static_cast<std::vector<git_diff_hunk>*>(payload);
-  ranges->push_back(*range);
-  return GIT_OK;
+int CheckoutHeadPath(git_repository* repository, const std::string& path) {
+  char* pathStr = const_cast<char*>(path.c_str());
+
+  git_checkout_options options = GIT_CHECKOUT_OPTIONS_INIT;
+  options.checkout_strategy = GIT_CHECKOUT_FORCE |
+                              GIT_CHECKOUT_DISABLE_PATHSPEC_MATCH;
+  git_strarray paths;
+  paths.count = 1;
+  paths.strings = &pathStr;
+  options.paths = paths;
+
+  return git_checkout_head(repository, &options);
 }
 
-NAN_METHOD(Repository::GetLineDiffs) {
-  Nan::HandleScope scope;
-  if (info.Length() < 2)
-    return info.GetReturnValue().Set(Nan::Null());
+// The tree of the HEAD commit, from |headCache| when there is one.
+int GetHeadTree(git_repository* repository, HeadCache* headCache,
+                git_tree** tree) {
+  if (headCache != NULL)
+    return headCache->GetTree(repository, tree) == GIT_OK ? GIT_OK : -1;
 
-  std::string text(*String::Utf8Value(info[1]));
+  git_reference* head;
+  if (git_repository_head(&head, repository) != GIT_OK)
+    return -1;
 
-  git_repository* repo = GetGitRepository(info);
+  const git_oid* sha = git_reference_target(head);
+  git_commit* commit;
+  int commitStatus = git_commit_lookup(&commit, repository, sha);
+  git_reference_free(head);
+  if (commitStatus != GIT_OK)
+    return -1;
 
-  git_blob* blob = NULL;
+  int treeStatus = git_commit_tree(tree, commit);
+  git_commit_free(commit);
+  return treeStatus == GIT_OK ? GIT_OK : -1;
+}
 
-  int getBlobResult = GetBlob(info, repo, blob);
+// Count the lines added and deleted in the working directory version of
+// |path| compared to HEAD. Both counters are left at zero when the path is
+// unchanged, new or could not be diffed.
+int DiffStatsForPath(git_repository* repository, const std::string& path,
+                     int* added, int* deleted, HeadCache* headCache = NULL) {
+  *added = 0;
+  *deleted = 0;
 
-  if (getBlobResult != 0)
-    return info.GetReturnValue().Set(Nan::Null());
+  git_tree* tree;
+  if (GetHeadTree(repository, headCache, &tree) != GIT_OK)
+    return -1;
 
-  std::vector<git_diff_hunk> ranges;
-  git_diff_options options = CreateDefaultGitDiffOptions();
+  char* pathStr = const_cast<char*>(path.c_str());
 
-  // Set GIT_DIFF_IGNORE_WHITESPACE_EOL when ignoreEolWhitespace: true
-  if (info.Length() >= 3) {
-    Local<Object> optionsArg(Local<Object>::Cast(info[2]));
-    Local<Value> ignoreEolWhitespace;
-    ignoreEolWhitespace = optionsArg->Get(
-        Nan::New<String>("ignoreEolWhitespace").ToLocalChecked());
+  git_diff_options options = Repository::CreateDefaultGitDiffOptions();
+  git_strarray paths;
+  paths.count = 1;
+  paths.strings = &pathStr;
+  options.pathspec = paths;
+  options.context_lines = 0;
+  options.flags = GIT_DIFF_DISABLE_PATHSPEC_MATCH;
+
+  git_diff* diffs;
+  int diffStatus = git_diff_tree_to_workdir(&diffs, repository, tree, &options);
+  git_tree_free(tree);
+  if (diffStatus != GIT_OK)
+    return -1;
 
-    if (ignoreEolWhitespace->BooleanValue())
-      options.flags = GIT_DIFF_IGNORE_WHITESPACE_EOL;
+  int deltas = git_diff_num_deltas(diffs);
+  if (deltas != 1) {
+    git_diff_free(diffs);
+    return -1;
   }
 
-  options.context_lines = 0;
-  if (git_diff_blob_to_buffer(blob, NULL, text.data(), text.length(), NULL,
-                              &options, NULL, NULL, DiffHunkCallback, NULL,
-                              &ranges) == GIT_OK) {
-    Local<Object> v8Ranges = Nan::New<Array>(ranges.size());
-    for (size_t i = 0; i < ranges.size(); i++) {
-      Local<Object> v8Range = Nan::New<Object>();
-      v8Range->Set(Nan::New<String>("oldStart").ToLocalChecked(),
-                   Nan::New<Number>(ranges[i].old_start));
-      v8Range->Set(Nan::New<String>("oldLines").ToLocalChecked(),
-                   Nan::New<Number>(ranges[i].old_lines));
-      v8Range->Set(Nan::New<String>("newStart").ToLocalChecked(),
-                   Nan::New<Number>(ranges[i].new_start));
-      v8Range->Set(Nan::New<String>("newLines").ToLocalChecked(),
-                   Nan::New<Number>(ranges[i].new_lines));
-      v8Ranges->Set(i, v8Range);
+  git_patch* patch;
+  int patchStatus = git_patch_from_diff(&patch, diffs, 0);
+  git_diff_free(diffs);
+  if (patchStatus != GIT_OK)
+    return -1;
+
+  int hunks = git_patch_num_hunks(patch);
+  for (int i = 0; i < hunks; i++) {
+    int lines = git_patch_num_lines_in_hunk(patch, i);
+    for (int j = 0; j < lines; j++) {
+      const git_diff_line* line;
+      if (git_patch_get_line_in_hunk(&line, patch, i, j) == GIT_OK) {
+        switch (line->origin) {
+          case GIT_DIFF_LINE_ADDITION:
+            (*added)++;
+            break;
+          case GIT_DIFF_LINE_DELETION:
+            (*deleted)++;
+            break;
+        }
+      }
     }
-    git_blob_free(blob);
-    return info.GetReturnValue().Set(v8Ranges);
+  }
+  git_patch_free(patch);
+  return GIT_OK;
+}
+
+// Lines added and deleted in one changed file, both -1 when it is binary.
+struct NumStat {
+  std::string path;
+  int32_t added;
+  int32_t deleted;
+};
+
+// What a worker thread needs from a delta of the tree to workdir diff, so
+// the diff itself is never shared between threads.
+struct NumStatDelta {
+  std::string oldPath;
+  std::string newPath;
+  git_oid oldId;
+  uint16_t oldMode;
+  uint16_t newMode;
+  bool deleted;
+};
+
+// Read the working directory version of |path| the way git would hash it:
+// symlinks as their target and files through the clean filters, so CRLF
+// conversion doesn't show up as changed lines.
+int ReadWorkdirContent(git_repository* repository, const std::string& path,
+                       uint16_t mode, git_blob* oldBlob, git_buf* content) {
+  std::string absolute = std::string(git_repository_workdir(repository)) +
+      path;
+  if (mode == GIT_FILEMODE_LINK) {
+    uv_fs_t request;
+    int result = uv_fs_readlink(NULL, &request, absolute.c_str(), NULL);
+    if (result == 0)
+      git_buf_set(content, request.ptr, strlen(static_cast<char*>(
+          request.ptr)));
+    uv_fs_req_cleanup(&request);
+    return result == 0 ? GIT_OK : -1;
+  }
+
+  git_filter_list* filters = NULL;
+  int error = git_filter_list_load(&filters, repository, oldBlob, path.c_str(),
+                                   GIT_FILTER_TO_ODB, GIT_FILTER_DEFAULT);
+  if (error != GIT_OK)
+    return error;
+  if (filters != NULL) {
+    error = git_filter_list_apply_to_file(content, filters, repository,
+                                          path.c_str());
+    git_filter_list_free(filters);
+    return error;
+  }
+
+  FILE* file = fopen(absolute.c_str(), "rb");
+  if (file == NULL)
+    return -1;
+  std::string data;
+  char buffer[65536];
+  size_t length;
+  while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    data.append(buffer, length);
+  fclose(file);
+  return git_buf_set(content, data.data(), data.size());
+}
+
+// Count the lines of |delta| like git diff --numstat, using |repository|
+// which belongs to the calling thread.
+int NumStatForDelta(git_repository* repository, const NumStatDelta& delta,
+                    NumStat* stat) {
+  stat->path = delta.newPath;
+  stat->added = 0;
+  stat->deleted = 0;
+  // Submodules only change the commit they point to.
+  if (delta.oldMode == GIT_FILEMODE_COMMIT ||
+      delta.newMode == GIT_FILEMODE_COMMIT)
+    return GIT_OK;
+
+  git_blob* oldBlob = NULL;
+  if (!git_oid_iszero(&delta.oldId) &&
+      git_blob_lookup(&oldBlob, repository, &delta.oldId) != GIT_OK)
+    return -1;
+
+  git_buf content = { NULL, 0, 0 };
+  if (!delta.deleted && ReadWorkdirContent(repository, delta.newPath,
+                                           delta.newMode, oldBlob, &content)
+      != GIT_OK) {
+    git_buf_free(&content);
+    git_blob_free(oldBlob);
+    return -1;
+  }
+
+  git_diff_options options = Repository::CreateDefaultGitDiffOptions();
+  options.context_lines = 0;
+  git_patch* patch = NULL;
+  int error = git_patch_from_blob_and_buffer(
+      &patch, oldBlob, delta.oldPath.c_str(),
+      delta.deleted ? NULL : content.ptr, content.size,
+      delta.newPath.c_str(), &options);
+  git_buf_free(&content);
+  git_blob_free(oldBlob);
+  if (error != GIT_OK)
+    return error;
+
+  if (git_patch_get_delta(patch)->flags & GIT_DIFF_FLAG_BINARY) {
+    stat->added = -1;
+    stat->deleted = -1;
   } else {
-    git_blob_free(blob);
-    return info.GetReturnValue().Set(Nan::Null());
+    size_t context, added, deleted;
+    git_patch_line_stats(&context, &added, &deleted, patch);
+    stat->added = static_cast<int32_t>(added);
+    stat->deleted = static_cast<int32_t>(deleted);
+  }
+  git_patch_free(patch);
+  return GIT_OK;
+}
+
+// Count the lines added and deleted in every file of |paths|, or of the whole
+// working directory when |paths| is NULL, compared to HEAD. One diff finds
+// the changed files, then their patches are computed on up to |threads|
+// threads, each with its own repository handle. Untracked files are left
+// out, like git diff HEAD --numstat does.
+int DiffStatsForPaths(git_repository* repository,
+                      const std::vector<std::string>* paths,
+                      HeadCache* headCache, size_t threads,
+                      std::vector<NumStat>* stats) {
+  // An empty pathspec would match everything.
+  if (paths != NULL && paths->empty())
+    return GIT_OK;
+
+  git_tree* tree;
+  if (GetHeadTree(repository, headCache, &tree) != GIT_OK)
+    return -1;
+
+  std::vector<char*> pathStrings;
+  git_diff_options options = Repository::CreateDefaultGitDiffOptions();
+  if (paths != NULL) {
+    for (size_t i = 0; i < paths->size(); i++)
+      pathStrings.push_back(const_cast<char*>((*paths)[i].c_str()));
+    options.pathspec.count = pathStrings.size();
+    options.pathspec.strings = pathStrings.data();
+    options.flags = GIT_DIFF_DISABLE_PATHSPEC_MATCH;
+  }
+
+  git_diff* diff;
+  int error = git_diff_tree_to_workdir(&diff, repository, tree, &options);
+  git_tree_free(tree);
+  if (error != GIT_OK)
+    return error;
+
+  std::vector<NumStatDelta> deltas;
+  size_t count = git_diff_num_deltas(diff);
+  for (size_t i = 0; i < count; i++) {
+    const git_diff_delta* delta = git_diff_get_delta(diff, i);
+    NumStatDelta entry;
+    entry.oldPath = delta->old_file.path;
+    entry.newPath = delta->new_file.path;
+    git_oid_cpy(&entry.oldId, &delta->old_file.id);
+    entry.oldMode = delta->old_file.mode;
+    entry.newMode = delta->new_file.mode;
+    entry.deleted = delta->status == GIT_DELTA_DELETED;
+    deltas.push_back(entry);
+  }
+  git_diff_free(diff);
+
+  const size_t DELTAS_PER_TASK = 8;
+  size_t tasks = (deltas.size() + DELTAS_PER_TASK - 1) / DELTAS_PER_TASK;
+  threads = ParallelThreadCount(threads, tasks);
+
+  std::string gitPath(git_repository_path(repository));
+  std::vector<git_repository*> handles(threads, NULL);
+  std::vector<int> errors(tasks, GIT_OK);
+  handles[0] = repository;
+  stats->resize(deltas.size());
+
+  ParallelFor(tasks, threads, [&](size_t task, size_t thread) {
+    if (handles[thread] == NULL &&
+        git_repository_open_ext(&handles[thread], gitPath.c_str(),
+                                GIT_REPOSITORY_OPEN_NO_SEARCH, NULL)
+          != GIT_OK) {
+      handles[thread] = NULL;
+      errors[task] = -1;
+      return;
+    }
+
+    size_t end = std::min(deltas.size(), (task + 1) * DELTAS_PER_TASK);
+    for (size_t i = task * DELTAS_PER_TASK; i < end; i++)
+      if (NumStatForDelta(handles[thread], deltas[i], &(*stats)[i])
+          != GIT_OK)
+        errors[task] = -1;
+  });
+
+  for (size_t i = 1; i < threads; i++)
+    git_repository_free(handles[i]);
+  for (size_t i = 0; i < tasks; i++)
+    if (errors[i] != GIT_OK)
+      return errors[i];
+  return GIT_OK;
+}
+
+// Numstat rows keyed by path, or, with the packed format, the paths one after
+// the other in a Buffer with their start offsets followed by the total
+// length, next to typed arrays of the counts.
+Local<Value> ToNumStats(const std::vector<NumStat>& stats, bool packed) {
+  if (!packed) {
+    Local<Object> result = Nan::New<Object>();
+    for (size_t i = 0; i < stats.size(); i++)
+      result->Set(Nan::New<String>(stats[i].path).ToLocalChecked(),
+                  ToDiffStats(stats[i].added, stats[i].deleted));
+    return result;
+  }
+
+  std::string paths;
+  std::vector<uint32_t> offsets;
+  std::vector<int32_t> added;
+  std::vector<int32_t> deleted;
+  for (size_t i = 0; i < stats.size(); i++) {
+    offsets.push_back(paths.size());
+    paths.append(stats[i].path);
+    added.push_back(stats[i].added);
+    deleted.push_back(stats[i].deleted);
   }
+  offsets.push_back(paths.size());
+
+  Local<Object> result = Nan::New<Object>();
+  result->Set(Nan::New<String>("paths").ToLocalChecked(),
+              Nan::CopyBuffer(paths.data(), paths.size()).ToLocalChecked());
+  result->Set(Nan::New<String>("offsets").ToLocalChecked(),
+              ToUint32Array(offsets));
+  result->Set(Nan::New<String>("added").ToLocalChecked(),
+              ToInt32Array(added));
+  result->Set(Nan::New<String>("deleted").ToLocalChecked(),
+              ToInt32Array(deleted));
+  return result;
+}
+
+// Patches are computed on one thread per core unless told otherwise.
+size_t GetDiffStatsThreads(Local<Value> options) {
+  if (options->IsObject() && !Local<Object>::Cast(options)->Get(
+        Nan::New<String>("parallel").ToLocalChecked())->IsUndefined())
+    return GetParallelOption(options);
+  return 0;
+}
+
+NAN_METHOD(Repository::GetStatus) {
+  Nan::HandleScope scope;
+  if (info.Length() < 1 || !info[0]->IsString()) {
+    Repository* repo = GetRepository(info);
+    bool packed = IsPackedFormat(info[0]);
+    if (packed && !repo->watcher && GetParallelOption(info[0]) == 1) {
+      PackedStatus statuses;
+      ScanStatusPacked(repo->repository, NULL,
+                       GetUntrackedCacheOption(info[0]), &statuses);
+      return info.GetReturnValue().Set(ToPackedStatus(statuses));
+    }
+
+    std::map<std::string, unsigned int> statuses;
+    StatusScan scan = StatusScanner(info[0]);
+    if (repo->watcher)
+      repo->watcher->GetStatus(repo->repository, scan, &statuses);
+    else
+      scan(repo->repository, NULL, &statuses);
+    if (packed) {
+      PackedStatus packedStatuses;
+      PackStatuses(statuses, &packedStatuses);
+      return info.GetReturnValue().Set(ToPackedStatus(packedStatuses));
+    }
+    return info.GetReturnValue().Set(ToStatusObject(statuses));
+  } else {
+    git_repository* repository = GetGitRepository(info);
+    std::string path(*String::Utf8Value(info[0]));
+    unsigned int status = 0;
+    if (git_status_file(&status, repository, path.c_str()) == GIT_OK)
+      return info.GetReturnValue().Set(Nan::New<Number>(status));
+    else
+      return info.GetReturnValue().Set(Nan::New<Number>(0));
+  }
+}
+
+NAN_METHOD(Repository::GetStatusForPaths) {
+  Nan::HandleScope scope;
+
+  std::map<std::string, unsigned int> statuses;
+  if (info.Length() < 1)
+    return info.GetReturnValue().Set(ToStatusObject(statuses));
+
+  std::vector<std::string> paths = ToStringVector(info[0]);
+  if (IsPackedFormat(info[1])) {
+    PackedStatus packed;
+    if (paths.size() > 0)
+      ScanStatusPacked(GetGitRepository(info), &paths, -1, &packed);
+    return info.GetReturnValue().Set(ToPackedStatus(packed));
+  }
+  if (paths.size() < 1)
+    return info.GetReturnValue().Set(ToStatusObject(statuses));
+
+  ScanStatus(GetGitRepository(info), &paths, &statuses, 1, -1);
+  return info.GetReturnValue().Set(ToStatusObject(statuses));
+}
+
+NAN_METHOD(Repository::CheckoutHead) {
+  Nan::HandleScope scope;
+  if (info.Length() < 1)
+    return info.GetReturnValue().Set(Nan::New<Boolean>(false));
+
+  std::string path(*String::Utf8Value(info[0]));
+  int result = CheckoutHeadPath(GetGitRepository(info), path);
+  return info.GetReturnValue().Set(Nan::New<Boolean>(result == GIT_OK));
+}
+
+int ReadReferenceTarget(git_repository* repository,
+                        const std::string& refName, std::string* target) {
+  git_oid sha;
+  if (git_reference_name_to_id(&sha, repository, refName.c_str()) != GIT_OK)
+    return -1;
+
+  char oid[GIT_OID_HEXSZ + 1];
+  git_oid_tostr(oid, GIT_OID_HEXSZ + 1, &sha);
+  *target = oid;
+  return GIT_OK;
+}
+
+NAN_METHOD(Repository::GetReferenceTarget) {
+  Nan::HandleScope scope;
+  if (info.Length() < 1)
+    return info.GetReturnValue().Set(Nan::Null());
+
+  std::string refName(*String::Utf8Value(info[0]));
+  std::string target;
+  if (ReadReferenceTarget(GetGitRepository(info), refName, &target) != GIT_OK)
+    return info.GetReturnValue().Set(Nan::Null());
+  return info.GetReturnValue().Set(Nan::New<String>(target).ToLocalChecked());
+}
+
+NAN_METHOD(Repository::GetDiffStats) {
+  Nan::HandleScope scope;
+
+  if (info.Length() >= 1 && (info[0]->IsArray() || info[0]->IsNull())) {
+    std::vector<std::string> paths = ToStringVector(info[0]);
+    std::vector<NumStat> stats;
+    if (DiffStatsForPaths(GetGitRepository(info),
+                          info[0]->IsNull() ? NULL : &paths,
+                          GetRepository(info)->headCache.get(),
+                          GetDiffStatsThreads(info[1]), &stats) != GIT_OK)
+      stats.clear();
+    return info.GetReturnValue().Set(
+        ToNumStats(stats, IsPackedFormat(info[1])));
+  }
+
+  int added = 0;
+  int deleted = 0;
+  if (info.Length() >= 1) {
+    std::string path(*String::Utf8Value(info[0]));
+    DiffStatsForPath(GetGitRepository(info), path, &added, &deleted,
+                     GetRepository(info)->headCache.get());
+  }
+
+  return info.GetReturnValue().Set(ToDiffStats(added, deleted));
+}
+
+NAN_METHOD(Repository::GetHeadBlob) {
+  Nan::HandleScope scope;
+  if (info.Length() < 1)
+    return info.GetReturnValue().Set(Nan::Null());
+
+  std::string path(*String::Utf8Value(info[0]));
+
+  git_blob* blob = NULL;
+  if (LookupBlob(GetGitRepository(info), path, false, blob,
+                 GetRepository(info)->headCache.get()) != GIT_OK)
+    return info.GetReturnValue().Set(Nan::Null());
+
+  bool asBuffer = GetBoolOption(info[1], "asBuffer");
+  return info.GetReturnValue().Set(ToBlobContent(blob, asBuffer));
+}
+
+NAN_METHOD(Repository::GetIndexBlob) {
+  Nan::HandleScope scope;
+  if (info.Length() < 1)
+    return info.GetReturnValue().Set(Nan::Null());
+
+  std::string path(*String::Utf8Value(info[0]));
+
+  git_blob* blob = NULL;
+  if (LookupBlob(GetGitRepository(info), path, true, blob) != GIT_OK)
+    return info.GetReturnValue().Set(Nan::Null());
+
+  bool asBuffer = GetBoolOption(info[1], "asBuffer");
+  return info.GetReturnValue().Set(ToBlobContent(blob, asBuffer));
+}
+
+int Repository::StatusCallback(
+    const char* path, unsigned int status, void* payload) {
+  std::map<std::string, unsigned int>* statuses =
+      static_cast<std::map<std::string, unsigned int>*>(payload);
+  statuses->insert(std::make_pair(std::string(path), status));
+  return GIT_OK;
+}
+
+int Repository::ScanStatus(
+    git_repository* repository, const std::vector<std::string>* paths,
+    StatusMap* statuses, size_t threads, int untrackedCache) {
+  std::unique_ptr<UntrackedCache> cache(
+      UntrackedCache::Open(repository, untrackedCache));
+
+  std::vector<std::vector<std::string>> partitions;
+  if (paths == NULL && threads != 1 &&
+      git_repository_workdir(repository) != NULL) {
+    partitions = PartitionWorkingDirectory(repository);
+    threads = ParallelThreadCount(threads, partitions.size());
+  }
+
+  int error = GIT_OK;
+  if (partitions.empty() || threads < 2) {
+    error = CollectStatuses(repository, paths, StatusCallback, statuses,
+                            cache.get());
+  } else {
+    error = ScanPartitions(repository, partitions, threads, statuses,
+                           cache.get());
+  }
+
+  if (cache && error == GIT_OK)
+    cache->Save(paths == NULL);
+  return error;
+}
+
+StatusScan Repository::StatusScanner(Local<Value> options) {
+  size_t threads = GetParallelOption(options);
+  int untrackedCache = GetUntrackedCacheOption(options);
+  return [threads, untrackedCache](git_repository* repository,
+                                   const std::vector<std::string>* paths,
+                                   StatusMap* statuses) {
+    return ScanStatus(repository, paths, statuses, threads, untrackedCache);
+  };
+}
+
+int Repository::ScanPartitions(
+    git_repository* repository,
+    const std::vector<std::vector<std::string>>& partitions,
+    size_t threads, StatusMap* statuses, UntrackedCache* untrackedCache) {
+  // A git_repository can't be shared between threads, every thread but the
+  // calling one scans on a handle of its own.
+  std::string gitPath(git_repository_path(repository));
+  std::vector<git_repository*> handles(threads, NULL);
+  std::vector<StatusMap> results(threads);
+  std::vector<int> errors(threads, GIT_OK);
+  handles[0] = repository;
+
+  ParallelFor(partitions.size(), threads,
+    [&](size_t index, size_t thread) {
+      if (errors[thread] != GIT_OK)
+        return;
+      if (handles[thread] == NULL) {
+        errors[thread] = git_repository_open_ext(
+            &handles[thread], gitPath.c_str(),
+            GIT_REPOSITORY_OPEN_NO_SEARCH, NULL);
+        if (errors[thread] != GIT_OK)
+          return;
+      }
+      errors[thread] = CollectStatuses(handles[thread], &partitions[index],
+                                       StatusCallback, &results[thread],
+                                       untrackedCache);
+    });
+
+  int error = GIT_OK;
+  for (size_t i = 0; i < threads; i++) {
+    if (i > 0)
+      git_repository_free(handles[i]);
+    if (errors[i] != GIT_OK)
+      error = errors[i];
+    else
+      statuses->insert(results[i].begin(), results[i].end());
+  }
+  return error;
+}
+
+int Repository::SubmoduleCallback(
+    git_submodule* submodule, const char* name, void* payload) {
+  std::vector<std::string>* submodules =
+      static_cast<std::vector<std::string>*>(payload);
+  const char* submodulePath = git_submodule_path(submodule);
+  if (submodulePath != NULL)
+    submodules->push_back(submodulePath);
+  return GIT_OK;
+}
+
+NAN_METHOD(Repository::Release) {
+  Nan::HandleScope scope;
+  Repository* repo = Nan::ObjectWrap::Unwrap<Repository>(info.This());
+  if (repo->watcher) {
+    repo->watcher->Stop();
+    repo->watcher.reset();
+  }
+  repo->headCache.reset();
+  repo->commitGraph.reset();
+  repo->changedPaths.reset();
+  repo->logWalks.reset();
+  repo->commitCache.reset();
+  repo->queue.Close();
+  if (repo->repository != NULL) {
+    git_repository_free(repo->repository);
+    repo->repository = NULL;
+  }
+  info.GetReturnValue().SetUndefined();
+}
+
+// Build the commit graph on the background lane the first time a history
+// query comes in, and again once queries missed commits. Until then those
+// queries fall back to revwalks.
+void ScheduleCommitGraphBuild(Repository* repo) {
+  if (!repo->commitGraph || !repo->commitGraph->TakeBuild())
+    return;
+
+  // The build walks every commit of the refs, it runs off the repository's
+  // queue so queued calls don't wait for it.
+  std::shared_ptr<CommitGraph> commitGraph = repo->commitGraph;
+  GitWorker::RunDetached(
+    git_repository_path(repo->repository),
+    Scheduler::BACKGROUND,
+    [commitGraph](git_repository* repository, Progress* progress)
+        -> GetResult {
+      if (repository != NULL)
+        commitGraph->Build(repository);
+      return FFL([]() { return Nan::Undefined(); });
+    });
+}
+
+// Build the changed-path filters, and the commit graph they cover, on the
+// background lane the first time a path history is asked for. Until then
+// every commit of a path history has its trees compared. The build walks
+// the whole history, it runs off the repository's queue so queued calls
+// don't wait for it.
+void ScheduleChangedPathsBuild(Repository* repo) {
+  if (!repo->changedPaths || !repo->changedPaths->TakeBuild())
+    return;
+
+  std::shared_ptr<CommitGraph> commitGraph = repo->commitGraph;
+  std::shared_ptr<ChangedPaths> changedPaths = repo->changedPaths;
+  GitWorker::RunDetached(
+    git_repository_path(repo->repository),
+    Scheduler::BACKGROUND,
+    [commitGraph, changedPaths](git_repository* repository,
+                                Progress* progress) -> GetResult {
+      if (repository != NULL)
+        UpdateHistoryIndexes(repository, commitGraph.get(),
+                             changedPaths.get(), true);
+      return FFL([]() { return Nan::Undefined(); });
+    });
+}
+
+int CountCommits(git_repository* repository, const std::string& fromId,
+                 const std::string& toId, CommitGraph* commitGraph = NULL) {
+  git_oid fromCommit;
+  if (git_oid_fromstr(&fromCommit, fromId.c_str()) != GIT_OK)
+    return 0;
+
+  git_oid toCommit;
+  if (git_oid_fromstr(&toCommit, toId.c_str()) != GIT_OK)
+    return 0;
+
+  size_t graphCount;
+  if (commitGraph != NULL &&
+      commitGraph->CountCommits(&fromCommit, &toCommit, &graphCount) ==
+        GIT_OK)
+    return static_cast<int>(graphCount);
+
+  git_revwalk* revWalk;
+  if (git_revwalk_new(&revWalk, repository) != GIT_OK)
+    return 0;
+
+  git_revwalk_push(revWalk, &fromCommit);
+  git_revwalk_hide(revWalk, &toCommit);
+  git_oid currentCommit;
+  int count = 0;
+  while (git_revwalk_next(&currentCommit, revWalk) == GIT_OK)
+    count++;
+  git_revwalk_free(revWalk);
+  return count;
+}
+
+int FindMergeBase(git_repository* repository, const std::string& oneId,
+                  const std::string& twoId, git_oid* mergeBase,
+                  CommitGraph* commitGraph = NULL) {
+  git_oid commitOne;
+  if (git_oid_fromstr(&commitOne, oneId.c_str()) != GIT_OK)
+    return -1;
+
+  git_oid commitTwo;
+  if (git_oid_fromstr(&commitTwo, twoId.c_str()) != GIT_OK)
+    return -1;
+
+  if (commitGraph != NULL) {
+    int error = commitGraph->MergeBase(&commitOne, &commitTwo, mergeBase);
+    if (error == GIT_OK || error == GIT_ENOTFOUND)
+      return error;
+  }
+  return git_merge_base(mergeBase, repository, &commitOne, &commitTwo);
+}
+
+// A local branch and the remote branch it tracks.
+struct TrackedBranch {
+  std::string name;
+  std::string upstream;
+  git_oid local;
+  git_oid remote;
+  size_t ahead;
+  size_t behind;
+};
+
+// Look up |name|, a full or short branch name. An empty name or HEAD stands
+// for the branch HEAD points to.
+int LookupBranch(git_repository* repository, const std::string& name,
+                 git_reference** branch) {
+  if (name.empty() || name == "HEAD")
+    return git_repository_head(branch, repository);
+  return git_reference_dwim(branch, repository, name.c_str());
+}
+
+// Fill |tracked| in from |branch| and the upstream branch.<name>.remote and
+// branch.<name>.merge point to. False when there is no upstream or either
+// side isn't a commit.
+bool GetTrackedBranch(git_reference* branch, TrackedBranch* tracked) {
+  git_reference* upstream;
+  if (git_branch_upstream(&upstream, branch) != GIT_OK)
+    return false;
+
+  git_object* local;
+  git_object* remote;
+  bool found = git_reference_peel(&local, branch, GIT_OBJ_COMMIT) == GIT_OK;
+  if (found) {
+    found = git_reference_peel(&remote, upstream, GIT_OBJ_COMMIT) == GIT_OK;
+    if (found) {
+      git_oid_cpy(&tracked->local, git_object_id(local));
+      git_oid_cpy(&tracked->remote, git_object_id(remote));
+      git_object_free(remote);
+    }
+    git_object_free(local);
+  }
+  tracked->name = git_reference_name(branch);
+  tracked->upstream = git_reference_name(upstream);
+  tracked->ahead = 0;
+  tracked->behind = 0;
+  git_reference_free(upstream);
+  return found;
+}
+
+// The tracking branches among |names|, or among every local branch when
+// |names| is NULL.
+int FindTrackedBranches(git_repository* repository,
+                        const std::vector<std::string>* names,
+                        std::vector<TrackedBranch>* tracked) {
+  TrackedBranch entry;
+  git_reference* branch;
+  if (names != NULL) {
+    for (size_t i = 0; i < names->size(); i++) {
+      if (LookupBranch(repository, (*names)[i], &branch) != GIT_OK)
+        continue;
+      if (GetTrackedBranch(branch, &entry))
+        tracked->push_back(entry);
+      git_reference_free(branch);
+    }
+    return GIT_OK;
+  }
+
+  git_branch_iterator* iterator;
+  int error = git_branch_iterator_new(&iterator, repository,
+                                      GIT_BRANCH_LOCAL);
+  if (error != GIT_OK)
+    return error;
+  git_branch_t type;
+  while (git_branch_next(&branch, &type, iterator) == GIT_OK) {
+    if (GetTrackedBranch(branch, &entry))
+      tracked->push_back(entry);
+    git_reference_free(branch);
+  }
+  git_branch_iterator_free(iterator);
+  return GIT_OK;
+}
+
+// Count every branch of |tracked| against its upstream, in a single walk of
+// the commit graph when it can answer, one libgit2 walk per branch
+// otherwise.
+int CountAheadBehind(git_repository* repository,
+                     std::vector<TrackedBranch>* tracked,
+                     CommitGraph* commitGraph) {
+  if (tracked->empty())
+    return GIT_OK;
+
+  if (commitGraph != NULL) {
+    std::vector<git_oid> locals;
+    std::vector<git_oid> remotes;
+    for (size_t i = 0; i < tracked->size(); i++) {
+      locals.push_back((*tracked)[i].local);
+      remotes.push_back((*tracked)[i].remote);
+    }
+    std::vector<size_t> ahead;
+    std::vector<size_t> behind;
+    if (commitGraph->AheadBehind(locals, remotes, &ahead, &behind) ==
+        GIT_OK) {
+      for (size_t i = 0; i < tracked->size(); i++) {
+        (*tracked)[i].ahead = ahead[i];
+        (*tracked)[i].behind = behind[i];
+      }
+      return GIT_OK;
+    }
+  }
+
+  for (size_t i = 0; i < tracked->size(); i++) {
+    TrackedBranch& branch = (*tracked)[i];
+    int error = git_graph_ahead_behind(&branch.ahead, &branch.behind,
+                                       repository, &branch.local,
+                                       &branch.remote);
+    if (error != GIT_OK)
+      return error;
+  }
+  return GIT_OK;
+}
+
+Local<Value> ToAheadBehind(size_t ahead, size_t behind) {
+  Local<Object> result = Nan::New<Object>();
+  result->Set(Nan::New<String>("ahead").ToLocalChecked(),
+              Nan::New<Number>(static_cast<double>(ahead)));
+  result->Set(Nan::New<String>("behind").ToLocalChecked(),
+              Nan::New<Number>(static_cast<double>(behind)));
+  return result;
+}
+
+Local<Value> ToOidString(const git_oid* oid) {
+  char oidStr[GIT_OID_HEXSZ + 1];
+  git_oid_tostr(oidStr, GIT_OID_HEXSZ + 1, oid);
+  return Nan::New<String>(oidStr, -1).ToLocalChecked();
+}
+
+NAN_METHOD(Repository::GetUpstreamBranch) {
+  Nan::HandleScope scope;
+  std::string name;
+  if (info.Length() >= 1 && info[0]->IsString())
+    name = *String::Utf8Value(info[0]);
+
+  git_reference* branch;
+  if (LookupBranch(GetGitRepository(info), name, &branch) != GIT_OK)
+    return info.GetReturnValue().Set(Nan::Null());
+
+  git_reference* upstream;
+  int error = git_branch_upstream(&upstream, branch);
+  git_reference_free(branch);
+  if (error != GIT_OK)
+    return info.GetReturnValue().Set(Nan::Null());
+
+  Local<Value> result =
+    Nan::New<String>(git_reference_name(upstream)).ToLocalChecked();
+  git_reference_free(upstream);
+  return info.GetReturnValue().Set(result);
+}
+
+NAN_METHOD(Repository::GetAheadBehindCount) {
+  Nan::HandleScope scope;
+  Repository* repo = GetRepository(info);
+  std::vector<std::string> names(1);
+  if (info.Length() >= 1 && info[0]->IsString())
+    names[0] = *String::Utf8Value(info[0]);
+
+  std::vector<TrackedBranch> tracked;
+  FindTrackedBranches(repo->repository, &names, &tracked);
+  int error = tracked.empty() ? GIT_ENOTFOUND :
+    CountAheadBehind(repo->repository, &tracked, repo->commitGraph.get());
+  ScheduleCommitGraphBuild(repo);
+  if (error != GIT_OK)
+    return info.GetReturnValue().Set(ToAheadBehind(0, 0));
+  return info.GetReturnValue().Set(
+      ToAheadBehind(tracked[0].ahead, tracked[0].behind));
+}
+
+NAN_METHOD(Repository::GetCommitCount) {
+  Nan::HandleScope scope;
+  if (info.Length() < 2)
+    return info.GetReturnValue().Set(Nan::New<Number>(0));
+
+  Repository* repo = GetRepository(info);
+  std::string fromCommitId(*String::Utf8Value(info[0]));
+  std::string toCommitId(*String::Utf8Value(info[1]));
+  int count = CountCommits(repo->repository, fromCommitId, toCommitId,
+                           repo->commitGraph.get());
+  ScheduleCommitGraphBuild(repo);
+  return info.GetReturnValue().Set(Nan::New<Number>(count));
+}
+
+NAN_METHOD(Repository::GetMergeBase) {
+  Nan::HandleScope scope;
+  if (info.Length() < 2)
+    return info.GetReturnValue().Set(Nan::Null());
+
+  Repository* repo = GetRepository(info);
+  std::string commitOneId(*String::Utf8Value(info[0]));
+  std::string commitTwoId(*String::Utf8Value(info[1]));
+
+  git_oid mergeBase;
+  int error = FindMergeBase(repo->repository, commitOneId, commitTwoId,
+                            &mergeBase, repo->commitGraph.get());
+  ScheduleCommitGraphBuild(repo);
+  if (error == GIT_OK)
+    return info.GetReturnValue().Set(ToOidString(&mergeBase));
+
+  return info.GetReturnValue().Set(Nan::Null());
+}
+
+int Repository::DiffHunkCallback(const git_diff_delta* delta,
+                                 const git_diff_hunk* range,
+                                 void* payload) {
+  std::vector<git_diff_hunk>* ranges =
+      static_cast<std::vector<git_diff_hunk>*>(payload);
+  ranges->push_back(*range);
+  return GIT_OK;
+}
+
+git_diff_options CreateLineDiffOptions(bool ignoreEolWhitespace) {
+  git_diff_options options = Repository::CreateDefaultGitDiffOptions();
+  if (ignoreEolWhitespace)
+    options.flags = GIT_DIFF_IGNORE_WHITESPACE_EOL;
+  options.context_lines = 0;
+  return options;
+}
+
+Local<Value> ToHunks(const std::vector<git_diff_hunk>& ranges) {
+  Local<Object> v8Ranges = Nan::New<Array>(ranges.size());
+  for (size_t i = 0; i < ranges.size(); i++) {
+    Local<Object> v8Range = Nan::New<Object>();
+    v8Range->Set(Nan::New<String>("oldStart").ToLocalChecked(),
+                 Nan::New<Number>(ranges[i].old_start));
+    v8Range->Set(Nan::New<String>("oldLines").ToLocalChecked(),
+                 Nan::New<Number>(ranges[i].old_lines));
+    v8Range->Set(Nan::New<String>("newStart").ToLocalChecked(),
+                 Nan::New<Number>(ranges[i].new_start));
+    v8Range->Set(Nan::New<String>("newLines").ToLocalChecked(),
+                 Nan::New<Number>(ranges[i].new_lines));
+    v8Ranges->Set(i, v8Range);
+  }
+  return v8Ranges;
+}
+
+NAN_METHOD(Repository::GetLineDiffs) {
+  Nan::HandleScope scope;
+  if (info.Length() < 2)
+    return info.GetReturnValue().Set(Nan::Null());
+
+  DiffText text(info[1]);
+
+  git_repository* repo = GetGitRepository(info);
+
+  git_blob* blob = NULL;
+
+  int getBlobResult = GetBlob(info, repo, blob);
+
+  if (getBlobResult != 0)
+    return info.GetReturnValue().Set(Nan::Null());
+
+  std::vector<git_diff_hunk> ranges;
+
+  // Set GIT_DIFF_IGNORE_WHITESPACE_EOL when ignoreEolWhitespace: true
+  git_diff_options options = CreateLineDiffOptions(
+      info.Length() >= 3 && GetBoolOption(info[2], "ignoreEolWhitespace"));
+
+  int diffStatus = git_diff_blob_to_buffer(
+      blob, NULL, text.Data(), text.Length(), NULL, &options, NULL, NULL,
+      DiffHunkCallback, NULL, &ranges);
+  git_blob_free(blob);
+
+  if (diffStatus != GIT_OK)
+    return info.GetReturnValue().Set(Nan::Null());
+  if (IsPackedFormat(info[2]))
+    return info.GetReturnValue().Set(ToPackedHunks(ranges));
+  return info.GetReturnValue().Set(ToHunks(ranges));
+}
+
+struct LineDiff {
+  git_diff_hunk hunk;
+  git_diff_line line;
+  // The line content is copied so the diff can outlive the blob and the
+  // text buffer it was computed from.
+  std::string content;
+  // Start and length pairs of the changed parts of the line, in UTF-16
+  // units, when asked for.
+  std::vector<int32_t> changes;
+};
+
+int Repository::DiffLineCallback(const git_diff_delta* delta,
+                                 const git_diff_hunk* range,
+                                 const git_diff_line* line,
+                                 void* payload) {
+  LineDiff lineDiff;
+  lineDiff.hunk = *range;
+  lineDiff.line = *line;
+  lineDiff.content.assign(line->content, line->content_len);
+  std::vector<LineDiff> * lineDiffs =
+      static_cast<std::vector<LineDiff>*>(payload);
+  lineDiffs->push_back(lineDiff);
+  return GIT_OK;
+}
+
+IntralineMode GetIntralineOption(Local<Value> options) {
+  if (!options->IsObject())
+    return INTRALINE_NONE;
+
+  Local<Value> intraline = Local<Object>::Cast(options)->Get(
+      Nan::New<String>("intraline").ToLocalChecked());
+  if (intraline->IsString() &&
+      strcmp(*String::Utf8Value(intraline), "char") == 0)
+    return INTRALINE_CHAR;
+  if (intraline->IsTrue() || (intraline->IsString() &&
+      strcmp(*String::Utf8Value(intraline), "word") == 0))
+    return INTRALINE_WORD;
+  return INTRALINE_NONE;
+}
+
+// Length of a line's content without its newline.
+size_t ContentLength(const char* content, size_t length) {
+  if (length > 0 && content[length - 1] == '\n')
+    length--;
+  return length;
+}
+
+void AddIntralineChanges(std::vector<LineDiff>* lineDiffs,
+                         IntralineMode mode) {
+  std::vector<IntralineLine> lines;
+  std::vector<size_t> indexes;
+  int hunk = -1;
+  int oldStart = -1, newStart = -1;
+  for (size_t i = 0; i < lineDiffs->size(); i++) {
+    const LineDiff& lineDiff = (*lineDiffs)[i];
+    char origin = lineDiff.line.origin;
+    if (origin != GIT_DIFF_LINE_ADDITION && origin != GIT_DIFF_LINE_DELETION)
+      continue;
+    if (lineDiff.hunk.old_start != oldStart ||
+        lineDiff.hunk.new_start != newStart) {
+      hunk++;
+      oldStart = lineDiff.hunk.old_start;
+      newStart = lineDiff.hunk.new_start;
+    }
+
+    IntralineLine line = {
+      hunk, origin == GIT_DIFF_LINE_ADDITION, lineDiff.content.data(),
+      ContentLength(lineDiff.content.data(), lineDiff.content.size())
+    };
+    lines.push_back(line);
+    indexes.push_back(i);
+  }
+
+  std::vector<std::vector<IntralineRange>> ranges;
+  DiffIntraline(lines, mode, &ranges);
+  for (size_t i = 0; i < lines.size(); i++) {
+    ToUtf16Ranges(lines[i].content, lines[i].length, &ranges[i]);
+    std::vector<int32_t>& changes = (*lineDiffs)[indexes[i]].changes;
+    for (size_t j = 0; j < ranges[i].size(); j++) {
+      changes.push_back(static_cast<int32_t>(ranges[i][j].start));
+      changes.push_back(static_cast<int32_t>(ranges[i][j].length));
+    }
+  }
+}
+
+Local<Value> ToLineDiffs(const std::vector<LineDiff>& lineDiffs,
+                         bool withChanges = false) {
+  Local<Object> v8Ranges = Nan::New<Array>(lineDiffs.size());
+  for (size_t i = 0; i < lineDiffs.size(); i++) {
+    Local<Object> v8Range = Nan::New<Object>();
+
+    v8Range->Set(Nan::New<String>("oldLineNumber").ToLocalChecked(),
+                 Nan::New<Number>(lineDiffs[i].line.old_lineno));
+    v8Range->Set(Nan::New<String>("newLineNumber").ToLocalChecked(),
+                 Nan::New<Number>(lineDiffs[i].line.new_lineno));
+    v8Range->Set(Nan::New<String>("oldStart").ToLocalChecked(),
+                 Nan::New<Number>(lineDiffs[i].hunk.old_start));
+    v8Range->Set(Nan::New<String>("newStart").ToLocalChecked(),
+                 Nan::New<Number>(lineDiffs[i].hunk.new_start));
+    v8Range->Set(Nan::New<String>("oldLines").ToLocalChecked(),
+                 Nan::New<Number>(lineDiffs[i].hunk.old_lines));
+    v8Range->Set(Nan::New<String>("newLines").ToLocalChecked(),
+                 Nan::New<Number>(lineDiffs[i].hunk.new_lines));
+    v8Range->Set(Nan::New<String>("line").ToLocalChecked(),
+                 Nan::New<String>(lineDiffs[i].content.data(),
+                                  lineDiffs[i].content.length())
+                                      .ToLocalChecked());
+    if (withChanges)
+      v8Range->Set(Nan::New<String>("changes").ToLocalChecked(),
+                   ToInt32Array(lineDiffs[i].changes));
+
+    v8Ranges->Set(i, v8Range);
+  }
+  return v8Ranges;
+}
+
+Local<Value> ToPackedHunks(const std::vector<git_diff_hunk>& ranges) {
+  std::vector<int32_t> values;
+  values.reserve(ranges.size() * 4);
+  for (size_t i = 0; i < ranges.size(); i++) {
+    values.push_back(ranges[i].old_start);
+    values.push_back(ranges[i].old_lines);
+    values.push_back(ranges[i].new_start);
+    values.push_back(ranges[i].new_lines);
+  }
+  return ToInt32Array(values);
+}
+
+// Line diffs as numbers only: hunks as [oldStart, oldLines, newStart,
+// newLines] and lines as [oldLineNumber, newLineNumber, hunk, contentOffset,
+// contentLength], the content staying where it is.
+struct PackedLineDiffs {
+  static const size_t LINE_FIELDS = 5;
+
+  std::vector<int32_t> hunks;
+  std::vector<int32_t> lines;
+  // [line, start, length] triples of the changed parts of lines, relative
+  // to the line's content, when asked for.
+  bool withIntraline = false;
+  std::vector<int32_t> intraline;
+};
+
+int PackedLineCallback(const git_diff_delta* delta,
+                       const git_diff_hunk* range,
+                       const git_diff_line* line, void* payload) {
+  PackedLineDiffs* packed = static_cast<PackedLineDiffs*>(payload);
+  size_t end = packed->hunks.size();
+  if (end == 0 || packed->hunks[end - 4] != range->old_start ||
+      packed->hunks[end - 2] != range->new_start) {
+    packed->hunks.push_back(range->old_start);
+    packed->hunks.push_back(range->old_lines);
+    packed->hunks.push_back(range->new_start);
+    packed->hunks.push_back(range->new_lines);
+  }
+
+  // The end of file newline markers have no content in either side.
+  bool hasContent = line->content_offset >= 0;
+  packed->lines.push_back(line->old_lineno);
+  packed->lines.push_back(line->new_lineno);
+  packed->lines.push_back(
+      static_cast<int32_t>(packed->hunks.size() / 4 - 1));
+  packed->lines.push_back(
+      hasContent ? static_cast<int32_t>(line->content_offset) : -1);
+  packed->lines.push_back(
+      hasContent ? static_cast<int32_t>(line->content_len) : 0);
+  return GIT_OK;
+}
+
+// Turn the UTF-8 byte offsets of the added lines of |packed| into UTF-16
+// offsets into the JS string |text| was read from.
+void ToUtf16Offsets(const char* text, size_t length, PackedLineDiffs* packed) {
+  const size_t FIELDS = PackedLineDiffs::LINE_FIELDS;
+  size_t byte = 0, unit = 0;
+  for (size_t i = 0; i + FIELDS <= packed->lines.size(); i += FIELDS) {
+    int32_t* line = &packed->lines[i];
+    if (line[0] != -1 || line[3] < 0)
+      continue;
+
+    size_t start = static_cast<size_t>(line[3]);
+    size_t end = start + static_cast<size_t>(line[4]);
+    if (start < byte)
+      byte = unit = 0;
+
+    size_t startUnit = 0;
+    for (; byte < end && byte < length; byte++) {
+      if (byte == start)
+        startUnit = unit;
+      unsigned char c = static_cast<unsigned char>(text[byte]);
+      // A unit per character, two for characters outside the BMP.
+      if ((c & 0xc0) != 0x80)
+        unit += c >= 0xf0 ? 2 : 1;
+    }
+    if (start == end)
+      startUnit = unit;
+    line[3] = static_cast<int32_t>(startUnit);
+    line[4] = static_cast<int32_t>(unit - startUnit);
+  }
+}
+
+// Diff the removed and added lines of |packed| against each other. Ranges
+// are in bytes, or in UTF-16 units for added lines of a non-ASCII string.
+void AddPackedIntraline(PackedLineDiffs* packed, git_blob* blob,
+                        const DiffText& text, IntralineMode mode) {
+  const size_t FIELDS = PackedLineDiffs::LINE_FIELDS;
+  const char* oldData = static_cast<const char*>(git_blob_rawcontent(blob));
+  size_t oldLength = static_cast<size_t>(git_blob_rawsize(blob));
+
+  std::vector<IntralineLine> lines;
+  std::vector<size_t> indexes;
+  for (size_t i = 0; i + FIELDS <= packed->lines.size(); i += FIELDS) {
+    const int32_t* line = &packed->lines[i];
+    bool added = line[0] == -1;
+    if ((line[0] != -1) == (line[1] != -1) || line[3] < 0)
+      continue;
+
+    const char* data = added ? text.Data() : oldData;
+    size_t length = added ? text.Length() : oldLength;
+    size_t offset = static_cast<size_t>(line[3]);
+    size_t contentLength = static_cast<size_t>(line[4]);
+    if (offset + contentLength > length)
+      continue;
+
+    IntralineLine intralineLine = {
+      line[2], added, data + offset,
+      ContentLength(data + offset, contentLength)
+    };
+    lines.push_back(intralineLine);
+    indexes.push_back(i / FIELDS);
+  }
+
+  std::vector<std::vector<IntralineRange>> ranges;
+  DiffIntraline(lines, mode, &ranges);
+  packed->withIntraline = true;
+  for (size_t i = 0; i < lines.size(); i++) {
+    if (lines[i].added && text.NeedsUtf16Offsets())
+      ToUtf16Ranges(lines[i].content, lines[i].length, &ranges[i]);
+    for (size_t j = 0; j < ranges[i].size(); j++) {
+      packed->intraline.push_back(static_cast<int32_t>(indexes[i]));
+      packed->intraline.push_back(static_cast<int32_t>(ranges[i][j].start));
+      packed->intraline.push_back(static_cast<int32_t>(ranges[i][j].length));
+    }
+  }
+}
+
+// Intraline ranges first, they need the byte offsets of the lines.
+void FinishPackedLineDiffs(PackedLineDiffs* packed, git_blob* blob,
+                           const DiffText& text, IntralineMode mode) {
+  if (mode != INTRALINE_NONE)
+    AddPackedIntraline(packed, blob, text, mode);
+  if (text.NeedsUtf16Offsets())
+    ToUtf16Offsets(text.Data(), text.Length(), packed);
+}
+
+// {hunks, lines, oldContent}, removed lines point into |oldContent|, a
+// Buffer over |blob| that takes ownership of it.
+Local<Value> ToPackedLineDiffs(const PackedLineDiffs& packed, git_blob* blob) {
+  Local<Object> result = Nan::New<Object>();
+  result->Set(Nan::New<String>("hunks").ToLocalChecked(),
+              ToInt32Array(packed.hunks));
+  result->Set(Nan::New<String>("lines").ToLocalChecked(),
+              ToInt32Array(packed.lines));
+  if (packed.withIntraline)
+    result->Set(Nan::New<String>("intraline").ToLocalChecked(),
+                ToInt32Array(packed.intraline));
+  result->Set(Nan::New<String>("oldContent").ToLocalChecked(),
+              ToBlobContent(blob, true));
+  return result;
+}
+
+NAN_METHOD(Repository::GetLineDiffDetails) {
+  Nan::HandleScope scope;
+  if (info.Length() < 2)
+    return info.GetReturnValue().Set(Nan::Null());
+
+  DiffText text(info[1]);
+
+  git_repository* repo = GetGitRepository(info);
+
+  git_blob* blob = NULL;
+
+  int getBlobResult = GetBlob(info, repo, blob);
+
+  if (getBlobResult != 0)
+    return info.GetReturnValue().Set(Nan::Null());
+
+  std::vector<LineDiff> lineDiffs;
+
+  // Set GIT_DIFF_IGNORE_WHITESPACE_EOL when ignoreEolWhitespace: true
+  git_diff_options options = CreateLineDiffOptions(
+      info.Length() >= 3 && GetBoolOption(info[2], "ignoreEolWhitespace"));
+
+  IntralineMode intraline = GetIntralineOption(info[2]);
+  if (IsPackedFormat(info[2])) {
+    PackedLineDiffs packed;
+    if (git_diff_blob_to_buffer(
+          blob, NULL, text.Data(), text.Length(), NULL, &options, NULL,
+          NULL, NULL, PackedLineCallback, &packed) != GIT_OK) {
+      git_blob_free(blob);
+      return info.GetReturnValue().Set(Nan::Null());
+    }
+    FinishPackedLineDiffs(&packed, blob, text, intraline);
+    return info.GetReturnValue().Set(ToPackedLineDiffs(packed, blob));
+  }
+
+  int diffStatus = git_diff_blob_to_buffer(
+      blob, NULL, text.Data(), text.Length(), NULL, &options, NULL, NULL,
+      NULL, DiffLineCallback, &lineDiffs);
+  git_blob_free(blob);
+
+  if (diffStatus != GIT_OK)
+    return info.GetReturnValue().Set(Nan::Null());
+  if (intraline != INTRALINE_NONE)
+    AddIntralineChanges(&lineDiffs, intraline);
+  return info.GetReturnValue().Set(
+      ToLineDiffs(lineDiffs, intraline != INTRALINE_NONE));
+}
+
+NAN_METHOD(Repository::CreateDiffSession) {
+  Nan::HandleScope scope;
+  if (info.Length() < 1)
+    return info.GetReturnValue().Set(Nan::Null());
+
+  std::string path(*String::Utf8Value(info[0]));
+  bool useIndex = GetBoolOption(info[1], "useIndex");
+  Repository* repo = GetRepository(info);
+
+  git_blob* blob = NULL;
+  if (LookupBlob(repo->repository, path, useIndex, blob,
+                 repo->headCache.get()) != GIT_OK || blob == NULL)
+    return info.GetReturnValue().Set(Nan::Null());
+
+  Local<Value> session = DiffSession::NewInstance(
+      blob, GetBoolOption(info[1], "ignoreEolWhitespace"));
+  git_blob_free(blob);
+  info.GetReturnValue().Set(session);
+}
+
+NAN_METHOD(Repository::GetReferences) {
+  Nan::HandleScope scope;
+
+  git_strarray strarray;
+  git_reference_list(&strarray, GetGitRepository(info));
+  auto references = ToReferences(&strarray);
+  git_strarray_free(&strarray);
+
+  info.GetReturnValue().Set(references);
+}
+
+int branch_checkout(git_repository* repo, const char* refName) {
+  git_reference* ref = NULL;
+  git_object* git_obj = NULL;
+  git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+  opts.checkout_strategy = GIT_CHECKOUT_SAFE;
+  int success = -1;
+
+  if (!(success = git_reference_lookup(&ref, repo, refName)) &&
+      !(success = git_reference_peel(&git_obj, ref, GIT_OBJ_TREE)) &&
+      !(success = git_checkout_tree(repo, git_obj, &opts)))
+    success = git_repository_set_head(repo, refName);
+
+  git_object_free(git_obj);
+  git_obj = NULL;
+  git_reference_free(ref);
+  ref = NULL;
+
+  return success;
+}
+
+int CheckoutReferenceByName(git_repository* repo, std::string strRefName,
+                            bool shouldCreateNewRef) {
+  std::string suffix;
+  std::string prefix = "refs/heads/";
+  if (strRefName.find(prefix) == 0) {
+    suffix = strRefName.substr(prefix.size());
+  } else {
+    suffix = strRefName;
+    strRefName = prefix.append(strRefName);
+  }
+  const char* refName = strRefName.c_str();
+
+  if (branch_checkout(repo, refName) == GIT_OK)
+    return GIT_OK;
+
+  if (!shouldCreateNewRef)
+    return -1;
+
+  git_reference* head;
+  if (git_repository_head(&head, repo) != GIT_OK)
+    return -1;
+
+  const git_oid* sha = git_reference_target(head);
+  git_commit* commit;
+  int commitStatus = git_commit_lookup(&commit, repo, sha);
+  git_reference_free(head);
+
+  if (commitStatus != GIT_OK)
+    return -1;
+
+  git_reference* branch;
+
+  // N.B.: git_branch_create needs a name like 'xxx', not 'refs/heads/xxx'
+
+  int branchCreateStatus = git_branch_create(
+      &branch, repo, suffix.c_str(), commit, 0);
+
+  git_commit_free(commit);
+
+  if (branchCreateStatus != GIT_OK)
+    return -1;
+
+  git_reference_free(branch);
+
+  return branch_checkout(repo, refName);
+}
+
+// Stage |path| into the index and write it back to disk. Returns NULL on
+// success or a fallback error message when libgit2 did not set one.
+const char* AddPathToIndex(git_repository* repository,
+                           const std::string& path) {
+  git_index* index;
+  if (git_repository_index(&index, repository) != GIT_OK)
+    return "Unknown error opening index";
+
+  // Modify the in-memory index.
+  if (git_index_add_bypath(index, path.c_str()) != GIT_OK) {
+    git_index_free(index);
+    return "Unknown error adding path to index";
+  }
+  // Write this change in the index back to disk, so it is persistent
+  if (git_index_write(index) != GIT_OK) {
+    git_index_free(index);
+    return "Unknown error adding path to index";
+  }
+  git_index_free(index);
+  return NULL;
+}
+
+// Commit the current index on top of HEAD. Returns NULL when the commit was
+// attempted, |created| tells whether it succeeded, or an error message when
+// one of the prerequisites could not be resolved.
+const char* CreateCommit(git_repository* repo, const std::string& message,
+                         const std::string& name, const std::string& email,
+                         bool* created) {
+  git_index *index;
+  git_reference *ref;
+  git_reference *direct_ref;
+  git_object *commitObj;
+  git_signature *s;
+  git_oid treeOid;
+  git_oid resOid;
+
+  if (git_repository_index(&index, repo) != GIT_OK)
+    return "Can't access index";
+
+  if (git_repository_head(&ref, repo) != GIT_OK) {
+    git_index_free(index);
+    return "Head not found";
+  }
+
+  if (git_reference_resolve(&direct_ref, ref) != GIT_OK) {
+    git_reference_free(ref);
+    git_index_free(index);
+    return "Can't resolve head";
+  }
+
+  if (git_reference_peel(&commitObj, direct_ref, GIT_OBJ_COMMIT) != GIT_OK) {
+    git_reference_free(direct_ref);
+    git_reference_free(ref);
+    git_index_free(index);
+    return "Can't find parent commit";
+  }
+
+  auto commitOid = git_object_id(commitObj);
+
+  git_signature_now(&s, name.c_str(), email.c_str());
+
+  git_index_write_tree(&treeOid, index);
+  *created = git_commit_create_from_callback(
+      &resOid, repo, "HEAD", s, s,
+      NULL, message.c_str(), &treeOid, OnSingleParentCommit,
+      (void*)commitOid) == GIT_OK;
+
+  git_reference_free(ref);
+  git_signature_free(s);
+  git_object_free(commitObj);
+  git_reference_free(direct_ref);
+  git_index_free(index);
+  return NULL;
+}
+
+NAN_METHOD(Repository::CheckoutReference) {
+  Nan::HandleScope scope;
+
+  if (info.Length() < 1)
+    return info.GetReturnValue().Set(Nan::New<Boolean>(false));
+
+  bool shouldCreateNewRef;
+  if (info.Length() > 1 && info[1]->BooleanValue())
+    shouldCreateNewRef = true;
+  else
+    shouldCreateNewRef = false;
+
+  std::string strRefName(*String::Utf8Value(info[0]));
+  int result = CheckoutReferenceByName(GetGitRepository(info), strRefName,
+                                       shouldCreateNewRef);
+  return info.GetReturnValue().Set(Nan::New<Boolean>(result == GIT_OK));
+}
+
+NAN_METHOD(Repository::Add) {
+  Nan::HandleScope scope;
+
+  git_repository* repository = GetGitRepository(info);
+  std::string path(*String::Utf8Value(info[0]));
+
+  const char* error = AddPathToIndex(repository, path);
+  if (error != NULL) {
+    const git_error* e = giterr_last();
+    if (e != NULL)
+      return Nan::ThrowError(e->message);
+    else
+      return Nan::ThrowError(error);
+  }
+  info.GetReturnValue().Set(Nan::New<Boolean>(true));
+}
+
+NAN_METHOD(Repository::Commit) {
+  Nan::HandleScope scope;
+
+  git_repository* repo = GetGitRepository(info);
+  std::string message(*String::Utf8Value(info[0]));
+  std::string name(*String::Utf8Value(info[1]));
+  std::string email(*String::Utf8Value(info[2]));
+
+  bool res = false;
+  const char* error = CreateCommit(repo, message, name, email, &res);
+  if (error != NULL)
+    return Nan::ThrowError(error);
+
+  info.GetReturnValue().Set(Nan::New<Boolean>(res));
+}
+
+NAN_METHOD(Repository::GetRemoteReferences) {
+  Nan::HandleScope scope;
+
+  auto repo = GetRepository(info);
+
+  RepositoryWork work =
+    [](git_repository* repository, Progress* progress) {
+      return RunOnRemote(
+        repository, ListRemoteRefs, nullptr, GIT_DIRECTION_FETCH);
+    };
+
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::BACKGROUND,
+    nullptr,
+    work,
+    GITERR_REPOSITORY,
+    "Could not load list of references from remote repository");
+}
+
+NAN_METHOD(Repository::GetStatusAsync) {
+  auto repo = GetRepository(info);
+  bool hasPath = info.Length() >= 1 && info[0]->IsString();
+  std::string path;
+  if (hasPath)
+    path = *String::Utf8Value(info[0]);
+
+  Local<Value> options = info[hasPath ? 1 : 0];
+  StatusScan scan = StatusScanner(options);
+  std::shared_ptr<StatusWatcher> watcher = repo->watcher;
+  bool packed = IsPackedFormat(options);
+  bool packDirectly = packed && !watcher && GetParallelOption(options) == 1;
+  int untrackedCache = GetUntrackedCacheOption(options);
+
+  RepositoryWork work =
+    [hasPath, path, scan, watcher, packed, packDirectly, untrackedCache](
+        git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
+
+      if (hasPath) {
+        unsigned int status = 0;
+        if (git_status_file(&status, repository, path.c_str())
+            != GIT_OK)
+          status = 0;
+        return FFL([status]() { return Nan::New<Number>(status); });
+      }
+
+      if (packDirectly) {
+        std::shared_ptr<PackedStatus> statuses(new PackedStatus());
+        if (ScanStatusPacked(repository, NULL, untrackedCache,
+                             statuses.get()) != GIT_OK)
+          return nullptr;
+        return FFL([statuses]() { return ToPackedStatus(*statuses); });
+      }
+
+      std::map<std::string, unsigned int> statuses;
+      int error = watcher ?
+        watcher->GetStatus(repository, scan, &statuses) :
+        scan(repository, NULL, &statuses);
+      if (error != GIT_OK)
+        return nullptr;
+      if (packed) {
+        std::shared_ptr<PackedStatus> packedStatuses(new PackedStatus());
+        PackStatuses(statuses, packedStatuses.get());
+        return FFL([packedStatuses]() {
+          return ToPackedStatus(*packedStatuses);
+        });
+      }
+      return FFL([statuses]() { return ToStatusObject(statuses); });
+    };
+
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_REPOSITORY,
+    "Could not get repository status");
+}
+
+NAN_METHOD(Repository::GetStatusForPathsAsync) {
+  auto repo = GetRepository(info);
+  std::vector<std::string> paths;
+  if (info.Length() >= 1)
+    paths = ToStringVector(info[0]);
+
+  bool packed = IsPackedFormat(info[1]);
+
+  RepositoryWork work =
+    [paths, packed](
+        git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
+
+      if (packed) {
+        std::shared_ptr<PackedStatus> statuses(new PackedStatus());
+        if (paths.size() > 0 &&
+            ScanStatusPacked(repository, &paths, -1, statuses.get())
+              != GIT_OK)
+          return nullptr;
+        return FFL([statuses]() { return ToPackedStatus(*statuses); });
+      }
+
+      std::map<std::string, unsigned int> statuses;
+      if (paths.size() > 0 &&
+          ScanStatus(repository, &paths, &statuses, 1, -1) != GIT_OK)
+        return nullptr;
+      return FFL([statuses]() { return ToStatusObject(statuses); });
+    };
+
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_REPOSITORY,
+    "Could not get status for paths");
+}
+
+NAN_METHOD(Repository::CheckoutHeadAsync) {
+  auto repo = GetRepository(info);
+  bool hasPath = info.Length() >= 1;
+  std::string path;
+  if (hasPath)
+    path = *String::Utf8Value(info[0]);
+
+  RepositoryWork work =
+    [hasPath, path](
+        git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
+
+      bool result = hasPath &&
+        CheckoutHeadPath(repository, path) == GIT_OK;
+      return FFL([result]() { return Nan::New<Boolean>(result); });
+    };
+
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::EXCLUSIVE,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_REPOSITORY,
+    "Could not checkout path");
+}
+
+NAN_METHOD(Repository::GetDiffStatsAsync) {
+  auto repo = GetRepository(info);
+  std::shared_ptr<HeadCache> headCache = repo->headCache;
+
+  if (info.Length() >= 1 && (info[0]->IsArray() || info[0]->IsNull())) {
+    bool all = info[0]->IsNull();
+    std::vector<std::string> paths = ToStringVector(info[0]);
+    bool packed = IsPackedFormat(info[1]);
+    size_t threads = GetDiffStatsThreads(info[1]);
+
+    RepositoryWork work =
+      [all, paths, packed, threads, headCache](
+          git_repository* repository, Progress* progress) -> GetResult {
+        if (repository == NULL)
+          return nullptr;
+
+        auto stats = std::make_shared<std::vector<NumStat>>();
+        if (DiffStatsForPaths(repository, all ? NULL : &paths,
+                              headCache.get(), threads, stats.get())
+            != GIT_OK)
+          stats->clear();
+        return FFL([stats, packed]() { return ToNumStats(*stats, packed); });
+      };
+
+    GitWorker::RunAsync(
+      &info,
+      &repo->queue,
+      WorkQueue::READ_ONLY,
+      Scheduler::INTERACTIVE,
+      nullptr,
+      work,
+      GITERR_REPOSITORY,
+      "Could not get diff stats");
+    return;
+  }
+
+  bool hasPath = info.Length() >= 1;
+  std::string path;
+  if (hasPath)
+    path = *String::Utf8Value(info[0]);
+
+  RepositoryWork work =
+    [hasPath, path, headCache](
+        git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
+
+      int added = 0;
+      int deleted = 0;
+      if (hasPath)
+        DiffStatsForPath(repository, path, &added, &deleted, headCache.get());
+      return FFL([added, deleted]() { return ToDiffStats(added, deleted); });
+    };
+
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_REPOSITORY,
+    "Could not get diff stats");
+}
+
+void RunBlobAsync(Nan::NAN_METHOD_ARGS_TYPE info, Repository* repo,
+                  bool useIndex) {
+  bool hasPath = info.Length() >= 1;
+  std::string path;
+  if (hasPath)
+    path = *String::Utf8Value(info[0]);
+
+  bool asBuffer = GetBoolOption(info[1], "asBuffer");
+  std::shared_ptr<HeadCache> headCache = repo->headCache;
+
+  RepositoryWork work =
+    [hasPath, path, useIndex, asBuffer, headCache](
+        git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
+
+      git_blob* blob = NULL;
+      if (!hasPath ||
+          Repository::LookupBlob(
+            repository, path, useIndex, blob, headCache.get()) != GIT_OK)
+        return FFL([]() { return Nan::Null(); });
+
+      return FFL([blob, asBuffer]() { return ToBlobContent(blob, asBuffer); });
+    };
+
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_REPOSITORY,
+    "Could not read blob");
+}
+
+NAN_METHOD(Repository::GetHeadBlobAsync) {
+  RunBlobAsync(info, GetRepository(info), false);
+}
+
+NAN_METHOD(Repository::GetIndexBlobAsync) {
+  RunBlobAsync(info, GetRepository(info), true);
+}
+
+NAN_METHOD(Repository::GetHeadBlobs) {
+  RunBlobsAsync(info, GetRepository(info), false);
+}
+
+NAN_METHOD(Repository::GetIndexBlobs) {
+  RunBlobsAsync(info, GetRepository(info), true);
+}
+
+NAN_METHOD(Repository::GetHeadBlobStream) {
+  RunBlobStreamAsync(info, GetRepository(info), false);
+}
+
+NAN_METHOD(Repository::GetIndexBlobStream) {
+  RunBlobStreamAsync(info, GetRepository(info), true);
+}
+
+NAN_METHOD(Repository::GetTreeDiffStream) {
+  if (info.Length() < 3 || !info[2]->IsFunction())
+    return Nan::ThrowTypeError("A file callback is required");
+
+  auto repo = GetRepository(info);
+  std::string oldSpec;
+  std::string newSpec;
+  if (!info[0]->IsNull() && !info[0]->IsUndefined())
+    oldSpec = *String::Utf8Value(info[0]);
+  if (!info[1]->IsNull() && !info[1]->IsUndefined())
+    newSpec = *String::Utf8Value(info[1]);
+  Callback* onFile = new Callback(Local<Function>::Cast(info[2]));
+  TreeDiffOptions options = GetTreeDiffOptions(info[3]);
+
+  RepositoryWork work =
+    [oldSpec, newSpec, options](
+        git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
+
+      git_tree* oldTree;
+      git_tree* newTree;
+      if (LookupSpecTree(repository, oldSpec, &oldTree) != GIT_OK)
+        return nullptr;
+      if (LookupSpecTree(repository, newSpec, &newTree) != GIT_OK) {
+        git_tree_free(oldTree);
+        return nullptr;
+      }
+
+      // PushChunk blocks while JS is behind, only a few batches of files
+      // are ever held in memory.
+      bool statsOnly = options.statsOnly;
+      TreeDiffSink sink =
+        [progress, statsOnly](const std::shared_ptr<TreeDiffFile>& file) {
+          return progress->PushChunk(FFL([file, statsOnly]() {
+            return ToTreeDiffFile(*file, statsOnly);
+          }));
+        };
+      size_t count = 0;
+      int error = DiffTrees(repository, oldTree, newTree, options, sink,
+                            &count);
+      git_tree_free(oldTree);
+      git_tree_free(newTree);
+      if (error != GIT_OK)
+        return nullptr;
+
+      double files = static_cast<double>(count);
+      return FFL([files]() { return Nan::New<Number>(files); });
+    };
+
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::INTERACTIVE,
+    onFile,
+    work,
+    GITERR_REPOSITORY,
+    "Could not diff trees");
+}
+
+NAN_METHOD(Repository::GetCommitCountAsync) {
+  auto repo = GetRepository(info);
+  bool hasCommits = info.Length() >= 2;
+  std::string fromCommitId, toCommitId;
+  if (hasCommits) {
+    fromCommitId = *String::Utf8Value(info[0]);
+    toCommitId = *String::Utf8Value(info[1]);
+  }
+  ScheduleCommitGraphBuild(repo);
+  std::shared_ptr<CommitGraph> commitGraph = repo->commitGraph;
+
+  RepositoryWork work =
+    [hasCommits, fromCommitId, toCommitId, commitGraph](
+        git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
+
+      int count = hasCommits ? CountCommits(repository, fromCommitId,
+                                            toCommitId, commitGraph.get()) : 0;
+      return FFL([count]() { return Nan::New<Number>(count); });
+    };
+
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_REPOSITORY,
+    "Could not count commits");
+}
+
+NAN_METHOD(Repository::GetMergeBaseAsync) {
+  auto repo = GetRepository(info);
+  bool hasCommits = info.Length() >= 2;
+  std::string commitOneId, commitTwoId;
+  if (hasCommits) {
+    commitOneId = *String::Utf8Value(info[0]);
+    commitTwoId = *String::Utf8Value(info[1]);
+  }
+  ScheduleCommitGraphBuild(repo);
+  std::shared_ptr<CommitGraph> commitGraph = repo->commitGraph;
+
+  RepositoryWork work =
+    [hasCommits, commitOneId, commitTwoId, commitGraph](
+        git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
+
+      git_oid mergeBase;
+      if (!hasCommits ||
+          FindMergeBase(repository, commitOneId, commitTwoId, &mergeBase,
+                        commitGraph.get()) != GIT_OK)
+        return FFL([]() { return Nan::Null(); });
+
+      return FFL([mergeBase]() { return ToOidString(&mergeBase); });
+    };
+
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_REPOSITORY,
+    "Could not find merge base");
+}
+
+NAN_METHOD(Repository::GetAheadBehindCounts) {
+  auto repo = GetRepository(info);
+  bool all = info.Length() < 1 || info[0]->IsNull() ||
+    info[0]->IsUndefined();
+  std::vector<std::string> names = ToStringVector(info[0]);
+  if (info[0]->IsString())
+    names.push_back(*String::Utf8Value(info[0]));
+  ScheduleCommitGraphBuild(repo);
+  std::shared_ptr<CommitGraph> commitGraph = repo->commitGraph;
+
+  RepositoryWork work =
+    [all, names, commitGraph](
+        git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
+
+      auto tracked = std::make_shared<std::vector<TrackedBranch>>();
+      if (FindTrackedBranches(repository, all ? NULL : &names,
+                              tracked.get()) != GIT_OK ||
+          CountAheadBehind(repository, tracked.get(), commitGraph.get())
+            != GIT_OK)
+        return nullptr;
+
+      return FFL([tracked]() {
+        Local<Object> result = Nan::New<Object>();
+        for (size_t i = 0; i < tracked->size(); i++) {
+          const TrackedBranch& branch = (*tracked)[i];
+          Local<Object> counts = Local<Object>::Cast(
+              ToAheadBehind(branch.ahead, branch.behind));
+          counts->Set(Nan::New<String>("upstream").ToLocalChecked(),
+                      Nan::New<String>(branch.upstream).ToLocalChecked());
+          result->Set(Nan::New<String>(branch.name).ToLocalChecked(),
+                      counts);
+        }
+        return result;
+      });
+    };
+
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_REPOSITORY,
+    "Could not count ahead and behind commits");
+}
+
+NAN_METHOD(Repository::GetPathHistory) {
+  auto repo = GetRepository(info);
+  std::string path(*String::Utf8Value(info[0]));
+  std::string from("HEAD");
+  size_t limit = 100;
+  if (info[1]->IsObject()) {
+    Local<Object> options = Local<Object>::Cast(info[1]);
+    Local<Value> fromValue =
+      options->Get(Nan::New<String>("from").ToLocalChecked());
+    if (fromValue->IsString())
+      from = *String::Utf8Value(fromValue);
+    Local<Value> limitValue =
+      options->Get(Nan::New<String>("limit").ToLocalChecked());
+    if (limitValue->IsNumber() && limitValue->NumberValue() >= 1)
+      limit = static_cast<size_t>(limitValue->NumberValue());
+  }
+  ScheduleChangedPathsBuild(repo);
+  std::shared_ptr<ChangedPaths> changedPaths = repo->changedPaths;
+
+  RepositoryWork work =
+    [path, from, limit, changedPaths](
+        git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
+
+      git_object* object;
+      if (git_revparse_single(&object, repository, from.c_str()) != GIT_OK)
+        return nullptr;
+      git_object* commit;
+      int error = git_object_peel(&commit, object, GIT_OBJ_COMMIT);
+      git_object_free(object);
+      if (error != GIT_OK)
+        return nullptr;
+
+      auto commits = std::make_shared<std::vector<git_oid>>();
+      error = PathHistory(repository, changedPaths.get(),
+                          git_object_id(commit), path, limit, commits.get());
+      git_object_free(commit);
+      if (error != GIT_OK)
+        return nullptr;
+
+      return FFL([commits]() {
+        Local<Array> result = Nan::New<Array>(commits->size());
+        for (size_t i = 0; i < commits->size(); i++)
+          result->Set(i, ToOidString(&(*commits)[i]));
+        return result;
+      });
+    };
+
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_REPOSITORY,
+    "Could not read path history");
+}
+
+// Parse the options of getLog. False when the cursor isn't one getLog
+// returned.
+bool GetLogOptions(Local<Value> value, LogOptions* options,
+                   std::string* range, bool* resume) {
+  *resume = false;
+  if (!value->IsObject())
+    return true;
+
+  Local<Object> object = Local<Object>::Cast(value);
+  Local<Value> limit = object->Get(Nan::New<String>("limit").ToLocalChecked());
+  if (limit->IsNumber() && limit->NumberValue() >= 1)
+    options->limit = static_cast<size_t>(limit->NumberValue());
+  Local<Value> batchSize =
+    object->Get(Nan::New<String>("batchSize").ToLocalChecked());
+  if (batchSize->IsNumber() && batchSize->NumberValue() >= 1)
+    options->batchSize = static_cast<size_t>(batchSize->NumberValue());
+
+  std::vector<std::string> fields = ToStringVector(
+      object->Get(Nan::New<String>("fields").ToLocalChecked()));
+  for (size_t i = 0; i < fields.size(); i++) {
+    if (fields[i] == "parents")
+      options->fields |= LOG_PARENTS;
+    else if (fields[i] == "author")
+      options->fields |= LOG_AUTHOR;
+    else if (fields[i] == "committer")
+      options->fields |= LOG_COMMITTER;
+    else if (fields[i] == "summary")
+      options->fields |= LOG_SUMMARY;
+    else if (fields[i] == "message")
+      options->fields |= LOG_MESSAGE;
+  }
+
+  // A cursor carries the range and order of the first page.
+  Local<Value> cursor =
+    object->Get(Nan::New<String>("cursor").ToLocalChecked());
+  if (cursor->IsString()) {
+    *resume = true;
+    return DecodeLogCursor(*String::Utf8Value(cursor), options);
+  }
+
+  Local<Value> rangeValue =
+    object->Get(Nan::New<String>("range").ToLocalChecked());
+  if (rangeValue->IsString())
+    *range = *String::Utf8Value(rangeValue);
+  Local<Value> order =
+    object->Get(Nan::New<String>("order").ToLocalChecked());
+  if (order->IsString()) {
+    std::string name(*String::Utf8Value(order));
+    if (name == "topological")
+      options->sort = GIT_SORT_TOPOLOGICAL;
+    else if (name == "none")
+      options->sort = GIT_SORT_NONE;
+  }
+  if (GetBoolOption(value, "reverse"))
+    options->sort |= GIT_SORT_REVERSE;
+  return true;
+}
+
+Local<Value> ToLogSignature(const LogSignature& signature) {
+  Local<Object> result = Nan::New<Object>();
+  result->Set(Nan::New<String>("name").ToLocalChecked(),
+              Nan::New<String>(signature.name).ToLocalChecked());
+  result->Set(Nan::New<String>("email").ToLocalChecked(),
+              Nan::New<String>(signature.email).ToLocalChecked());
+  result->Set(Nan::New<String>("time").ToLocalChecked(),
+              Nan::New<Number>(static_cast<double>(signature.time)));
+  result->Set(Nan::New<String>("offset").ToLocalChecked(),
+              Nan::New<Number>(signature.offset));
+  return result;
+}
+
+Local<Value> ToLogCommit(const LogCommit& commit, uint32_t fields) {
+  Local<Object> result = Nan::New<Object>();
+  result->Set(Nan::New<String>("id").ToLocalChecked(),
+              ToOidString(&commit.id));
+  if (fields & LOG_PARENTS) {
+    Local<Array> parents = Nan::New<Array>(commit.parents.size());
+    for (size_t i = 0; i < commit.parents.size(); i++)
+      parents->Set(i, ToOidString(&commit.parents[i]));
+    result->Set(Nan::New<String>("parents").ToLocalChecked(), parents);
+  }
+  if (fields & LOG_AUTHOR)
+    result->Set(Nan::New<String>("author").ToLocalChecked(),
+                ToLogSignature(commit.author));
+  if (fields & LOG_COMMITTER)
+    result->Set(Nan::New<String>("committer").ToLocalChecked(),
+                ToLogSignature(commit.committer));
+  if (fields & LOG_SUMMARY)
+    result->Set(Nan::New<String>("summary").ToLocalChecked(),
+                Nan::New<String>(commit.summary).ToLocalChecked());
+  if (fields & LOG_MESSAGE)
+    result->Set(Nan::New<String>("message").ToLocalChecked(),
+                Nan::New<String>(commit.message).ToLocalChecked());
+  return result;
+}
+
+NAN_METHOD(Repository::GetLog) {
+  if (info.Length() < 1 || !info[0]->IsFunction())
+    return Nan::ThrowTypeError("A commits callback is required");
+
+  LogOptions options;
+  std::string range;
+  bool resume;
+  if (!GetLogOptions(info[1], &options, &range, &resume))
+    return Nan::ThrowTypeError("Invalid log cursor");
+
+  auto repo = GetRepository(info);
+  std::shared_ptr<LogWalks> logWalks = repo->logWalks;
+  Callback* onCommits = new Callback(Local<Function>::Cast(info[0]));
+
+  RepositoryWork work =
+    [options, range, resume, logWalks](
+        git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
+
+      LogOptions page(options);
+      if (!resume && ResolveLogRange(repository, range, &page) != GIT_OK)
+        return nullptr;
+
+      uint32_t fields = page.fields;
+      LogBatchSink sink =
+        [progress, fields](const std::shared_ptr<std::vector<LogCommit>>&
+                             commits) {
+          return progress->PushChunk(FFL([commits, fields]() {
+            Local<Array> result = Nan::New<Array>(commits->size());
+            for (size_t i = 0; i < commits->size(); i++)
+              result->Set(i, ToLogCommit((*commits)[i], fields));
+            return result;
+          }));
+        };
+      size_t delivered;
+      bool more;
+      if (logWalks->Walk(repository, page, sink, &delivered, &more)
+            != GIT_OK)
+        return nullptr;
+
+      if (!more)
+        return FFL([]() { return Nan::Null(); });
+      page.offset += delivered;
+      std::string cursor = EncodeLogCursor(page);
+      return FFL([cursor]() {
+        return Nan::New<String>(cursor).ToLocalChecked();
+      });
+    };
+
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::INTERACTIVE,
+    onCommits,
+    work,
+    GITERR_REPOSITORY,
+    "Could not read log");
+}
+
+NAN_METHOD(Repository::GetCommits) {
+  auto repo = GetRepository(info);
+  std::vector<std::string> names = ToStringVector(info[0]);
+  std::vector<git_oid> ids(names.size());
+  std::vector<bool> valid(names.size());
+  for (size_t i = 0; i < names.size(); i++)
+    valid[i] = names[i].size() == GIT_OID_HEXSZ &&
+      git_oid_fromstr(&ids[i], names[i].c_str()) == GIT_OK;
+  size_t threads = 0;
+  if (info[1]->IsObject() &&
+      !Local<Object>::Cast(info[1])->Get(
+        Nan::New<String>("parallel").ToLocalChecked())->IsUndefined())
+    threads = GetParallelOption(info[1]);
+  std::shared_ptr<CommitCache> commitCache = repo->commitCache;
+
+  RepositoryWork work =
+    [ids, valid, threads, commitCache](
+        git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
+
+      // Malformed ids are left out of the lookup and come back as null.
+      std::vector<git_oid> lookup;
+      for (size_t i = 0; i < ids.size(); i++)
+        if (valid[i])
+          lookup.push_back(ids[i]);
+      std::vector<std::shared_ptr<const LogCommit>> found;
+      if (commitCache->Lookup(repository, lookup, threads, &found) != GIT_OK)
+        return nullptr;
+
+      auto commits =
+        std::make_shared<std::vector<std::shared_ptr<const LogCommit>>>(
+          ids.size());
+      for (size_t i = 0, next = 0; i < ids.size(); i++)
+        if (valid[i])
+          (*commits)[i] = found[next++];
+
+      return FFL([commits]() {
+        uint32_t fields = LOG_PARENTS | LOG_AUTHOR | LOG_COMMITTER |
+          LOG_SUMMARY | LOG_MESSAGE;
+        Local<Array> result = Nan::New<Array>(commits->size());
+        for (size_t i = 0; i < commits->size(); i++) {
+          if ((*commits)[i])
+            result->Set(i, ToLogCommit(*(*commits)[i], fields));
+          else
+            result->Set(i, Nan::Null());
+        }
+        return result;
+      });
+    };
+
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_REPOSITORY,
+    "Could not read commits");
+}
+
+NAN_METHOD(Repository::GetCommitCacheStats) {
+  Nan::HandleScope scope;
+  Repository* repo = GetRepository(info);
+  CommitCache::Stats stats = { 0, 0, 0, 0 };
+  if (repo->commitCache)
+    stats = repo->commitCache->GetStats();
+  Local<Object> result = Nan::New<Object>();
+  result->Set(Nan::New<String>("hits").ToLocalChecked(),
+              Nan::New<Number>(static_cast<double>(stats.hits)));
+  result->Set(Nan::New<String>("misses").ToLocalChecked(),
+              Nan::New<Number>(static_cast<double>(stats.misses)));
+  result->Set(Nan::New<String>("entries").ToLocalChecked(),
+              Nan::New<Number>(static_cast<double>(stats.entries)));
+  result->Set(Nan::New<String>("bytes").ToLocalChecked(),
+              Nan::New<Number>(static_cast<double>(stats.bytes)));
+  info.GetReturnValue().Set(result);
+}
+
+// Key of a latest-wins line diff request, a request only supersedes the
+// ones asking for the same kind of result against the same blob.
+std::string LineDiffRequestKey(const char* kind, const std::string& path,
+                               bool useIndex) {
+  return std::string(kind) + (useIndex ? ":index:" : ":head:") + path;
+}
+
+// Payload of the line diff callbacks of a latest-wins request. The diff
+// stops at the next callback once a newer request for the key came in.
+struct LatestDiffPayload {
+  std::shared_ptr<LatestRequests> requests;
+  std::string key;
+  uint64_t ticket;
+  bool superseded;
+
+  bool Superseded() {
+    if (!superseded && !requests->IsLatest(key, ticket))
+      superseded = true;
+    return superseded;
+  }
+};
+
+struct LatestHunksPayload : LatestDiffPayload {
+  std::vector<git_diff_hunk> ranges;
+};
+
+struct LatestLinesPayload : LatestDiffPayload {
+  bool asPacked;
+  std::vector<LineDiff> lineDiffs;
+  PackedLineDiffs packed;
+};
+
+int LatestHunkCallback(const git_diff_delta* delta,
+                       const git_diff_hunk* range, void* payload) {
+  LatestHunksPayload* latest = static_cast<LatestHunksPayload*>(payload);
+  if (latest->Superseded())
+    return GIT_EUSER;
+  latest->ranges.push_back(*range);
+  return GIT_OK;
+}
+
+int LatestLineCallback(const git_diff_delta* delta,
+                       const git_diff_hunk* range,
+                       const git_diff_line* line, void* payload) {
+  LatestLinesPayload* latest = static_cast<LatestLinesPayload*>(payload);
+  if (latest->Superseded())
+    return GIT_EUSER;
+  if (latest->asPacked)
+    return PackedLineCallback(delta, range, line, &latest->packed);
+  LineDiff lineDiff;
+  lineDiff.hunk = *range;
+  lineDiff.line = *line;
+  lineDiff.content.assign(line->content, line->content_len);
+  latest->lineDiffs.push_back(lineDiff);
+  return GIT_OK;
+}
+
+// Look up the blob of a latest-wins request. Sets |blob| to NULL when the
+// path has no blob, returns false when the request was superseded.
+bool LookupLatestBlob(git_repository* repository, const std::string& path,
+                      bool useIndex, HeadCache* headCache,
+                      LatestDiffPayload* latest, git_blob** blob) {
+  *blob = NULL;
+  if (latest->Superseded()) {
+    latest->requests->Drop();
+    return false;
+  }
+  if (Repository::LookupBlob(repository, path, useIndex, *blob, headCache)
+      != GIT_OK)
+    *blob = NULL;
+  if (latest->Superseded()) {
+    git_blob_free(*blob);
+    *blob = NULL;
+    latest->requests->Drop();
+    return false;
+  }
+  return true;
+}
+
+NAN_METHOD(Repository::GetLineDiffsAsync) {
+  auto repo = GetRepository(info);
+  bool hasText = info.Length() >= 2;
+  std::string path;
+  // Lives as long as the worker holding the work, which is destroyed on the
+  // main thread.
+  std::shared_ptr<DiffText> text;
+  bool useIndex = false, ignoreEolWhitespace = false;
+  if (hasText) {
+    path = *String::Utf8Value(info[0]);
+    text = std::make_shared<DiffText>(info[1]);
+  }
+  if (info.Length() >= 3) {
+    useIndex = GetBoolOption(info[2], "useIndex");
+    ignoreEolWhitespace = GetBoolOption(info[2], "ignoreEolWhitespace");
+  }
+
+  std::shared_ptr<HeadCache> headCache = repo->headCache;
+  std::shared_ptr<LatestRequests> requests = repo->lineDiffRequests;
+  std::string key = LineDiffRequestKey("hunks", path, useIndex);
+  uint64_t ticket = requests->Take(key);
+  bool packed = IsPackedFormat(info[2]);
+
+  RepositoryWork work =
+    [hasText, path, text, useIndex, ignoreEolWhitespace, headCache, requests,
+     key, ticket, packed](
+        git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
+
+      LatestHunksPayload latest;
+      latest.requests = requests;
+      latest.key = key;
+      latest.ticket = ticket;
+      latest.superseded = false;
+
+      git_blob* blob = NULL;
+      if (!LookupLatestBlob(repository, path, useIndex, headCache.get(),
+                            &latest, &blob))
+        return FFL([]() { return Nan::Null(); });
+      if (!hasText || blob == NULL) {
+        requests->Complete();
+        return FFL([]() { return Nan::Null(); });
+      }
+
+      git_diff_options options = CreateLineDiffOptions(ignoreEolWhitespace);
+      int diffStatus = git_diff_blob_to_buffer(
+          blob, NULL, text->Data(), text->Length(), NULL, &options, NULL, NULL,
+          LatestHunkCallback, NULL, &latest);
+      git_blob_free(blob);
+      if (latest.superseded) {
+        requests->Cancel();
+        return FFL([]() { return Nan::Null(); });
+      }
+      if (diffStatus != GIT_OK)
+        return nullptr;
+
+      requests->Complete();
+      std::vector<git_diff_hunk> ranges;
+      ranges.swap(latest.ranges);
+      return FFL([ranges, packed]() {
+        return packed ? ToPackedHunks(ranges) : ToHunks(ranges);
+      });
+    };
+
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_REPOSITORY,
+    "Could not diff lines");
+}
+
+NAN_METHOD(Repository::GetLineDiffDetailsAsync) {
+  auto repo = GetRepository(info);
+  bool hasText = info.Length() >= 2;
+  std::string path;
+  // Lives as long as the worker holding the work, which is destroyed on the
+  // main thread.
+  std::shared_ptr<DiffText> text;
+  bool useIndex = false, ignoreEolWhitespace = false;
+  if (hasText) {
+    path = *String::Utf8Value(info[0]);
+    text = std::make_shared<DiffText>(info[1]);
+  }
+  if (info.Length() >= 3) {
+    useIndex = GetBoolOption(info[2], "useIndex");
+    ignoreEolWhitespace = GetBoolOption(info[2], "ignoreEolWhitespace");
+  }
+
+  std::shared_ptr<HeadCache> headCache = repo->headCache;
+  std::shared_ptr<LatestRequests> requests = repo->lineDiffRequests;
+  std::string key = LineDiffRequestKey("lines", path, useIndex);
+  uint64_t ticket = requests->Take(key);
+  bool packed = IsPackedFormat(info[2]);
+  IntralineMode intraline = GetIntralineOption(info[2]);
+
+  RepositoryWork work =
+    [hasText, path, text, useIndex, ignoreEolWhitespace, headCache, requests,
+     key, ticket, packed, intraline](
+        git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
+
+      LatestLinesPayload latest;
+      latest.requests = requests;
+      latest.key = key;
+      latest.ticket = ticket;
+      latest.superseded = false;
+      latest.asPacked = packed;
+
+      git_blob* blob = NULL;
+      if (!LookupLatestBlob(repository, path, useIndex, headCache.get(),
+                            &latest, &blob))
+        return FFL([]() { return Nan::Null(); });
+      if (!hasText || blob == NULL) {
+        requests->Complete();
+        return FFL([]() { return Nan::Null(); });
+      }
+
+      git_diff_options options = CreateLineDiffOptions(ignoreEolWhitespace);
+      int diffStatus = git_diff_blob_to_buffer(
+          blob, NULL, text->Data(), text->Length(), NULL, &options, NULL, NULL,
+          NULL, LatestLineCallback, &latest);
+      if (!packed || latest.superseded || diffStatus != GIT_OK)
+        git_blob_free(blob);
+      if (latest.superseded) {
+        requests->Cancel();
+        return FFL([]() { return Nan::Null(); });
+      }
+      if (diffStatus != GIT_OK)
+        return nullptr;
+
+      requests->Complete();
+      if (packed) {
+        std::shared_ptr<PackedLineDiffs> lines(new PackedLineDiffs());
+        lines->hunks.swap(latest.packed.hunks);
+        lines->lines.swap(latest.packed.lines);
+        FinishPackedLineDiffs(lines.get(), blob, *text, intraline);
+        return FFL([lines, blob]() {
+          return ToPackedLineDiffs(*lines, blob);
+        });
+      }
+      std::vector<LineDiff> lineDiffs;
+      lineDiffs.swap(latest.lineDiffs);
+      bool withChanges = intraline != INTRALINE_NONE;
+      if (withChanges)
+        AddIntralineChanges(&lineDiffs, intraline);
+      return FFL([lineDiffs, withChanges]() {
+        return ToLineDiffs(lineDiffs, withChanges);
+      });
+    };
+
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_REPOSITORY,
+    "Could not diff lines");
 }
 
-struct LineDiff {
-  git_diff_hunk hunk;
-  git_diff_line line;
-};
+NAN_METHOD(Repository::GetLineDiffStats) {
+  Nan::HandleScope scope;
+  LatestRequests::Stats stats =
+      GetRepository(info)->lineDiffRequests->GetStats();
 
-int Repository::DiffLineCallback(const git_diff_delta* delta,
-                                 const git_diff_hunk* range,
-                                 const git_diff_line* line,
-                                 void* payload) {
-  LineDiff lineDiff;
-  lineDiff.hunk = *range;
-  lineDiff.line = *line;
-  std::vector<LineDiff> * lineDiffs =
-      static_cast<std::vector<LineDiff>*>(payload);
-  lineDiffs->push_back(lineDiff);
-  return GIT_OK;
+  Local<Object> result = Nan::New<Object>();
+  result->Set(Nan::New<String>("requested").ToLocalChecked(),
+              Nan::New<Number>(static_cast<double>(stats.requested)));
+  result->Set(Nan::New<String>("dropped").ToLocalChecked(),
+              Nan::New<Number>(static_cast<double>(stats.dropped)));
+  result->Set(Nan::New<String>("cancelled").ToLocalChecked(),
+              Nan::New<Number>(static_cast<double>(stats.cancelled)));
+  result->Set(Nan::New<String>("completed").ToLocalChecked(),
+              Nan::New<Number>(static_cast<double>(stats.completed)));
+  info.GetReturnValue().Set(result);
 }
 
-NAN_METHOD(Repository::GetLineDiffDetails) {
-  Nan::HandleScope scope;
-  if (info.Length() < 2)
-    return info.GetReturnValue().Set(Nan::Null());
+NAN_METHOD(Repository::CheckoutReferenceAsync) {
+  auto repo = GetRepository(info);
+  bool hasRef = info.Length() >= 1;
+  std::string refName;
+  if (hasRef)
+    refName = *String::Utf8Value(info[0]);
+  bool shouldCreateNewRef = info.Length() > 1 && info[1]->BooleanValue();
+
+  RepositoryWork work =
+    [hasRef, refName, shouldCreateNewRef](
+        git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
+
+      bool result = hasRef && CheckoutReferenceByName(
+        repository, refName, shouldCreateNewRef) == GIT_OK;
+      return FFL([result]() { return Nan::New<Boolean>(result); });
+    };
 
-  std::string text(*String::Utf8Value(info[1]));
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::EXCLUSIVE,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_REFERENCE,
+    "Could not checkout reference");
+}
 
-  git_repository* repo = GetGitRepository(info);
+NAN_METHOD(Repository::AddAsync) {
+  auto repo = GetRepository(info);
+  std::string path(*String::Utf8Value(info[0]));
 
-  git_blob* blob = NULL;
+  RepositoryWork work =
+    [path](git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL ||
+          AddPathToIndex(repository, path) != NULL)
+        return nullptr;
 
-  int getBlobResult = GetBlob(info, repo, blob);
+      return FFL([]() { return Nan::New<Boolean>(true); });
+    };
 
-  if (getBlobResult != 0)
-    return info.GetReturnValue().Set(Nan::Null());
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::EXCLUSIVE,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_INDEX,
+    "Unknown error adding path to index");
+}
 
-  std::vector<LineDiff> lineDiffs;
-  git_diff_options options = CreateDefaultGitDiffOptions();
+NAN_METHOD(Repository::CommitAsync) {
+  auto repo = GetRepository(info);
+  std::string message(*String::Utf8Value(info[0]));
+  std::string name(*String::Utf8Value(info[1]));
+  std::string email(*String::Utf8Value(info[2]));
 
-  // Set GIT_DIFF_IGNORE_WHITESPACE_EOL when ignoreEolWhitespace: true
-  if (info.Length() >= 3) {
-    Local<Object> optionsArg(Local<Object>::Cast(info[2]));
-    Local<Value> ignoreEolWhitespace;
-    ignoreEolWhitespace = optionsArg->Get(
-        Nan::New<String>("ignoreEolWhitespace").ToLocalChecked());
+  RepositoryWork work =
+    [message, name, email](
+        git_repository* repository, Progress* progress) -> GetResult {
+      bool created = false;
+      if (repository == NULL ||
+          CreateCommit(repository, message, name, email, &created)
+            != NULL)
+        return nullptr;
 
-    if (ignoreEolWhitespace->BooleanValue())
-      options.flags = GIT_DIFF_IGNORE_WHITESPACE_EOL;
-  }
+      return FFL([created]() { return Nan::New<Boolean>(created); });
+    };
 
-  options.context_lines = 0;
-  if (git_diff_blob_to_buffer(blob, NULL, text.data(), text.length(), NULL,
-                              &options, NULL, NULL, NULL, DiffLineCallback,
-                              &lineDiffs) == GIT_OK) {
-    Local<Object> v8Ranges = Nan::New<Array>(lineDiffs.size());
-    for (size_t i = 0; i < lineDiffs.size(); i++) {
-      Local<Object> v8Range = Nan::New<Object>();
-
-      v8Range->Set(Nan::New<String>("oldLineNumber").ToLocalChecked(),
-                   Nan::New<Number>(lineDiffs[i].line.old_lineno));
-      v8Range->Set(Nan::New<String>("newLineNumber").ToLocalChecked(),
-                   Nan::New<Number>(lineDiffs[i].line.new_lineno));
-      v8Range->Set(Nan::New<String>("oldStart").ToLocalChecked(),
-                   Nan::New<Number>(lineDiffs[i].hunk.old_start));
-      v8Range->Set(Nan::New<String>("newStart").ToLocalChecked(),
-                   Nan::New<Number>(lineDiffs[i].hunk.new_start));
-      v8Range->Set(Nan::New<String>("oldLines").ToLocalChecked(),
-                   Nan::New<Number>(lineDiffs[i].hunk.old_lines));
-      v8Range->Set(Nan::New<String>("newLines").ToLocalChecked(),
-                   Nan::New<Number>(lineDiffs[i].hunk.new_lines));
-      v8Range->Set(Nan::New<String>("line").ToLocalChecked(),
-                   Nan::New<String>(lineDiffs[i].line.content,
-                                    lineDiffs[i].line.content_len)
-                                        .ToLocalChecked());
-
-      v8Ranges->Set(i, v8Range);
-    }
-    git_blob_free(blob);
-    return info.GetReturnValue().Set(v8Ranges);
-  } else {
-    git_blob_free(blob);
-    return info.GetReturnValue().Set(Nan::Null());
-  }
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::EXCLUSIVE,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_OBJECT,
+    "Could not create commit");
 }
 
-NAN_METHOD(Repository::GetReferences) {
-  Nan::HandleScope scope;
+NAN_METHOD(Repository::GetSubmodulePathsAsync) {
+  auto repo = GetRepository(info);
 
-  git_strarray strarray;
-  git_reference_list(&strarray, GetGitRepository(info));
-  auto references = ToReferences(&strarray);
-  git_strarray_free(&strarray);
+  RepositoryWork work =
+    [](git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
 
-  info.GetReturnValue().Set(references);
-}
+      auto paths = std::make_shared<std::vector<std::string>>();
+      git_submodule_foreach(repository, SubmoduleCallback, paths.get());
+      return FFL([paths]() { return ConvertStringVectorToV8Array(*paths); });
+    };
 
-int branch_checkout(git_repository* repo, const char* refName) {
-  git_reference* ref = NULL;
-  git_object* git_obj = NULL;
-  git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
-  opts.checkout_strategy = GIT_CHECKOUT_SAFE;
-  int success = -1;
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_REPOSITORY,
+    "Could not list submodules");
+}
 
-  if (!(success = git_reference_lookup(&ref, repo, refName)) &&
-      !(success = git_reference_peel(&git_obj, ref, GIT_OBJ_TREE)) &&
-      !(success = git_checkout_tree(repo, git_obj, &opts)))
-    success = git_repository_set_head(repo, refName);
+NAN_METHOD(Repository::GetHeadAsync) {
+  auto repo = GetRepository(info);
 
-  git_object_free(git_obj);
-  git_obj = NULL;
-  git_reference_free(ref);
-  ref = NULL;
+  RepositoryWork work =
+    [](git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
+
+      std::string head;
+      if (ReadHead(repository, &head) != GIT_OK)
+        return FFL([]() { return Nan::Null(); });
+      return FFL([head]() {
+        return Nan::New<String>(head).ToLocalChecked();
+      });
+    };
 
-  return success;
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_REPOSITORY,
+    "Could not read HEAD");
 }
 
-NAN_METHOD(Repository::CheckoutReference) {
-  Nan::HandleScope scope;
+NAN_METHOD(Repository::RefreshIndexAsync) {
+  auto repo = GetRepository(info);
 
-  if (info.Length() < 1)
-    return info.GetReturnValue().Set(Nan::New<Boolean>(false));
+  // Exclusive so that it is ordered with the writes around it.
+  RepositoryWork work =
+    [](git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
 
-  bool shouldCreateNewRef;
-  if (info.Length() > 1 && info[1]->BooleanValue())
-    shouldCreateNewRef = true;
-  else
-    shouldCreateNewRef = false;
+      ReloadIndex(repository);
+      return FFL([]() { return Nan::Undefined(); });
+    };
 
-  std::string strRefName(*String::Utf8Value(info[0]));
-  std::string suffix;
-  std::string prefix = "refs/heads/";
-  if (strRefName.find(prefix) == 0) {
-    suffix = strRefName.substr(prefix.size());
-  } else {
-    suffix = strRefName;
-    strRefName = prefix.append(strRefName);
-  }
-  const char* refName = strRefName.c_str();
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::EXCLUSIVE,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_INDEX,
+    "Could not refresh index");
+}
 
-  git_repository* repo = GetGitRepository(info);
+NAN_METHOD(Repository::IsIgnoredAsync) {
+  auto repo = GetRepository(info);
+  bool hasPath = info.Length() >= 1;
+  std::string path;
+  if (hasPath)
+    path = *String::Utf8Value(info[0]);
+
+  RepositoryWork work =
+    [hasPath, path](
+        git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
+
+      bool ignored = hasPath && IsPathIgnored(repository, path);
+      return FFL([ignored]() { return Nan::New<Boolean>(ignored); });
+    };
 
-  if (branch_checkout(repo, refName) == GIT_OK) {
-    return info.GetReturnValue().Set(Nan::New<Boolean>(true));
-  } else if (shouldCreateNewRef) {
-    git_reference* head;
-    if (git_repository_head(&head, repo) != GIT_OK)
-      return info.GetReturnValue().Set(Nan::New<Boolean>(false));
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_REPOSITORY,
+    "Could not check ignore rules");
+}
 
-    const git_oid* sha = git_reference_target(head);
-    git_commit* commit;
-    int commitStatus = git_commit_lookup(&commit, repo, sha);
-    git_reference_free(head);
+NAN_METHOD(Repository::IsSubmoduleAsync) {
+  auto repo = GetRepository(info);
+  bool hasPath = info.Length() >= 1;
+  std::string path;
+  if (hasPath)
+    path = *String::Utf8Value(info[0]);
+
+  RepositoryWork work =
+    [hasPath, path](
+        git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
+
+      bool isSubmodule = hasPath && IsSubmodulePath(repository, path);
+      return FFL([isSubmodule]() { return Nan::New<Boolean>(isSubmodule); });
+    };
 
-    if (commitStatus != GIT_OK)
-      return info.GetReturnValue().Set(Nan::New<Boolean>(false));
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_INDEX,
+    "Could not read index");
+}
 
-    git_reference* branch;
+NAN_METHOD(Repository::GetConfigValueAsync) {
+  auto repo = GetRepository(info);
+  bool hasKey = info.Length() >= 1;
+  std::string configKey;
+  if (hasKey)
+    configKey = *String::Utf8Value(info[0]);
+
+  RepositoryWork work =
+    [hasKey, configKey](
+        git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
+
+      std::string configValue;
+      if (!hasKey ||
+          ReadConfigValue(repository, configKey, &configValue) != GIT_OK)
+        return FFL([]() { return Nan::Null(); });
+      return FFL([configValue]() {
+        return Nan::New<String>(configValue).ToLocalChecked();
+      });
+    };
 
-    // N.B.: git_branch_create needs a name like 'xxx', not 'refs/heads/xxx'
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_CONFIG,
+    "Could not read config");
+}
 
-    int branchCreateStatus = git_branch_create(
-        &branch, repo, suffix.c_str(), commit, 0);
+NAN_METHOD(Repository::SetConfigValueAsync) {
+  auto repo = GetRepository(info);
+  bool hasValue = info.Length() >= 2;
+  std::string configKey, configValue;
+  if (hasValue) {
+    configKey = *String::Utf8Value(info[0]);
+    configValue = *String::Utf8Value(info[1]);
+  }
 
-    git_commit_free(commit);
+  RepositoryWork work =
+    [hasValue, configKey, configValue](
+        git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
 
-    if (branchCreateStatus != GIT_OK)
-      return info.GetReturnValue().Set(Nan::New<Boolean>(false));
+      bool result = hasValue &&
+        WriteConfigValue(repository, configKey, configValue) == GIT_OK;
+      return FFL([result]() { return Nan::New<Boolean>(result); });
+    };
 
-    git_reference_free(branch);
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::EXCLUSIVE,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_CONFIG,
+    "Could not write config");
+}
 
-    if (branch_checkout(repo, refName) == GIT_OK)
-      return info.GetReturnValue().Set(Nan::New<Boolean>(true));
-  }
+NAN_METHOD(Repository::GetReferenceTargetAsync) {
+  auto repo = GetRepository(info);
+  bool hasName = info.Length() >= 1;
+  std::string refName;
+  if (hasName)
+    refName = *String::Utf8Value(info[0]);
+
+  RepositoryWork work =
+    [hasName, refName](
+        git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
+
+      std::string target;
+      if (!hasName ||
+          ReadReferenceTarget(repository, refName, &target) != GIT_OK)
+        return FFL([]() { return Nan::Null(); });
+      return FFL([target]() {
+        return Nan::New<String>(target).ToLocalChecked();
+      });
+    };
 
-  return info.GetReturnValue().Set(Nan::New<Boolean>(false));
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_REFERENCE,
+    "Could not resolve reference");
 }
 
-NAN_METHOD(Repository::Add) {
-  Nan::HandleScope scope;
+NAN_METHOD(Repository::GetReferencesAsync) {
+  auto repo = GetRepository(info);
 
-  git_repository* repository = GetGitRepository(info);
-  std::string path(*String::Utf8Value(info[0]));
+  RepositoryWork work =
+    [](git_repository* repository, Progress* progress) -> GetResult {
+      git_strarray strarray;
+      if (repository == NULL ||
+          git_reference_list(&strarray, repository) != GIT_OK)
+        return nullptr;
+
+      std::vector<std::string*> refs;
+      for (size_t i = 0; i < strarray.count; i++)
+        refs.push_back(new std::string(strarray.strings[i]));
+      git_strarray_free(&strarray);
+      return FFL([refs]() { return ToReferences(&refs); });
+    };
 
-  git_index* index;
-  if (git_repository_index(&index, repository) != GIT_OK) {
-    const git_error* e = giterr_last();
-    if (e != NULL)
-      return Nan::ThrowError(e->message);
-    else
-      return Nan::ThrowError("Unknown error opening index");
-  }
-  // Modify the in-memory index.
-  if (git_index_add_bypath(index, path.c_str()) != GIT_OK) {
-    git_index_free(index);
-    const git_error* e = giterr_last();
-    if (e != NULL)
-      return Nan::ThrowError(e->message);
-    else
-      return Nan::ThrowError("Unknown error adding path to index");
-  }
-  // Write this change in the index back to disk, so it is persistent
-  if (git_index_write(index) != GIT_OK) {
-    git_index_free(index);
-    const git_error* e = giterr_last();
-    if (e != NULL)
-      return Nan::ThrowError(e->message);
-    else
-      return Nan::ThrowError("Unknown error adding path to index");
-  }
-  git_index_free(index);
-  info.GetReturnValue().Set(Nan::New<Boolean>(true));
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::INTERACTIVE,
+    nullptr,
+    work,
+    GITERR_REFERENCE,
+    "Could not list references");
 }
 
-NAN_METHOD(Repository::Commit) {
+NAN_METHOD(Repository::Watch) {
   Nan::HandleScope scope;
+  Repository* repo = GetRepository(info);
+  if (repo->watcher)
+    return info.GetReturnValue().Set(Nan::New<Boolean>(true));
 
-  git_repository* repo = GetGitRepository(info);
-  std::string message(*String::Utf8Value(info[0]));
-  std::string name(*String::Utf8Value(info[1]));
-  std::string email(*String::Utf8Value(info[2]));
-
-  bool res;
-  git_index *index;
-  git_reference *ref;
-  git_reference *direct_ref;
-  git_object *commitObj;
-  git_signature *s;
-  git_oid treeOid;
-  git_oid resOid;
-
-  if (git_repository_index(&index, repo) != GIT_OK)
-    return Nan::ThrowError("Can't access index");
-
-  if (git_repository_head(&ref, repo) != GIT_OK)
-    return Nan::ThrowError("Head not found");
+  const char* workdir = NULL;
+  if (repo->repository != NULL)
+    workdir = git_repository_workdir(repo->repository);
+  if (workdir == NULL)
+    return info.GetReturnValue().Set(Nan::New<Boolean>(false));
 
-  if (git_reference_resolve(&direct_ref, ref) != GIT_OK)
-    return Nan::ThrowError("Can't resolve head");
+  Callback* onChange = NULL;
+  if (info.Length() >= 1 && info[0]->IsFunction())
+    onChange = new Callback(Local<Function>::Cast(info[0]));
 
-  if (git_reference_peel(&commitObj, direct_ref, GIT_OBJ_COMMIT) != GIT_OK)
-    return Nan::ThrowError("Can't find parent commit");
+  std::shared_ptr<StatusWatcher> watcher = std::make_shared<StatusWatcher>(
+    workdir, git_repository_path(repo->repository), onChange);
+  if (!watcher->Start())
+    return info.GetReturnValue().Set(Nan::New<Boolean>(false));
 
-  auto commitOid = git_object_id(commitObj);
+  repo->watcher = watcher;
+  return info.GetReturnValue().Set(Nan::New<Boolean>(true));
+}
 
-  git_signature_now(&s, name.c_str(), email.c_str());
+NAN_METHOD(Repository::Unwatch) {
+  Nan::HandleScope scope;
+  Repository* repo = GetRepository(info);
+  if (repo->watcher) {
+    repo->watcher->Stop();
+    repo->watcher.reset();
+  }
+  info.GetReturnValue().SetUndefined();
+}
 
-  git_index_write_tree(&treeOid, index);
-  res = git_commit_create_from_callback(
-      &resOid, repo, "HEAD", s, s,
-      NULL, message.c_str(), &treeOid, OnSingleParentCommit,
-      (void*)commitOid) == GIT_OK;
+NAN_METHOD(Repository::GetStatusStream) {
+  auto repo = GetRepository(info);
+  if (info.Length() < 1 || !info[0]->IsFunction())
+    return Nan::ThrowTypeError("A chunk callback is required");
+
+  Callback* onChunk = new Callback(Local<Function>::Cast(info[0]));
+  bool packed = IsPackedFormat(info[1]);
+  int untrackedCache = GetUntrackedCacheOption(info[1]);
+  size_t chunkSize = GetChunkSizeOption(info[1]);
+
+  RepositoryWork work =
+    [packed, untrackedCache, chunkSize](
+        git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
+
+      StatusStream stream = {
+        progress, chunkSize, packed, std::make_shared<PackedStatus>(), 0
+      };
+      std::unique_ptr<UntrackedCache> cache(
+          UntrackedCache::Open(repository, untrackedCache));
+      int error = CollectStatuses(
+          repository, NULL, StatusStreamCallback, &stream, cache.get());
+
+      bool cancelled = progress->IsCancelled();
+      if (error != GIT_OK && !cancelled)
+        return nullptr;
+      if (!cancelled) {
+        stream.Flush();
+        if (cache)
+          cache->Save(true);
+      }
 
-  git_reference_free(ref);
-  git_signature_free(s);
-  git_object_free(commitObj);
-  git_reference_free(direct_ref);
-  git_index_free(index);
+      double total = stream.total;
+      return FFL([total]() { return Nan::New<Number>(total); });
+    };
 
-  info.GetReturnValue().Set(Nan::New<Boolean>(res));
+  GitWorker::RunAsync(
+    &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::INTERACTIVE,
+    onChunk,
+    work,
+    GITERR_REPOSITORY,
+    "Could not get repository status");
 }
 
-NAN_METHOD(Repository::GetRemoteReferences) {
-  Nan::HandleScope scope;
-
+NAN_METHOD(Repository::GetStatusSummary) {
   auto repo = GetRepository(info);
+  bool dirtyOnly = GetBoolOption(info[0], "dirtyOnly");
+  int untrackedCache = GetUntrackedCacheOption(info[0]);
+  StatusScan scan = StatusScanner(info[0]);
+  std::shared_ptr<StatusWatcher> watcher = repo->watcher;
+
+  RepositoryWork work =
+    [dirtyOnly, untrackedCache, scan, watcher](
+        git_repository* repository, Progress* progress) -> GetResult {
+      if (repository == NULL)
+        return nullptr;
+
+      StatusSummary summary = { dirtyOnly, false, 0, 0, 0, 0, 0 };
+      if (CountConflicts(repository, &summary.conflicted) != GIT_OK)
+        return nullptr;
+
+      int error = GIT_OK;
+      if (watcher) {
+        StatusMap statuses;
+        error = watcher->GetStatus(repository, scan, &statuses);
+        StatusMap::iterator iter = statuses.begin();
+        for (; error == GIT_OK && iter != statuses.end(); ++iter)
+          if (StatusSummaryCallback(
+                iter->first.c_str(), iter->second, &summary) != GIT_OK)
+            break;
+      } else if (dirtyOnly) {
+        // One change is enough, there is no need to look inside untracked
+        // directories.
+        summary.dirty = summary.conflicted > 0;
+        git_status_options options = GIT_STATUS_OPTIONS_INIT;
+        options.flags = GIT_STATUS_OPT_INCLUDE_UNTRACKED;
+        if (!summary.dirty)
+          error = git_status_foreach_ext(
+              repository, &options, StatusSummaryCallback, &summary);
+      } else {
+        std::unique_ptr<UntrackedCache> cache(
+            UntrackedCache::Open(repository, untrackedCache));
+        error = CollectStatuses(
+            repository, NULL, StatusSummaryCallback, &summary, cache.get());
+        if (cache && error == GIT_OK)
+          cache->Save(true);
+      }
 
-  Work work =
-    [repo](Progress* progress) {
-      return repo->RunOnRemote(ListRemoteRefs, nullptr, GIT_DIRECTION_FETCH);
+      if (error != GIT_OK && !(dirtyOnly && summary.dirty))
+        return nullptr;
+      summary.dirty = summary.dirty || summary.conflicted > 0;
+      return FFL([summary]() { return ToStatusSummary(summary); });
     };
 
   GitWorker::RunAsync(
     &info,
+    &repo->queue,
+    WorkQueue::READ_ONLY,
+    Scheduler::INTERACTIVE,
     nullptr,
     work,
     GITERR_REPOSITORY,
-    "Could not load list of references from remote repository");
+    "Could not get repository status");
 }
 
-Repository::Repository(Local<String> path) {
+Repository::Repository(Local<String> path)
+    : lineDiffRequests(std::make_shared<LatestRequests>()) {
   Nan::HandleScope scope;
 
   std::string repositoryPath(*String::Utf8Value(path));
   if (git_repository_open_ext(
         &repository, repositoryPath.c_str(), 0, NULL) != GIT_OK)
     repository = NULL;
+  else
+    queue.SetPath(git_repository_path(repository));
+  if (repository != NULL)
+    headCache = std::make_shared<HeadCache>(git_repository_path(repository));
 }
 
 Repository::~Repository() {
+  if (watcher)
+    watcher->Stop();
+  queue.Close();
   if (repository != NULL) {
     git_repository_free(repository);
     repository = NULL;
@@ -29,16 +29,39 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <memory>
 
+#include "./changed-paths.h"
 #include "./common.h"
+#include "./commit-cache.h"
+#include "./commit-graph.h"
+#include "./commit-log.h"
+#include "./head-cache.h"
+#include "./latest-requests.h"
+#include "./status-watcher.h"
+#include "./work-queue.h"
 
 using namespace v8;  // NOLINT
 
+class UntrackedCache;
+
 class Repository : public Nan::ObjectWrap {
  public:
     static void Init(Local<Object> target);
     static Nan::Persistent<v8::Function> constructor;
+    static git_diff_options CreateDefaultGitDiffOptions();
+    static int LookupBlob(
+        git_repository* repo, const std::string& path, bool useIndex,
+        git_blob*& blob, HeadCache* headCache = NULL);
     git_repository* repository;
+    WorkQueue queue;
+    std::shared_ptr<StatusWatcher> watcher;
+    std::shared_ptr<HeadCache> headCache;
+    std::shared_ptr<CommitGraph> commitGraph;
+    std::shared_ptr<ChangedPaths> changedPaths;
+    std::shared_ptr<LogWalks> logWalks;
+    std::shared_ptr<CommitCache> commitCache;
+    std::shared_ptr<LatestRequests> lineDiffRequests;
 
  private:
     static NAN_METHOD(Open);
@@ -65,6 +88,8 @@ class Repository : public Nan::ObjectWrap {
     static NAN_METHOD(GetHeadBlob);
     static NAN_METHOD(GetCommitCount);
     static NAN_METHOD(GetMergeBase);
+    static NAN_METHOD(GetUpstreamBranch);
+    static NAN_METHOD(GetAheadBehindCount);
     static NAN_METHOD(Release);
     static NAN_METHOD(GetLineDiffs);
     static NAN_METHOD(GetLineDiffDetails);
@@ -73,10 +98,58 @@ class Repository : public Nan::ObjectWrap {
     static NAN_METHOD(CheckoutReference);
     static NAN_METHOD(Add);
     static NAN_METHOD(Commit);
+    static NAN_METHOD(Watch);
+    static NAN_METHOD(Unwatch);
+
+    static NAN_METHOD(GetStatusAsync);
+    static NAN_METHOD(GetStatusForPathsAsync);
+    static NAN_METHOD(CheckoutHeadAsync);
+    static NAN_METHOD(GetDiffStatsAsync);
+    static NAN_METHOD(GetIndexBlobAsync);
+    static NAN_METHOD(GetHeadBlobAsync);
+    static NAN_METHOD(GetCommitCountAsync);
+    static NAN_METHOD(GetMergeBaseAsync);
+    static NAN_METHOD(GetAheadBehindCounts);
+    static NAN_METHOD(GetPathHistory);
+    static NAN_METHOD(GetLog);
+    static NAN_METHOD(GetCommits);
+    static NAN_METHOD(GetCommitCacheStats);
+    static NAN_METHOD(GetLineDiffsAsync);
+    static NAN_METHOD(GetLineDiffDetailsAsync);
+    static NAN_METHOD(GetLineDiffStats);
+    static NAN_METHOD(CheckoutReferenceAsync);
+    static NAN_METHOD(AddAsync);
+    static NAN_METHOD(CommitAsync);
+    static NAN_METHOD(GetSubmodulePathsAsync);
+    static NAN_METHOD(GetHeadAsync);
+    static NAN_METHOD(RefreshIndexAsync);
+    static NAN_METHOD(IsIgnoredAsync);
+    static NAN_METHOD(IsSubmoduleAsync);
+    static NAN_METHOD(GetConfigValueAsync);
+    static NAN_METHOD(SetConfigValueAsync);
+    static NAN_METHOD(GetReferenceTargetAsync);
+    static NAN_METHOD(GetReferencesAsync);
+    static NAN_METHOD(GetStatusStream);
+    static NAN_METHOD(GetStatusSummary);
+    static NAN_METHOD(GetHeadBlobs);
+    static NAN_METHOD(GetIndexBlobs);
+    static NAN_METHOD(GetHeadBlobStream);
+    static NAN_METHOD(GetIndexBlobStream);
+    static NAN_METHOD(GetTreeDiffStream);
+    static NAN_METHOD(CreateDiffSession);
 
 
     static int StatusCallback(const char *path, unsigned int status,
                                                         void *payload);
+    static int ScanStatus(git_repository *repository,
+                          const std::vector<std::string> *paths,
+                          StatusMap *statuses, size_t threads,
+                          int untrackedCache);
+    static StatusScan StatusScanner(Local<Value> options);
+    static int ScanPartitions(
+        git_repository *repository,
+        const std::vector<std::vector<std::string>> &partitions,
+        size_t threads, StatusMap *statuses, UntrackedCache *untrackedCache);
     static int DiffHunkCallback(
         const git_diff_delta *delta,
         const git_diff_hunk *hunk,
@@ -101,9 +174,9 @@ class Repository : public Nan::ObjectWrap {
         Nan::NAN_METHOD_ARGS_TYPE args,
         git_repository* repo, git_blob*& blob);
 
-    static git_diff_options CreateDefaultGitDiffOptions();
     template< typename... Args>
-    GetResult RunOnRemote(
+    static GetResult RunOnRemote(
+        git_repository *repository,
         RemoteAction<Args...> action,
         const git_remote_callbacks *callbacks,
         git_direction direction,
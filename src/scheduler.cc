@@ -0,0 +1,139 @@
+#include <stdlib.h>
+#include <string.h>
+#include "./scheduler.h"
+
+Scheduler::LaneState Scheduler::lanes[Scheduler::LANE_COUNT] = {
+    LaneState("interactive", "GIT_NATIVE_INTERACTIVE_THREADS", 2),
+    LaneState("background", "GIT_NATIVE_BACKGROUND_THREADS", 2)
+};
+
+void Scheduler::Queue(AsyncWorker *worker, Lane lane) {
+    LaneState *state = &lanes[lane];
+    if (!state->started)
+        Start(state);
+
+    // The completion handle is unreferenced while the lane is idle so an
+    // idle lane does not keep the process alive.
+    if (state->outstanding++ == 0)
+        uv_ref(reinterpret_cast<uv_handle_t*>(&state->completeAsync));
+
+    uv_mutex_lock(&state->lock);
+    state->queued.push_back(worker);
+    if (state->queued.size() > state->peakQueued)
+        state->peakQueued = state->queued.size();
+    uv_cond_signal(&state->hasWork);
+    uv_mutex_unlock(&state->lock);
+}
+
+Scheduler::Lane Scheduler::LaneFromArgs(
+    const Nan::FunctionCallbackInfo<Value>& info, Lane fallback) {
+    if (info.Length() < 1)
+        return fallback;
+
+    Local<Value> last = info[info.Length() - 1];
+    if (!last->IsObject() || last->IsArray() || last->IsFunction())
+        return fallback;
+
+    Local<Value> lane = Local<Object>::Cast(last)->Get(
+        Nan::New<String>("lane").ToLocalChecked());
+    if (!lane->IsString())
+        return fallback;
+
+    String::Utf8Value laneName(lane);
+    for (int i = 0; i < LANE_COUNT; i++)
+        if (strcmp(*laneName, lanes[i].name) == 0)
+            return static_cast<Lane>(i);
+
+    return fallback;
+}
+
+NAN_METHOD(Scheduler::GetStats) {
+    Nan::HandleScope scope;
+    Local<Object> stats = Nan::New<Object>();
+
+    for (int i = 0; i < LANE_COUNT; i++) {
+        LaneState *state = &lanes[i];
+        Local<Object> laneStats = Nan::New<Object>();
+
+        size_t queued = 0, running = 0;
+        if (state->started) {
+            uv_mutex_lock(&state->lock);
+            queued = state->queued.size();
+            running = state->running;
+            uv_mutex_unlock(&state->lock);
+        }
+
+        laneStats->Set(Nan::New("threads").ToLocalChecked(),
+            Nan::New<Number>(state->threads.size()));
+        laneStats->Set(Nan::New("queued").ToLocalChecked(),
+            Nan::New<Number>(queued));
+        laneStats->Set(Nan::New("running").ToLocalChecked(),
+            Nan::New<Number>(running));
+        laneStats->Set(Nan::New("peakQueued").ToLocalChecked(),
+            Nan::New<Number>(state->peakQueued));
+        laneStats->Set(Nan::New("completed").ToLocalChecked(),
+            Nan::New<Number>(state->finished));
+        stats->Set(Nan::New(state->name).ToLocalChecked(), laneStats);
+    }
+
+    info.GetReturnValue().Set(stats);
+}
+
+void Scheduler::Start(LaneState *lane) {
+    const char *threads = getenv(lane->threadsEnv);
+    if (threads != NULL && atoi(threads) > 0)
+        lane->threadCount = atoi(threads);
+
+    uv_mutex_init(&lane->lock);
+    uv_cond_init(&lane->hasWork);
+    uv_async_init(uv_default_loop(), &lane->completeAsync, OnComplete);
+    lane->completeAsync.data = lane;
+    uv_unref(reinterpret_cast<uv_handle_t*>(&lane->completeAsync));
+
+    lane->threads.resize(lane->threadCount);
+    for (size_t i = 0; i < lane->threadCount; i++)
+        uv_thread_create(&lane->threads[i], ThreadMain, lane);
+
+    lane->started = true;
+}
+
+void Scheduler::ThreadMain(void *data) {
+    LaneState *lane = static_cast<LaneState*>(data);
+
+    for (;;) {
+        uv_mutex_lock(&lane->lock);
+        while (lane->queued.empty())
+            uv_cond_wait(&lane->hasWork, &lane->lock);
+        AsyncWorker *worker = lane->queued.front();
+        lane->queued.pop_front();
+        lane->running++;
+        uv_mutex_unlock(&lane->lock);
+
+        worker->Execute();
+
+        uv_mutex_lock(&lane->lock);
+        lane->running--;
+        lane->completed.push_back(worker);
+        uv_mutex_unlock(&lane->lock);
+
+        uv_async_send(&lane->completeAsync);
+    }
+}
+
+void Scheduler::OnComplete(uv_async_t *handle) {
+    LaneState *lane = static_cast<LaneState*>(handle->data);
+    deque<AsyncWorker*> completed;
+
+    uv_mutex_lock(&lane->lock);
+    completed.swap(lane->completed);
+    uv_mutex_unlock(&lane->lock);
+
+    for (size_t i = 0; i < completed.size(); i++) {
+        AsyncWorker *worker = completed[i];
+        lane->finished++;
+        worker->WorkComplete();
+        worker->Destroy();
+        if (--lane->outstanding == 0)
+            uv_unref(reinterpret_cast<uv_handle_t*>(&lane->completeAsync));
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef SRC_SCHEDULER_H_
+#define SRC_SCHEDULER_H_
+
+#include <nan.h>
+#include <deque>
+#include <vector>
+
+using namespace std;  // NOLINT(build/namespaces)
+using namespace v8;  // NOLINT(build/namespaces)
+using namespace Nan;  // NOLINT(build/namespaces)
+
+// Runs AsyncWorkers on thread pools owned by this module instead of the
+// shared libuv pool, so long network operations neither starve quick
+// repository calls nor the fs calls of the host application.
+//
+// Every lane has its own threads and queue. The interactive lane is meant
+// for short calls a user is waiting on, the background lane for clones,
+// fetches, pushes and other long running work. The thread count of a lane
+// can be set with the GIT_NATIVE_INTERACTIVE_THREADS and
+// GIT_NATIVE_BACKGROUND_THREADS environment variables, they are read when
+// the lane runs its first worker.
+class Scheduler {
+    public:
+        enum Lane {
+            INTERACTIVE,
+            BACKGROUND,
+            LANE_COUNT
+        };
+
+    private:
+        struct LaneState {
+            LaneState(const char *name, const char *threadsEnv,
+                      size_t threadCount)
+                : name(name), threadsEnv(threadsEnv),
+                  threadCount(threadCount) {
+            }
+
+            const char *name;
+            const char *threadsEnv;
+            size_t threadCount;
+            bool started = false;
+            vector<uv_thread_t> threads;
+            uv_mutex_t lock;
+            uv_cond_t hasWork;
+            uv_async_t completeAsync;
+            deque<AsyncWorker*> queued;
+            deque<AsyncWorker*> completed;
+            size_t outstanding = 0;
+            size_t running = 0;
+            size_t peakQueued = 0;
+            double finished = 0;
+        };
+
+        static LaneState lanes[LANE_COUNT];
+
+    public:
+        // Must be called from the main thread.
+        static void Queue(AsyncWorker *worker, Lane lane);
+
+        // Lane picked by a trailing `{ lane: 'interactive'|'background' }`
+        // options argument, |fallback| when there is none.
+        static Lane LaneFromArgs(
+            const Nan::FunctionCallbackInfo<Value>& info, Lane fallback);
+
+        static NAN_METHOD(GetStats);
+
+    private:
+        static void Start(LaneState *lane);
+        static void ThreadMain(void *data);
+        static void OnComplete(uv_async_t *handle);
+};
+
+#endif  // SRC_SCHEDULER_H_
@@ -0,0 +1,389 @@
+#include "./status-watcher.h"
+
+#include <string.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+static const uint32_t WORKDIR_MASK = IN_CREATE | IN_DELETE | IN_MODIFY |
+    IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+static const uint32_t GITDIR_MASK = IN_CREATE | IN_DELETE | IN_CLOSE_WRITE |
+    IN_MOVED_TO | IN_ONLYDIR;
+#endif
+
+StatusWatcher::StatusWatcher(const char *workdir, const char *gitdir,
+                             Callback *onChange)
+    : workdir(workdir), gitdir(gitdir), onChange(onChange) {
+    uv_mutex_init(&lock);
+    uv_mutex_init(&queryLock);
+}
+
+StatusWatcher::~StatusWatcher() {
+    Stop();
+    uv_mutex_destroy(&lock);
+    uv_mutex_destroy(&queryLock);
+    delete onChange;
+}
+
+bool StatusWatcher::Start() {
+#ifdef __linux__
+    if (running)
+        return true;
+
+    inotifyFd = inotify_init1(IN_CLOEXEC);
+    if (inotifyFd < 0)
+        return false;
+
+    if (pipe(stopPipe) != 0) {
+        close(inotifyFd);
+        inotifyFd = -1;
+        return false;
+    }
+
+    notifyAsync = new uv_async_t;
+    uv_async_init(uv_default_loop(), notifyAsync, OnNotify);
+    notifyAsync->data = this;
+
+    uv_mutex_lock(&lock);
+    running = true;
+    uv_mutex_unlock(&lock);
+    uv_thread_create(&thread, ThreadMain, this);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void StatusWatcher::Stop() {
+#ifdef __linux__
+    if (!running)
+        return;
+
+    if (write(stopPipe[1], "x", 1) != 1) {
+        // The thread polls the pipe, nothing else can wake it up.
+    }
+    uv_thread_join(&thread);
+
+    uv_mutex_lock(&lock);
+    running = false;
+    uv_mutex_unlock(&lock);
+
+    close(inotifyFd);
+    close(stopPipe[0]);
+    close(stopPipe[1]);
+    inotifyFd = stopPipe[0] = stopPipe[1] = -1;
+
+    uv_close(reinterpret_cast<uv_handle_t*>(notifyAsync),
+        [](uv_handle_t *handle) {
+            delete reinterpret_cast<uv_async_t*>(handle);
+        });
+    notifyAsync = nullptr;
+#endif
+}
+
+int StatusWatcher::GetStatus(git_repository *repository,
+                             const StatusScan &scan,
+                             StatusMap *statuses) {
+    int error = GIT_OK;
+    uv_mutex_lock(&queryLock);
+
+    set<string> paths;
+    uv_mutex_lock(&lock);
+    bool fullScan = needsFullScan || degraded || !running;
+    needsFullScan = false;
+    paths.swap(dirty);
+    uv_mutex_unlock(&lock);
+
+    if (fullScan) {
+        StatusMap fresh;
+        error = scan(repository, NULL, &fresh);
+        if (error == GIT_OK)
+            cache.swap(fresh);
+    } else {
+        set<string>::iterator path = paths.begin();
+        for (; path != paths.end() && error == GIT_OK; ++path) {
+            // Forget the path and, if it is a directory, everything in it.
+            // "dir0" is the first key sorting after every "dir/..." key.
+            cache.erase(*path);
+            cache.erase(cache.lower_bound(*path + "/"),
+                        cache.lower_bound(*path + "0"));
+
+            vector<string> pathspec(1, *path);
+            error = scan(repository, &pathspec, &cache);
+        }
+    }
+
+    if (error != GIT_OK) {
+        uv_mutex_lock(&lock);
+        needsFullScan = true;
+        uv_mutex_unlock(&lock);
+    } else {
+        *statuses = cache;
+    }
+
+    uv_mutex_unlock(&queryLock);
+    return error;
+}
+
+void StatusWatcher::ThreadMain(void *data) {
+    static_cast<StatusWatcher*>(data)->Watch();
+}
+
+void StatusWatcher::OnNotify(uv_async_t *handle) {
+    StatusWatcher *watcher = static_cast<StatusWatcher*>(handle->data);
+    set<string> changed;
+
+    uv_mutex_lock(&watcher->lock);
+    changed.swap(watcher->events);
+    uv_mutex_unlock(&watcher->lock);
+
+    if (changed.empty() || watcher->onChange == nullptr)
+        return;
+
+    Nan::HandleScope scope;
+    v8::Local<v8::Array> paths = Nan::New<v8::Array>(changed.size());
+    uint32_t i = 0;
+    set<string>::iterator path = changed.begin();
+    for (; path != changed.end(); ++path, i++)
+        paths->Set(i, Nan::New(path->c_str()).ToLocalChecked());
+
+    v8::Local<v8::Value> args[] = { paths };
+    watcher->onChange->Call(1, args);
+}
+
+#ifdef __linux__
+void StatusWatcher::Watch() {
+    if (git_repository_open_ext(&ignoreRepository, gitdir.c_str(),
+            GIT_REPOSITORY_OPEN_NO_SEARCH, NULL) != GIT_OK)
+        ignoreRepository = nullptr;
+
+    AddWatches("");
+    AddGitWatches("", false);
+    AddGitWatches("info", false);
+    AddGitWatches("refs/heads", true);
+
+    // Anything that changed while the watches were being added was missed.
+    MarkDirty("", true);
+
+    char buffer[64 * 1024];
+    struct pollfd fds[2] = {
+        { inotifyFd, POLLIN, 0 },
+        { stopPipe[0], POLLIN, 0 }
+    };
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[1].revents)
+            break;
+
+        ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+        if (length > 0)
+            HandleEvents(buffer, length);
+    }
+
+    watches.clear();
+    if (ignoreRepository != nullptr)
+        git_repository_free(ignoreRepository);
+    ignoreRepository = nullptr;
+}
+
+void StatusWatcher::AddWatches(const string &relativeDir) {
+    if (!relativeDir.empty() && ignoreRepository != nullptr) {
+        int ignored = 0;
+        if (git_ignore_path_is_ignored(&ignored, ignoreRepository,
+                (relativeDir + "/").c_str()) == GIT_OK && ignored)
+            return;
+    }
+
+    string absoluteDir = workdir + relativeDir;
+    int wd = inotify_add_watch(inotifyFd, absoluteDir.c_str(), WORKDIR_MASK);
+    if (wd < 0) {
+        // Out of watches, fall back to full scans rather than missing
+        // changes.
+        if (errno == ENOSPC) {
+            uv_mutex_lock(&lock);
+            degraded = true;
+            uv_mutex_unlock(&lock);
+        }
+        return;
+    }
+    watches[wd] = relativeDir;
+
+    vector<string> children;
+    ListDirectories(absoluteDir, &children);
+    for (size_t i = 0; i < children.size(); i++) {
+        if (relativeDir.empty() && children[i] == ".git")
+            continue;
+        AddWatches(relativeDir.empty() ?
+            children[i] : relativeDir + "/" + children[i]);
+    }
+}
+
+void StatusWatcher::AddGitWatches(const string &relativeDir,
+                                  bool recursive) {
+    string absoluteDir = gitdir + relativeDir;
+    int wd = inotify_add_watch(inotifyFd, absoluteDir.c_str(), GITDIR_MASK);
+    if (wd < 0) {
+        if (errno == ENOSPC) {
+            uv_mutex_lock(&lock);
+            degraded = true;
+            uv_mutex_unlock(&lock);
+        }
+        return;
+    }
+    watches[wd] = relativeDir.empty() ? ".git" : ".git/" + relativeDir;
+    if (!recursive)
+        return;
+
+    // Branches with slashes in their names live in subdirectories.
+    vector<string> children;
+    ListDirectories(absoluteDir, &children);
+    for (size_t i = 0; i < children.size(); i++)
+        AddGitWatches(relativeDir + "/" + children[i], true);
+}
+
+void StatusWatcher::ListDirectories(const string &absoluteDir,
+                                    vector<string> *names) {
+    DIR *dir = opendir(absoluteDir.c_str());
+    if (dir == NULL)
+        return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 ||
+            strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        bool isDir = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat st;
+            isDir = lstat((absoluteDir + "/" + entry->d_name).c_str(),
+                          &st) == 0 && S_ISDIR(st.st_mode);
+        }
+        if (isDir)
+            names->push_back(entry->d_name);
+    }
+    closedir(dir);
+}
+
+void StatusWatcher::IgnoresChanged(const string &path) {
+    MarkDirty(path, true);
+    // Directories that were ignored until now have no watch yet. Adding a
+    // watch that exists again only updates it.
+    AddWatches("");
+}
+
+void StatusWatcher::HandleEvents(const char *buffer, ssize_t length) {
+    const char *ptr = buffer;
+    while (ptr < buffer + length) {
+        const struct inotify_event *event =
+            reinterpret_cast<const struct inotify_event*>(ptr);
+        ptr += sizeof(struct inotify_event) + event->len;
+
+        if (event->mask & IN_Q_OVERFLOW) {
+            MarkDirty("", true);
+            continue;
+        }
+
+        unordered_map<int, string>::iterator watch = watches.find(event->wd);
+        if (watch == watches.end())
+            continue;
+        if (event->mask & IN_IGNORED) {
+            watches.erase(watch);
+            continue;
+        }
+        if (event->len == 0)
+            continue;
+
+        string name(event->name);
+        const string &dir = watch->second;
+        bool newDir = (event->mask & IN_ISDIR) &&
+            (event->mask & (IN_CREATE | IN_MOVED_TO));
+
+        if (dir.compare(0, 4, ".git") == 0) {
+            // Only the index, HEAD, branch tips and the exclude file change
+            // the status of the working directory, lock files are renamed
+            // over them.
+            size_t nameLength = name.length();
+            if (nameLength > 5 && name.compare(nameLength - 5, 5, ".lock") == 0)
+                continue;
+            string path = dir + "/" + name;
+            if (dir == ".git" && name == "info") {
+                if (newDir)
+                    AddGitWatches("info", false);
+                IgnoresChanged(path);
+            } else if (dir == ".git/info") {
+                if (name == "exclude")
+                    IgnoresChanged(path);
+            } else if (dir == ".git" && name != "index" && name != "HEAD" &&
+                       name != "packed-refs") {
+                continue;
+            } else {
+                if (newDir)
+                    AddGitWatches(path.substr(5), true);
+                MarkDirty(path, true);
+            }
+            continue;
+        }
+
+        string path = dir.empty() ? name : dir + "/" + name;
+        if (name == ".gitignore") {
+            IgnoresChanged(path);
+            continue;
+        }
+        if (newDir)
+            AddWatches(path);
+        MarkDirty(path, false);
+    }
+}
+#else
+void StatusWatcher::Watch() {
+}
+
+void StatusWatcher::AddWatches(const string &relativeDir) {
+}
+
+void StatusWatcher::AddGitWatches(const string &relativeDir,
+                                  bool recursive) {
+}
+
+void StatusWatcher::ListDirectories(const string &absoluteDir,
+                                    vector<string> *names) {
+}
+
+void StatusWatcher::IgnoresChanged(const string &path) {
+}
+
+void StatusWatcher::HandleEvents(const char *buffer, ssize_t length) {
+}
+#endif
+
+void StatusWatcher::MarkDirty(const string &path, bool fullScan) {
+    uv_mutex_lock(&lock);
+    if (fullScan) {
+        needsFullScan = true;
+        dirty.clear();
+    } else if (!needsFullScan) {
+        dirty.insert(path);
+        if (dirty.size() > MAX_DIRTY_PATHS) {
+            needsFullScan = true;
+            dirty.clear();
+        }
+    }
+    if (!path.empty())
+        events.insert(path);
+    uv_mutex_unlock(&lock);
+
+    if (!path.empty())
+        uv_async_send(notifyAsync);
+}
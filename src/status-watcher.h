@@ -0,0 +1,95 @@
+#ifndef SRC_STATUS_WATCHER_H_
+#define SRC_STATUS_WATCHER_H_
+
+#include <git2.h>
+#include <nan.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;  // NOLINT(build/namespaces)
+using namespace Nan;  // NOLINT(build/namespaces)
+
+typedef map<string, unsigned int> StatusMap;
+
+// Scan the status of |paths|, or of the whole working directory when
+// |paths| is NULL, into |statuses|.
+typedef function<int(
+    git_repository *repository,
+    const vector<string> *paths,
+    StatusMap *statuses)> StatusScan;
+
+// Keeps the status of a working directory up to date from inotify events.
+//
+// A thread watches every directory of the working directory that is not
+// ignored, plus the git directory, and records which paths changed. A status
+// query then only rescans those paths and patches its cached result. Changes
+// to the index, HEAD, branch refs or ignore files, a queue overflow or too
+// many dirty paths make the next query rescan everything. An ignore file
+// change also watches the directories it no longer ignores. When the inotify
+// watch limit is reached every query rescans everything.
+//
+// Changed paths are also reported to the JS callback, batched per turn of
+// the event loop. Watching is only supported on Linux, Start returns false
+// elsewhere.
+class StatusWatcher {
+    private:
+        static const size_t MAX_DIRTY_PATHS = 256;
+
+        string workdir;
+        string gitdir;
+        Callback *onChange;
+
+        uv_thread_t thread;
+        uv_async_t *notifyAsync = nullptr;
+        int inotifyFd = -1;
+        int stopPipe[2] = { -1, -1 };
+        bool running = false;
+
+        // Watcher thread only.
+        unordered_map<int, string> watches;
+        git_repository *ignoreRepository = nullptr;
+
+        uv_mutex_t lock;
+        set<string> dirty;
+        set<string> events;
+        bool needsFullScan = true;
+        bool degraded = false;
+
+        uv_mutex_t queryLock;
+        StatusMap cache;
+
+    public:
+        StatusWatcher(const char *workdir, const char *gitdir,
+                      Callback *onChange);
+        ~StatusWatcher();
+
+        bool Start();
+        void Stop();
+
+        // Bring the cached status up to date using |repository| and copy it
+        // into |statuses|. Safe to call from any thread.
+        int GetStatus(git_repository *repository, const StatusScan &scan,
+                      StatusMap *statuses);
+
+    private:
+        static void ThreadMain(void *data);
+        static void OnNotify(uv_async_t *handle);
+
+        void Watch();
+        void AddWatches(const string &relativeDir);
+        // Watch |relativeDir| of the git directory, and the directories in
+        // it when |recursive| is set.
+        void AddGitWatches(const string &relativeDir, bool recursive);
+        static void ListDirectories(const string &absoluteDir,
+                                    vector<string> *names);
+        void IgnoresChanged(const string &path);
+        void HandleEvents(const char *buffer, ssize_t length);
+        void MarkDirty(const string &path, bool fullScan);
+};
+
+#endif  // SRC_STATUS_WATCHER_H_
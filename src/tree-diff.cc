@@ -0,0 +1,233 @@
+#include <algorithm>
+#include "./parallel.h"
+#include "./tree-diff.h"
+
+namespace {
+
+const size_t FILES_PER_BATCH = 64;
+
+// What a worker thread needs from a delta, so the diff itself is never
+// shared between threads.
+struct Delta {
+    git_delta_t status;
+    string oldPath;
+    string newPath;
+    git_oid oldId;
+    git_oid newId;
+    uint16_t oldMode;
+    uint16_t newMode;
+    uint16_t similarity;
+};
+
+struct Payload {
+    TreeDiffFile *file;
+    bool statsOnly;
+};
+
+char StatusLetter(git_delta_t status) {
+    switch (status) {
+        case GIT_DELTA_ADDED:
+            return 'A';
+        case GIT_DELTA_DELETED:
+            return 'D';
+        case GIT_DELTA_RENAMED:
+            return 'R';
+        case GIT_DELTA_COPIED:
+            return 'C';
+        case GIT_DELTA_TYPECHANGE:
+            return 'T';
+        default:
+            return 'M';
+    }
+}
+
+int FileCallback(const git_diff_delta *delta, float progress, void *data) {
+    Payload *payload = static_cast<Payload*>(data);
+    if (delta->flags & GIT_DIFF_FLAG_BINARY) {
+        payload->file->added = -1;
+        payload->file->deleted = -1;
+    }
+    return 0;
+}
+
+int HunkCallback(const git_diff_delta *delta, const git_diff_hunk *range,
+                 void *data) {
+    Payload *payload = static_cast<Payload*>(data);
+    if (payload->statsOnly)
+        return 0;
+
+    TreeDiffHunk hunk;
+    hunk.oldStart = range->old_start;
+    hunk.oldLines = range->old_lines;
+    hunk.newStart = range->new_start;
+    hunk.newLines = range->new_lines;
+    payload->file->hunks.push_back(hunk);
+    return 0;
+}
+
+int LineCallback(const git_diff_delta *delta, const git_diff_hunk *range,
+                 const git_diff_line *line, void *data) {
+    Payload *payload = static_cast<Payload*>(data);
+    TreeDiffFile *file = payload->file;
+    switch (line->origin) {
+        case GIT_DIFF_LINE_ADDITION:
+            file->added++;
+            break;
+        case GIT_DIFF_LINE_DELETION:
+            file->deleted++;
+            break;
+        case GIT_DIFF_LINE_CONTEXT:
+            break;
+        default:
+            // End of file markers.
+            return 0;
+    }
+    if (payload->statsOnly || file->hunks.empty())
+        return 0;
+
+    size_t length = line->content_len;
+    while (length > 0 && (line->content[length - 1] == '\n' ||
+                          line->content[length - 1] == '\r'))
+        length--;
+    string text(1, line->origin);
+    text.append(line->content, length);
+    file->hunks.back().lines.push_back(text);
+    return 0;
+}
+
+int LookupBlob(git_repository *repository, const git_oid *id,
+               uint16_t mode, git_blob **blob) {
+    *blob = NULL;
+    // Submodules point to commits of another repository.
+    if (git_oid_iszero(id) || mode == GIT_FILEMODE_COMMIT)
+        return GIT_OK;
+    return git_blob_lookup(blob, repository, id);
+}
+
+int DiffDelta(git_repository *repository, const Delta &delta,
+              const TreeDiffOptions &options, TreeDiffFile *file) {
+    file->status = StatusLetter(delta.status);
+    file->oldPath = delta.oldPath;
+    file->newPath = delta.newPath;
+    if (delta.status == GIT_DELTA_RENAMED || delta.status == GIT_DELTA_COPIED)
+        file->similarity = delta.similarity;
+
+    git_blob *oldBlob;
+    git_blob *newBlob;
+    int error = LookupBlob(repository, &delta.oldId, delta.oldMode, &oldBlob);
+    if (error != GIT_OK)
+        return error;
+    error = LookupBlob(repository, &delta.newId, delta.newMode, &newBlob);
+    if (error != GIT_OK) {
+        git_blob_free(oldBlob);
+        return error;
+    }
+
+    git_diff_options diffOptions = GIT_DIFF_OPTIONS_INIT;
+    diffOptions.context_lines = options.statsOnly ? 0 : options.contextLines;
+    Payload payload = { file, options.statsOnly };
+    error = git_diff_blobs(oldBlob, delta.oldPath.c_str(), newBlob,
+                           delta.newPath.c_str(), &diffOptions, FileCallback,
+                           NULL, HunkCallback, LineCallback, &payload);
+    git_blob_free(oldBlob);
+    git_blob_free(newBlob);
+    return error;
+}
+
+int FindDeltas(git_repository *repository, git_tree *oldTree,
+               git_tree *newTree, const TreeDiffOptions &options,
+               vector<Delta> *deltas) {
+    git_diff_options diffOptions = GIT_DIFF_OPTIONS_INIT;
+    git_diff *diff;
+    int error = git_diff_tree_to_tree(&diff, repository, oldTree, newTree,
+                                      &diffOptions);
+    if (error != GIT_OK)
+        return error;
+
+    if (options.renames) {
+        git_diff_find_options findOptions = GIT_DIFF_FIND_OPTIONS_INIT;
+        findOptions.flags = GIT_DIFF_FIND_RENAMES;
+        findOptions.rename_threshold = options.renameThreshold;
+        error = git_diff_find_similar(diff, &findOptions);
+        if (error != GIT_OK) {
+            git_diff_free(diff);
+            return error;
+        }
+    }
+
+    size_t count = git_diff_num_deltas(diff);
+    for (size_t i = 0; i < count; i++) {
+        const git_diff_delta *delta = git_diff_get_delta(diff, i);
+        Delta entry;
+        entry.status = delta->status;
+        entry.oldPath = delta->old_file.path;
+        entry.newPath = delta->new_file.path;
+        git_oid_cpy(&entry.oldId, &delta->old_file.id);
+        git_oid_cpy(&entry.newId, &delta->new_file.id);
+        entry.oldMode = delta->old_file.mode;
+        entry.newMode = delta->new_file.mode;
+        entry.similarity = delta->similarity;
+        deltas->push_back(entry);
+    }
+    git_diff_free(diff);
+    return GIT_OK;
+}
+
+}  // namespace
+
+int DiffTrees(git_repository *repository, git_tree *oldTree,
+              git_tree *newTree, const TreeDiffOptions &options,
+              const TreeDiffSink &sink, size_t *count) {
+    *count = 0;
+    vector<Delta> deltas;
+    int error = FindDeltas(repository, oldTree, newTree, options, &deltas);
+    if (error != GIT_OK)
+        return error;
+
+    size_t threads = ParallelThreadCount(
+        options.threads, min(deltas.size(), FILES_PER_BATCH));
+    string gitPath(git_repository_path(repository));
+    vector<git_repository*> handles(threads, NULL);
+    handles[0] = repository;
+
+    bool stopped = false;
+    for (size_t start = 0; start < deltas.size() && !stopped &&
+         error == GIT_OK; start += FILES_PER_BATCH) {
+        size_t batch = min(deltas.size() - start, FILES_PER_BATCH);
+        vector<shared_ptr<TreeDiffFile>> files(batch);
+        vector<int> errors(batch, GIT_OK);
+
+        ParallelFor(batch, threads, [&](size_t index, size_t thread) {
+            if (handles[thread] == NULL &&
+                git_repository_open_ext(&handles[thread], gitPath.c_str(),
+                                        GIT_REPOSITORY_OPEN_NO_SEARCH, NULL)
+                  != GIT_OK) {
+                handles[thread] = NULL;
+                errors[index] = -1;
+                return;
+            }
+
+            files[index] = make_shared<TreeDiffFile>();
+            errors[index] = DiffDelta(handles[thread], deltas[start + index],
+                                      options, files[index].get());
+        });
+
+        // Hand the batch out in diff order whatever order it finished in.
+        for (size_t i = 0; i < batch; i++) {
+            if (errors[i] != GIT_OK) {
+                error = errors[i];
+                break;
+            }
+            if (!sink(files[i])) {
+                stopped = true;
+                break;
+            }
+            (*count)++;
+        }
+    }
+
+    for (size_t i = 1; i < threads; i++)
+        if (handles[i] != NULL)
+            git_repository_free(handles[i]);
+    return error;
+}
@@ -0,0 +1,61 @@
+#ifndef SRC_TREE_DIFF_H_
+#define SRC_TREE_DIFF_H_
+
+#include <git2.h>
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;  // NOLINT(build/namespaces)
+
+struct TreeDiffHunk {
+    uint32_t oldStart;
+    uint32_t oldLines;
+    uint32_t newStart;
+    uint32_t newLines;
+    // Every line prefixed with its origin, ' ', '+' or '-', without the
+    // line ending.
+    vector<string> lines;
+};
+
+struct TreeDiffFile {
+    // The letter git diff --name-status uses, A, C, D, M, R or T.
+    char status = 'M';
+    string oldPath;
+    string newPath;
+    // How similar the old and new contents are, in percent, for renames and
+    // copies.
+    uint16_t similarity = 0;
+    // Both -1 when the file is binary.
+    int32_t added = 0;
+    int32_t deleted = 0;
+    vector<TreeDiffHunk> hunks;
+};
+
+struct TreeDiffOptions {
+    bool renames = false;
+    uint16_t renameThreshold = 50;
+    // Only count lines, never copy their contents.
+    bool statsOnly = false;
+    uint32_t contextLines = 3;
+    // 0 for one thread per core.
+    size_t threads = 0;
+};
+
+// Receives the files of a diff in order. Returns false to stop diffing.
+typedef function<bool(const shared_ptr<TreeDiffFile> &file)> TreeDiffSink;
+
+// Diff |oldTree| against |newTree|, either may be NULL for an empty tree.
+//
+// One tree to tree diff, followed by rename detection when asked for, finds
+// the changed files. Their patches are then computed straight from the blobs
+// on up to |options.threads| threads, each with its own repository handle,
+// a batch of files at a time so memory use doesn't depend on the size of
+// the diff. |count| is set to the number of files handed to |sink|.
+int DiffTrees(git_repository *repository, git_tree *oldTree,
+              git_tree *newTree, const TreeDiffOptions &options,
+              const TreeDiffSink &sink, size_t *count);
+
+#endif  // SRC_TREE_DIFF_H_
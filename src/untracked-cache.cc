@@ -0,0 +1,363 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "./untracked-cache.h"
+
+namespace {
+
+const char MAGIC[4] = { 'G', 'N', 'U', 'C' };
+
+uint64_t Hash(uint64_t hash, const char *data, size_t length) {
+    // 64-bit FNV-1a.
+    for (size_t i = 0; i < length; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t HashFile(uint64_t hash, const string &path) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == NULL)
+        return Hash(hash, "\0", 1);
+
+    char buffer[8192];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        hash = Hash(hash, buffer, length);
+    fclose(file);
+    return Hash(hash, "\1", 1);
+}
+
+bool Stat(const string &path, uv_stat_t *stat) {
+    uv_fs_t request;
+    bool found = uv_fs_stat(NULL, &request, path.c_str(), NULL) == 0;
+    if (found)
+        *stat = request.statbuf;
+    uv_fs_req_cleanup(&request);
+    return found;
+}
+
+bool IsIgnored(git_repository *repository, const string &path) {
+    int ignored = 0;
+    return git_ignore_path_is_ignored(&ignored, repository, path.c_str())
+        == GIT_OK && ignored;
+}
+
+// Little-endian encoding of the cache file.
+void PutInt(string *out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++)
+        out->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+}
+
+void PutString(string *out, const string &value) {
+    PutInt(out, value.size(), 4);
+    out->append(value);
+}
+
+void PutStrings(string *out, const vector<string> &values) {
+    PutInt(out, values.size(), 4);
+    for (size_t i = 0; i < values.size(); i++)
+        PutString(out, values[i]);
+}
+
+struct Reader {
+    const string &data;
+    size_t offset;
+    bool ok;
+
+    uint64_t Int(int bytes) {
+        if (!ok || data.size() - offset < static_cast<size_t>(bytes)) {
+            ok = false;
+            return 0;
+        }
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; i++)
+            value |= static_cast<uint64_t>(
+                static_cast<unsigned char>(data[offset + i])) << (8 * i);
+        offset += bytes;
+        return value;
+    }
+
+    string String() {
+        size_t length = Int(4);
+        if (!ok || data.size() - offset < length) {
+            ok = false;
+            return string();
+        }
+        string value = data.substr(offset, length);
+        offset += length;
+        return value;
+    }
+
+    void Strings(vector<string> *values) {
+        size_t count = Int(4);
+        for (size_t i = 0; ok && i < count; i++)
+            values->push_back(String());
+    }
+};
+
+}  // namespace
+
+UntrackedCache::UntrackedCache(git_repository *repository) {
+    const char *workdirPath = git_repository_workdir(repository);
+    if (workdirPath != NULL)
+        workdir = workdirPath;
+    string gitdir(git_repository_path(repository));
+    cachePath = gitdir + "git-native/untracked-cache";
+
+    // Rules that apply everywhere, a change to them drops the whole cache.
+    uint32_t version = VERSION;
+    globalHash = Hash(14695981039346656037ULL,
+        reinterpret_cast<const char*>(&version), sizeof(version));
+    globalHash = HashFile(globalHash, gitdir + "info/exclude");
+    git_config *config = NULL;
+    if (git_repository_config(&config, repository) == GIT_OK) {
+        git_buf excludesFile = { NULL, 0, 0 };
+        if (git_config_get_path(&excludesFile, config, "core.excludesfile")
+                == GIT_OK)
+            globalHash = HashFile(globalHash, excludesFile.ptr);
+        git_buf_free(&excludesFile);
+        git_config_free(config);
+    }
+
+    uv_mutex_init(&lock);
+}
+
+UntrackedCache::~UntrackedCache() {
+    uv_mutex_destroy(&lock);
+}
+
+bool UntrackedCache::IsEnabled(git_repository *repository, int option) {
+    if (option == 0 || option == 1)
+        return option == 1;
+    if (git_repository_workdir(repository) == NULL)
+        return false;
+
+    git_config *config = NULL;
+    int enabled = 0;
+    if (git_repository_config(&config, repository) == GIT_OK) {
+        if (git_config_get_bool(&enabled, config, "core.untrackedCache")
+                != GIT_OK)
+            enabled = 0;
+        git_config_free(config);
+    }
+    return enabled != 0;
+}
+
+UntrackedCache* UntrackedCache::Open(git_repository *repository, int option) {
+    if (!IsEnabled(repository, option))
+        return NULL;
+
+    UntrackedCache *cache = new UntrackedCache(repository);
+    cache->Load();
+    return cache;
+}
+
+bool UntrackedCache::Load() {
+    FILE *file = fopen(cachePath.c_str(), "rb");
+    if (file == NULL)
+        return false;
+
+    string data;
+    char buffer[65536];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        data.append(buffer, length);
+    fclose(file);
+
+    if (data.size() < sizeof(MAGIC) ||
+        memcmp(data.data(), MAGIC, sizeof(MAGIC)) != 0)
+        return false;
+
+    Reader reader = { data, sizeof(MAGIC), true };
+    if (reader.Int(4) != VERSION || reader.Int(8) != globalHash)
+        return false;
+
+    unordered_map<string, Entry> loaded;
+    size_t count = reader.Int(4);
+    for (size_t i = 0; reader.ok && i < count; i++) {
+        string directory = reader.String();
+        Entry &entry = loaded[directory];
+        entry.mtimeSec = static_cast<int64_t>(reader.Int(8));
+        entry.mtimeNsec = static_cast<int64_t>(reader.Int(8));
+        entry.ignoreHash = reader.Int(8);
+        reader.Strings(&entry.files);
+        reader.Strings(&entry.directories);
+    }
+    if (!reader.ok)
+        return false;
+
+    uv_mutex_lock(&lock);
+    entries.swap(loaded);
+    uv_mutex_unlock(&lock);
+    return true;
+}
+
+bool UntrackedCache::Save(bool prune) {
+    string data(MAGIC, sizeof(MAGIC));
+
+    uv_mutex_lock(&lock);
+    if (prune) {
+        unordered_map<string, Entry>::iterator entry = entries.begin();
+        while (entry != entries.end()) {
+            if (entry->second.used) {
+                ++entry;
+            } else {
+                entry = entries.erase(entry);
+                modified = true;
+            }
+        }
+    }
+    if (!modified) {
+        uv_mutex_unlock(&lock);
+        return true;
+    }
+    PutInt(&data, VERSION, 4);
+    PutInt(&data, globalHash, 8);
+    PutInt(&data, entries.size(), 4);
+    unordered_map<string, Entry>::iterator entry = entries.begin();
+    for (; entry != entries.end(); ++entry) {
+        PutString(&data, entry->first);
+        PutInt(&data, static_cast<uint64_t>(entry->second.mtimeSec), 8);
+        PutInt(&data, static_cast<uint64_t>(entry->second.mtimeNsec), 8);
+        PutInt(&data, entry->second.ignoreHash, 8);
+        PutStrings(&data, entry->second.files);
+        PutStrings(&data, entry->second.directories);
+    }
+    modified = false;
+    uv_mutex_unlock(&lock);
+
+    // Write a temporary file and rename it over the cache so readers never
+    // see a partial file.
+    uv_fs_t request;
+    string directory = cachePath.substr(0, cachePath.rfind('/'));
+    uv_fs_mkdir(NULL, &request, directory.c_str(), 0777, NULL);
+    uv_fs_req_cleanup(&request);
+
+    string tempPath = cachePath + ".tmp";
+    FILE *file = fopen(tempPath.c_str(), "wb");
+    if (file == NULL)
+        return false;
+    bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+    written = fclose(file) == 0 && written;
+
+    if (written) {
+        written = uv_fs_rename(NULL, &request, tempPath.c_str(),
+                               cachePath.c_str(), NULL) == 0;
+        uv_fs_req_cleanup(&request);
+    }
+    if (!written)
+        remove(tempPath.c_str());
+    return written;
+}
+
+void UntrackedCache::ListUntracked(git_repository *repository,
+                                   const string &directory,
+                                   vector<string> *paths) {
+    uv_stat_t stat;
+    if (Stat(workdir + directory + ".git", &stat)) {
+        paths->push_back(directory);
+        return;
+    }
+
+    // The rules of every .gitignore above |directory| apply to it.
+    uint64_t hash = globalHash;
+    size_t slash = 0;
+    while (slash < directory.size() - 1) {
+        hash = HashFile(hash, workdir + directory.substr(0, slash) +
+                        ".gitignore");
+        slash = directory.find('/', slash) + 1;
+    }
+    List(repository, directory, hash, paths);
+}
+
+void UntrackedCache::List(git_repository *repository, const string &directory,
+                          uint64_t parentHash, vector<string> *paths) {
+    uint64_t ignoreHash = HashFile(parentHash,
+                                   workdir + directory + ".gitignore");
+
+    uv_stat_t stat;
+    if (!Stat(workdir + directory, &stat))
+        return;
+
+    Entry entry;
+    if (!Lookup(directory, &entry) ||
+        entry.mtimeSec != stat.st_mtim.tv_sec ||
+        entry.mtimeNsec != stat.st_mtim.tv_nsec ||
+        entry.ignoreHash != ignoreHash) {
+        entry = Entry();
+        Scan(repository, directory, &entry);
+        entry.ignoreHash = ignoreHash;
+        entry.mtimeSec = stat.st_mtim.tv_sec;
+        entry.mtimeNsec = stat.st_mtim.tv_nsec;
+        if (time(NULL) - entry.mtimeSec < 2)
+            entry.mtimeSec = entry.mtimeNsec = -1;
+        Store(directory, entry);
+    }
+
+    for (size_t i = 0; i < entry.files.size(); i++)
+        paths->push_back(directory + entry.files[i]);
+    for (size_t i = 0; i < entry.directories.size(); i++)
+        List(repository, directory + entry.directories[i] + "/", ignoreHash,
+             paths);
+}
+
+bool UntrackedCache::Lookup(const string &directory, Entry *entry) {
+    uv_mutex_lock(&lock);
+    unordered_map<string, Entry>::iterator found = entries.find(directory);
+    bool hit = found != entries.end();
+    if (hit) {
+        found->second.used = true;
+        *entry = found->second;
+    }
+    uv_mutex_unlock(&lock);
+    return hit;
+}
+
+void UntrackedCache::Store(const string &directory, const Entry &entry) {
+    uv_mutex_lock(&lock);
+    entries[directory] = entry;
+    entries[directory].used = true;
+    modified = true;
+    uv_mutex_unlock(&lock);
+}
+
+void UntrackedCache::Scan(git_repository *repository, const string &directory,
+                          Entry *entry) {
+    uv_fs_t request;
+    string absolute = workdir + directory;
+    if (uv_fs_scandir(NULL, &request, absolute.c_str(), 0, NULL) < 0) {
+        uv_fs_req_cleanup(&request);
+        return;
+    }
+
+    uv_dirent_t dirent;
+    while (uv_fs_scandir_next(&request, &dirent) != UV_EOF) {
+        string name(dirent.name);
+        string path = directory + name;
+
+        bool isDirectory = dirent.type == UV_DIRENT_DIR;
+        if (dirent.type == UV_DIRENT_UNKNOWN) {
+            uv_stat_t stat;
+            isDirectory = Stat(workdir + path, &stat) &&
+                (stat.st_mode & S_IFMT) == S_IFDIR;
+        }
+
+        if (!isDirectory) {
+            if (!IsIgnored(repository, path))
+                entry->files.push_back(name);
+            continue;
+        }
+
+        if (IsIgnored(repository, path + "/"))
+            continue;
+        uv_stat_t stat;
+        if (Stat(workdir + path + "/.git", &stat))
+            entry->files.push_back(name + "/");
+        else
+            entry->directories.push_back(name);
+    }
+    uv_fs_req_cleanup(&request);
+}
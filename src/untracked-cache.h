@@ -0,0 +1,78 @@
+#ifndef SRC_UNTRACKED_CACHE_H_
+#define SRC_UNTRACKED_CACHE_H_
+
+#include <git2.h>
+#include <uv.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;  // NOLINT(build/namespaces)
+
+// Remembers the untracked files of untracked directories, in the spirit of
+// the UNTR extension of git's index.
+//
+// Every directory entry records the mtime of the directory, a hash of the
+// ignore rules that apply to it and its untracked files and subdirectories.
+// While neither changed, listing the directory again is a stat instead of a
+// readdir plus an ignore check per entry. Directories modified in the last
+// couple of seconds are never trusted, a file created in the same clock tick
+// would not change their mtime.
+//
+// The cache is stored in <gitdir>/git-native/untracked-cache so it survives
+// process restarts. Lookups may happen from several threads at once.
+class UntrackedCache {
+    private:
+        static const uint32_t VERSION = 1;
+
+        struct Entry {
+            int64_t mtimeSec = 0;
+            int64_t mtimeNsec = 0;
+            uint64_t ignoreHash = 0;
+            vector<string> files;
+            vector<string> directories;
+            bool used = false;
+        };
+
+        string workdir;
+        string cachePath;
+        uint64_t globalHash = 0;
+
+        uv_mutex_t lock;
+        unordered_map<string, Entry> entries;
+        bool modified = false;
+
+    public:
+        explicit UntrackedCache(git_repository *repository);
+        ~UntrackedCache();
+
+        // Whether to use the cache: |option| when it is 0 or 1, the
+        // core.untrackedCache setting otherwise.
+        static bool IsEnabled(git_repository *repository, int option);
+
+        // A loaded cache for |repository| if IsEnabled, NULL otherwise.
+        static UntrackedCache* Open(git_repository *repository, int option);
+
+        bool Load();
+        // Write the cache back if it changed. |prune| drops the directories
+        // that were not listed since the cache was loaded, only pass it
+        // after a scan of the whole working directory.
+        bool Save(bool prune);
+
+        // Append every untracked, non-ignored file below |directory|, a
+        // repository-relative path ending in a slash, to |paths|. Nested
+        // repositories are listed as directories, like libgit2 does.
+        void ListUntracked(git_repository *repository, const string &directory,
+                           vector<string> *paths);
+
+    private:
+        void List(git_repository *repository, const string &directory,
+                  uint64_t parentHash, vector<string> *paths);
+        bool Lookup(const string &directory, Entry *entry);
+        void Store(const string &directory, const Entry &entry);
+        void Scan(git_repository *repository, const string &directory,
+                  Entry *entry);
+};
+
+#endif  // SRC_UNTRACKED_CACHE_H_
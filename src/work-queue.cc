@@ -0,0 +1,109 @@
+#include "./work-queue.h"
+#include "./git-worker.h"
+
+WorkQueue::WorkQueue(size_t maxReaders) : maxReaders(maxReaders) {
+    uv_mutex_init(&handlesLock);
+}
+
+WorkQueue::~WorkQueue() {
+    Close();
+    uv_mutex_destroy(&handlesLock);
+}
+
+void WorkQueue::SetPath(const char *gitPath) {
+    uv_mutex_lock(&handlesLock);
+    FreeIdleHandles();
+    path = gitPath ? gitPath : "";
+    closed = false;
+    uv_mutex_unlock(&handlesLock);
+}
+
+void WorkQueue::Push(GitWorker *worker, Access access) {
+    worker->SetAccess(access);
+    pending.push_back({worker, access});
+    Dispatch();
+}
+
+void WorkQueue::Done(GitWorker *worker) {
+    if (worker->GetAccess() == EXCLUSIVE)
+        runningWriter = false;
+    else
+        runningReaders--;
+
+    ReleaseHandle(worker->GetRepository());
+    worker->SetRepository(NULL);
+    Dispatch();
+}
+
+bool WorkQueue::IsIdle() {
+    return pending.empty() && !runningWriter && runningReaders == 0;
+}
+
+void WorkQueue::Close() {
+    uv_mutex_lock(&handlesLock);
+    closed = true;
+    FreeIdleHandles();
+    uv_mutex_unlock(&handlesLock);
+}
+
+git_repository* WorkQueue::AcquireHandle() {
+    git_repository *handle = NULL;
+    string openPath;
+
+    uv_mutex_lock(&handlesLock);
+    if (!closed) {
+        if (!idleHandles.empty()) {
+            handle = idleHandles.back();
+            idleHandles.pop_back();
+        } else {
+            openPath = path;
+        }
+    }
+    uv_mutex_unlock(&handlesLock);
+
+    // Open outside the lock, Done releases handles from the main thread.
+    if (!openPath.empty() && git_repository_open_ext(
+            &handle, openPath.c_str(),
+            GIT_REPOSITORY_OPEN_NO_SEARCH, NULL) != GIT_OK)
+        handle = NULL;
+
+    return handle;
+}
+
+void WorkQueue::ReleaseHandle(git_repository *handle) {
+    if (handle == NULL)
+        return;
+
+    uv_mutex_lock(&handlesLock);
+    if (closed)
+        git_repository_free(handle);
+    else
+        idleHandles.push_back(handle);
+    uv_mutex_unlock(&handlesLock);
+}
+
+void WorkQueue::Dispatch() {
+    while (!pending.empty() && !runningWriter) {
+        Item item = pending.front();
+        if (item.access == EXCLUSIVE) {
+            if (runningReaders > 0)
+                break;
+            runningWriter = true;
+        } else {
+            if (runningReaders >= maxReaders)
+                break;
+            runningReaders++;
+        }
+        pending.pop_front();
+
+        // The worker only gets its slot here, it takes a handle on its own
+        // thread since opening one reads files under the git directory.
+        Scheduler::Queue(item.worker, item.worker->GetLane());
+    }
+}
+
+void WorkQueue::FreeIdleHandles() {
+    for (size_t i = 0; i < idleHandles.size(); i++)
+        git_repository_free(idleHandles[i]);
+    idleHandles.clear();
+}
@@ -0,0 +1,68 @@
+#ifndef SRC_WORK_QUEUE_H_
+#define SRC_WORK_QUEUE_H_
+
+#include <git2.h>
+#include <nan.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+using namespace std;  // NOLINT(build/namespaces)
+
+class GitWorker;
+
+// Ordered lane of asynchronous work for a single repository.
+//
+// A git_repository is not safe for concurrent use, so every queued worker
+// runs on a handle of its own taken from a pool of handles opened on the
+// same git directory. Exclusive work (anything that writes) runs alone and
+// in submission order; read-only work may run next to other read-only work
+// but never overtakes exclusive work queued before it.
+//
+// Push and Done must be called from the main thread. A dispatched worker
+// holds a slot, it acquires its handle in Execute on its worker thread and
+// Done releases it.
+class WorkQueue {
+    public:
+        enum Access {
+            READ_ONLY,
+            EXCLUSIVE
+        };
+
+    private:
+        struct Item {
+            GitWorker *worker;
+            Access access;
+        };
+
+        static const size_t DEFAULT_MAX_READERS = 4;
+
+        deque<Item> pending;
+        size_t runningReaders = 0;
+        bool runningWriter = false;
+        size_t maxReaders;
+        bool closed = false;
+
+        uv_mutex_t handlesLock;
+        string path;
+        vector<git_repository*> idleHandles;
+
+    public:
+        explicit WorkQueue(size_t maxReaders = DEFAULT_MAX_READERS);
+        ~WorkQueue();
+
+        void SetPath(const char *gitPath);
+        void Push(GitWorker *worker, Access access);
+        void Done(GitWorker *worker);
+        bool IsIdle();
+        void Close();
+
+        git_repository* AcquireHandle();
+        void ReleaseHandle(git_repository *handle);
+
+    private:
+        void Dispatch();
+        void FreeIdleHandles();
+};
+
+#endif  // SRC_WORK_QUEUE_H_